@@ -0,0 +1,46 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <cstddef>
+
+#include <acpp-network/iobuf.h>
+
+namespace acpp::network::async {
+
+struct broadcast_stats {
+    size_t destinations = 0;
+    // held by the queues of the destinations whose socket did not take it all
+    size_t queued = 0;
+};
+
+// Writes one message, serialized once, to many streams: stream<> tops or
+// pointers to them (raw or smart). Each destination's socket_stream keeps a
+// share of the message's blocks for what its socket has not taken, so the
+// subscribers do not hold a copy each; layers that change the bytes
+// (ssl::stream) encrypt the same blocks per destination.
+// The message lives until the last destination has sent it: wrap it with
+// iobuf::wrap to know when.
+template<typename Streams>
+broadcast_stats broadcast(Streams& streams, const iobuf& message) {
+    broadcast_stats stats;
+    for (auto& s: streams) {
+        auto& destination = [&]() -> auto& {
+            if constexpr (requires { s->write(message); })
+                return *s;
+            else
+                return s;
+        }();
+        destination.write(message);
+        stats.destinations++;
+        if (destination.pending_output())
+            stats.queued++;
+    }
+    return stats;
+}
+
+} // namespace acpp::network::async
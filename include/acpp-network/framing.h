@@ -0,0 +1,352 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <acpp-network/stream.h>
+
+namespace acpp::network::async {
+
+// Length prefix of each frame. Fixed widths are big endian, varint is LEB128.
+enum class length_prefix { varint, fixed8, fixed16, fixed32, fixed64 };
+
+struct framing_options {
+    length_prefix prefix = length_prefix::varint;
+    // Larger frames, sent or received, are an error
+    size_t max_frame = 16 * 1024 * 1024;
+};
+
+// Received frames; `copied` are the ones that straddled receive buffers
+struct framing_stats {
+    size_t frames = 0;
+    size_t copied = 0;
+    size_t copied_bytes = 0;
+};
+
+// Message framing over a byte stream. Each write is one frame; each frame
+// goes up as one on_received. A frame that sits whole in the buffer handed up
+// by the layer below is passed on in place, only frames split across buffers
+// are assembled in a copy.
+template<typename Next = null_layer>
+class framing_layer {
+public:
+    enum {it = Next::it+1,};
+    using next_type = Next;
+    using chain_type = append_to_tuple_t<typename next_type::chain_type, framing_layer* >;
+    using last_type = next_type::last_type;
+
+    static constexpr size_t max_header = 10;
+
+    framing_layer(side_t side): side_(side), next_(side) {
+        next_.prev_ = this;
+    }
+
+    // Options come from the context when it has framing()
+    template<typename Context>
+    framing_layer(Context& c): side_(c.side()), next_(c) {
+        next_.prev_ = this;
+        if constexpr (requires { c.framing(); })
+            options_ = c.framing();
+        if constexpr (requires { c.io(); })
+            io_ = &c.io();
+    }
+
+    void options(const framing_options& o) { options_ = o; }
+    const framing_options& options() const { return options_; }
+    const framing_stats& stats() const { return stats_; }
+    // A malformed or oversized frame was received, the rest of the input is dropped
+    bool failed() const { return failed_; }
+
+    template<typename Chain>
+    void connect() {
+        next_.template connect<Chain>();
+    }
+
+    template<typename Chain>
+    void on_connected() {
+        auto prior = get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_connected<Chain>();
+    }
+
+    template<typename Chain>
+    void disconnect() {
+        next_.template disconnect<Chain>();
+    }
+
+    template<typename Chain>
+    void on_disconnected() {
+        std::string().swap(partial_);
+        header_ = 0;
+        auto prior = get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_disconnected<Chain>();
+    }
+
+    template<typename Chain>
+    size_t write(const char* buf, size_t s) {
+        const_buffer body{buf, s};
+        return writev<Chain>(&body, 1);
+    }
+
+    // One frame with the buffers as its body. The prefix and the body go down
+    // as one gathered write, the body is not copied here.
+    template<typename Chain>
+    size_t writev(const const_buffer* buffers, size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; i++)
+            size += buffers[i].size;
+        if (size > max_size()) {
+            LOG_ERROR("framing_layer.write: frame of {} bytes, max {}", size, max_size());
+            return 0;
+        }
+        char header[max_header];
+        auto header_len = encode(size, header);
+
+        writev_prefixed({header, header_len}, buffers, count, [this](const const_buffer* v, size_t n) {
+            next_.template writev<Chain>(v, n);
+        });
+        return size;
+    }
+
+    // One frame with `buf` as its body. The prefix goes in front of a share
+    // of the blocks, so down to a socket_stream the body is never copied.
+    template<typename Chain>
+    size_t write(const iobuf& buf) {
+        if constexpr (requires { next_.template write<Chain>(buf); }) {
+            if (buf.size() > max_size()) {
+                LOG_ERROR("framing_layer.write: frame of {} bytes, max {}", buf.size(), max_size());
+                return 0;
+            }
+            char header[max_header];
+            iobuf frame(buf);
+            frame.prepend(header, encode(buf.size(), header));
+            next_.template write<Chain>(frame);
+            return buf.size();
+        } else {
+            return buf.gather([&](const const_buffer* v, size_t count) {
+                return writev<Chain>(v, count);
+            });
+        }
+    }
+
+    template<typename Chain>
+    void flush() {
+        next_.template flush<Chain>();
+    }
+
+    template<typename Chain>
+    void pause_reading() {
+        next_.template pause_reading<Chain>();
+    }
+
+    template<typename Chain>
+    void resume_reading() {
+        next_.template resume_reading<Chain>();
+    }
+
+    size_t pending_output() const { return next_.pending_output(); }
+
+    template<typename Chain>
+    void on_drained() {
+        auto prior = get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_drained<Chain>();
+    }
+
+    size_t memory_footprint() const { return partial_.capacity() + next_.memory_footprint(); }
+
+    // Ready for another connection: no frame in progress, no disconnect
+    // pending from the last one, stats from zero
+    void reset() requires requires (Next& n) { n.reset(); } {
+        disconnect_.cancel();
+        std::string().swap(partial_);
+        header_ = 0;
+        size_ = 0;
+        failed_ = false;
+        stats_ = {};
+        next_.reset();
+    }
+
+    template<typename Chain>
+    void on_received(const char* buf, size_t len) {
+        LOG_DEBUG("framing_layer.on_received len: {}", len);
+        if (failed_)
+            return;
+        if (!partial_.empty()) {
+            auto used = assemble<Chain>(buf, len);
+            if (failed_ || !partial_.empty())
+                return;
+            buf += used;
+            len -= used;
+        }
+        while (len) {
+            size_t header = 0;
+            uint64_t size = 0;
+            auto r = decode(buf, len, header, size);
+            if (r < 0 || (r > 0 && size > options_.max_frame)) {
+                fail<Chain>();
+                return;
+            }
+            if (r == 0 || len - header < size) {
+                // the rest of the frame comes in later buffers
+                header_ = r > 0 ? header : 0;
+                size_ = r > 0 ? size : 0;
+                if (header_)
+                    partial_.reserve(header_ + size_);
+                partial_.assign(buf, len);
+                return;
+            }
+            stats_.frames++;
+            deliver<Chain>(buf + header, size);
+            buf += header + size;
+            len -= header + size;
+        }
+    }
+
+    template <typename Chain>
+    decltype(auto) last() {
+        return next_.template last<Chain>();
+    }
+    void* prev_;
+
+    Next& next() { return next_;}
+
+private:
+    size_t max_size() const {
+        switch (options_.prefix) {
+        case length_prefix::fixed8:  return std::min<size_t>(options_.max_frame, UINT8_MAX);
+        case length_prefix::fixed16: return std::min<size_t>(options_.max_frame, UINT16_MAX);
+        case length_prefix::fixed32: return std::min<size_t>(options_.max_frame, UINT32_MAX);
+        default:                     return options_.max_frame;
+        }
+    }
+
+    size_t width() const {
+        switch (options_.prefix) {
+        case length_prefix::fixed8:  return 1;
+        case length_prefix::fixed16: return 2;
+        case length_prefix::fixed32: return 4;
+        case length_prefix::fixed64: return 8;
+        default:                     return 0;
+        }
+    }
+
+    size_t encode(uint64_t size, char* out) const {
+        size_t n = 0;
+        if (options_.prefix == length_prefix::varint) {
+            while (size >= 0x80) {
+                out[n++] = (char)((size & 0x7f) | 0x80);
+                size >>= 7;
+            }
+            out[n++] = (char)size;
+            return n;
+        }
+        n = width();
+        for (size_t i = 0; i < n; i++)
+            out[i] = (char)(size >> 8 * (n - 1 - i));
+        return n;
+    }
+
+    // 1 with the prefix decoded, 0 when it needs more bytes, -1 when malformed
+    int decode(const char* buf, size_t len, size_t& header, uint64_t& size) const {
+        size = 0;
+        if (options_.prefix == length_prefix::varint) {
+            for (size_t i = 0; i < std::min(len, max_header); i++) {
+                auto b = (uint8_t)buf[i];
+                size |= (uint64_t)(b & 0x7f) << 7 * i;
+                if (!(b & 0x80)) {
+                    header = i + 1;
+                    return i == max_header - 1 && b > 1 ? -1 : 1;
+                }
+            }
+            return len >= max_header ? -1 : 0;
+        }
+        header = width();
+        if (len < header)
+            return 0;
+        for (size_t i = 0; i < header; i++)
+            size = size << 8 | (uint8_t)buf[i];
+        return 1;
+    }
+
+    // Adds to the split frame in partial_. Returns the bytes of `buf` used;
+    // partial_ is empty again once the frame went up.
+    template<typename Chain>
+    size_t assemble(const char* buf, size_t len) {
+        size_t used = 0;
+        if (!header_) {
+            // the prefix itself was split
+            used = std::min(len, max_header - std::min(max_header, partial_.size()));
+            partial_.append(buf, used);
+            size_t header = 0;
+            uint64_t size = 0;
+            auto r = decode(partial_.data(), partial_.size(), header, size);
+            if (r < 0 || (r > 0 && size > options_.max_frame)) {
+                fail<Chain>();
+                return len;
+            }
+            if (r == 0)
+                return used;
+            header_ = header;
+            size_ = size;
+            if (partial_.size() > header_ + size_) {
+                used -= partial_.size() - (header_ + size_);
+                partial_.resize(header_ + size_);
+            }
+            partial_.reserve(header_ + size_);
+        }
+        auto n = std::min(header_ + size_ - partial_.size(), len - used);
+        partial_.append(buf + used, n);
+        used += n;
+        if (partial_.size() == header_ + size_) {
+            stats_.frames++;
+            stats_.copied++;
+            stats_.copied_bytes += size_;
+            deliver<Chain>(partial_.data() + header_, size_);
+            partial_.clear();
+            header_ = 0;
+            if (partial_.capacity() > 64 * 1024)
+                std::string().swap(partial_);
+        }
+        return used;
+    }
+
+    template<typename Chain>
+    void deliver(const char* buf, size_t len) {
+        auto prior = get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_received<Chain>(buf, len);
+    }
+
+    template<typename Chain>
+    void fail() {
+        LOG_ERROR("framing_layer: invalid frame, max_frame: {}", options_.max_frame);
+        failed_ = true;
+        std::string().swap(partial_);
+        if constexpr (requires { next_.template disconnect<Chain>(); })
+            disconnect_.schedule(io_, [this]() { next_.template disconnect<Chain>(); });
+    }
+
+    side_t side_;
+    next_type next_;
+    framing_options options_;
+    framing_stats stats_;
+    io_context* io_ = nullptr;
+    deferred_disconnect disconnect_;
+    // a frame split across receive buffers: prefix and body
+    std::string partial_;
+    size_t header_ = 0;
+    uint64_t size_ = 0;
+    bool failed_ = false;
+};
+
+} //namespace acpp::network::async
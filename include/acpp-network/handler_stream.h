@@ -0,0 +1,131 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <acpp-network/iobuf.h>
+#include <acpp-network/stream.h>
+
+namespace acpp::network::async {
+
+// The top of a chain, as stream<>, whose upcalls are member functions of
+// Derived instead of std::function members:
+//
+//     class session: public handler_stream<session, framing_layer<socket_stream>> {
+//     public:
+//         using handler_stream::handler_stream;
+//         void on_received(const char* buf, size_t len) { write(buf, len); }
+//     };
+//
+// Derived defines the ones it needs of on_connected(), on_disconnected(),
+// on_received(buf, len) and on_drained(); they are called directly, so the
+// layers' upcalls and the handler inline into one another. The socket's
+// callbacks are set up by the constructor.
+template<typename Derived, typename Next>
+class handler_stream {
+public:
+    enum {it = Next::it+1,};
+    using next_type = Next;
+    using chain_type = append_to_tuple_t<typename Next::chain_type, handler_stream* >;
+    using last_type = next_type::last_type;
+
+    template<typename Context>
+    handler_stream(Context& c)
+    :side_(c.side()), next_(c) {
+        next_.prev_ = this;
+        next_.template last<chain_type>();
+    }
+
+    handler_stream(handler_stream&&) = delete;
+
+    void connect() {
+        next_.template connect<chain_type>();
+    }
+
+    void disconnect() {
+        next_.template disconnect<chain_type>();
+    }
+
+    void flush() {
+        next_.template flush<chain_type>();
+    }
+
+    size_t memory_footprint() const {
+        return sizeof(Derived) + next_.memory_footprint();
+    }
+
+    void reset() requires requires (Next& n) { n.reset(); } {
+        next_.reset();
+    }
+
+    void pause_reading() {
+        next_.template pause_reading<chain_type>();
+    }
+
+    void resume_reading() {
+        next_.template resume_reading<chain_type>();
+    }
+
+    size_t pending_output() const {
+        return next_.pending_output();
+    }
+
+    size_t write(const char* buf, size_t s) {
+        return next_.template write<chain_type>(buf, s);
+    }
+
+    size_t writev(const const_buffer* buffers, size_t count) {
+        return next_.template writev<chain_type>(buffers, count);
+    }
+
+    size_t write(const iobuf& buf) {
+        if constexpr (requires { next_.template write<chain_type>(buf); }) {
+            return next_.template write<chain_type>(buf);
+        } else {
+            return buf.gather([&](const const_buffer* v, size_t count) {
+                return next_.template writev<chain_type>(v, count);
+            });
+        }
+    }
+
+    template<typename Chain>
+    void on_connected() {
+        if constexpr (requires (Derived& d) { d.on_connected(); })
+            derived().on_connected();
+    }
+
+    template<typename Chain>
+    void on_disconnected() {
+        if constexpr (requires (Derived& d) { d.on_disconnected(); })
+            derived().on_disconnected();
+    }
+
+    template<typename Chain>
+    void on_received(const char* buf, size_t s) {
+        if constexpr (requires (Derived& d) { d.on_received(buf, s); })
+            derived().on_received(buf, s);
+    }
+
+    template<typename Chain>
+    void on_drained() {
+        if constexpr (requires (Derived& d) { d.on_drained(); })
+            derived().on_drained();
+    }
+
+    auto last() {
+        return next_.template last<chain_type>();
+    }
+
+    Next& next() { return next_;}
+
+private:
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    side_t side_;
+    Next next_;
+};
+
+} // namespace acpp::network::async
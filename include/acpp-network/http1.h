@@ -0,0 +1,378 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <acpp-network/stream.h>
+
+namespace acpp::network::http {
+
+struct header {
+    std::string_view name;
+    std::string_view value;
+};
+
+// A parsed request or response head. The views point into the receive
+// buffer and are valid during the callback only.
+struct message {
+    std::string_view method;    // requests
+    std::string_view target;
+    int status = 0;             // responses
+    std::string_view reason;
+    int version = 11;           // 10 or 11
+    std::vector<header> headers;
+    int64_t content_length = -1;
+    bool chunked = false;
+    bool keep_alive = true;
+    bool upgrade = false;
+
+    bool request() const { return status == 0; }
+    // First value of the header (names are case insensitive), empty when missing
+    std::string_view get(std::string_view name) const;
+};
+
+struct parser_options {
+    size_t max_head = 64 * 1024;
+    size_t max_headers = 100;
+};
+
+// Incremental HTTP/1.x parser. A server parses requests, a client responses.
+// Bodies go out as they come, as views into the input; only the head needs
+// to be in one piece.
+class parser {
+public:
+    class handler {
+    public:
+        virtual void on_head(message& m) = 0;
+        virtual void on_body(const char* buf, size_t len) = 0;
+        virtual void on_end() = 0;
+    };
+
+    enum class state { head, body, chunk_size, chunk_data, chunk_end, trailers, until_close, upgraded, error };
+
+    explicit parser(side_t side, parser_options options = {});
+
+    // Parses as much as it can. Returns the bytes used: fewer than `len` when
+    // a head is incomplete (it is expected again at the start of the next
+    // call, with more bytes after it), after an upgrade and on error.
+    size_t parse(const char* buf, size_t len, handler& h);
+
+    // End of the input: ends a body read until close. false when a message
+    // was cut short.
+    bool close(handler& h);
+
+    // Client side: a request went out, HEAD responses have no body
+    void sent_request(std::string_view method);
+    // Server side: switching protocols, the input after this message is not HTTP
+    void upgrade();
+
+    state status() const { return state_; }
+    const char* error() const { return error_; }
+
+private:
+    size_t parse_head(const char* buf, size_t len, handler& h);
+    const char* parse_request_line(const char* p, const char* end);
+    const char* parse_status_line(const char* p, const char* end);
+    bool interpret();
+    size_t take_line(const char* buf, size_t len, bool& complete);
+    void end_message(handler& h);
+    size_t fail(const char* error);
+
+    side_t side_;
+    parser_options options_;
+    state state_ = state::head;
+    message message_;
+    uint64_t remaining_ = 0;
+    // a chunk size or trailer line split across buffers
+    std::string line_;
+    std::deque<bool> head_requests_;
+    bool upgrade_ = false;
+    const char* error_ = nullptr;
+};
+
+// Scanning kernels of the parser, picked once from the CPU (SSE 4.2 when
+// present, AVX2 only on request)
+enum class simd { scalar, sse42, avx2 };
+simd scan_level();
+// Forces a kernel (tests, benchmarks); clamped to what the CPU has. Not
+// thread safe.
+simd scan_level(simd level);
+
+void write_request_head(std::string& out, std::string_view method, std::string_view target,
+                        std::initializer_list<header> headers, int64_t content_length);
+void write_response_head(std::string& out, int status, std::string_view reason,
+                         std::initializer_list<header> headers, int64_t content_length);
+
+// 1xx, 204 and 304 responses end with their head (RFC 9112 6.3)
+inline bool response_has_body(int status) {
+    return status >= 200 && status != 204 && status != 304;
+}
+
+// HTTP/1.1 over a byte stream (socket_stream, ssl::stream). Heads go to
+// on_head_cb_ and the end of each message to on_end_cb_; body bytes go up
+// the chain as on_received. Pipelined messages come one after the other, and
+// after a 101 response the bytes go up untouched.
+template<typename Next = async::null_layer>
+class http1_layer {
+public:
+    enum {it = Next::it+1,};
+    using next_type = Next;
+    using chain_type = async::append_to_tuple_t<typename next_type::chain_type, http1_layer* >;
+    using last_type = next_type::last_type;
+
+    http1_layer(side_t side): side_(side), next_(side), parser_(side) {
+        next_.prev_ = this;
+    }
+
+    template<typename Context>
+    http1_layer(Context& c): side_(c.side()), next_(c), parser_(c.side()) {
+        next_.prev_ = this;
+        if constexpr (requires { c.io(); })
+            io_ = &c.io();
+    }
+
+    // Starts an outgoing message. The head goes out with the first write, or
+    // on flush. With content_length < 0 the body is chunked: each write is a
+    // chunk and an empty write ends it.
+    void request(std::string_view method, std::string_view target,
+                 std::initializer_list<header> headers = {}, int64_t content_length = 0) {
+        write_request_head(out_head_, method, target, headers, content_length);
+        out_chunked_ = content_length < 0;
+        parser_.sent_request(method);
+    }
+
+    void response(int status, std::string_view reason,
+                  std::initializer_list<header> headers = {}, int64_t content_length = 0) {
+        write_response_head(out_head_, status, reason, headers, content_length);
+        out_chunked_ = content_length < 0 && response_has_body(status);
+        if (status == 101)
+            parser_.upgrade();
+    }
+
+    bool upgraded() const { return parser_.status() == parser::state::upgraded; }
+    // A malformed message was received, the rest of the input is dropped
+    bool failed() const { return failed_; }
+
+    template<typename Chain>
+    void connect() {
+        next_.template connect<Chain>();
+    }
+
+    template<typename Chain>
+    void on_connected() {
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_connected<Chain>();
+    }
+
+    template<typename Chain>
+    void disconnect() {
+        next_.template disconnect<Chain>();
+    }
+
+    template<typename Chain>
+    void on_disconnected() {
+        sink<Chain> s(*this);
+        if (!parser_.close(s))
+            LOG_DEBUG("http1_layer.on_disconnected: message cut short");
+        std::string().swap(partial_);
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_disconnected<Chain>();
+    }
+
+    template<typename Chain>
+    size_t write(const char* buf, size_t s) {
+        async::const_buffer body{buf, s};
+        return writev<Chain>(&body, 1);
+    }
+
+    // The head, the chunk framing and the body go down as one gathered write
+    template<typename Chain>
+    size_t writev(const async::const_buffer* buffers, size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; i++)
+            size += buffers[i].size;
+        if (out_head_.empty() && !out_chunked_)
+            return next_.template writev<Chain>(buffers, count);
+
+        // head, chunk size line, body, chunk end
+        constexpr size_t inline_count = 8;
+        async::const_buffer inline_v[inline_count];
+        std::vector<async::const_buffer> heap_v;
+        auto v = inline_v;
+        if (count + 3 > inline_count) {
+            heap_v.resize(count + 3);
+            v = heap_v.data();
+        }
+        size_t n = 0;
+        if (!out_head_.empty())
+            v[n++] = {out_head_.data(), out_head_.size()};
+        char chunk[24];
+        if (out_chunked_ && !size) {
+            v[n++] = {"0\r\n\r\n", 5};
+            out_chunked_ = false;
+        } else {
+            if (out_chunked_)
+                v[n++] = {chunk, (size_t)std::snprintf(chunk, sizeof(chunk), "%zx\r\n", size)};
+            std::copy(buffers, buffers + count, v + n);
+            n += count;
+            if (out_chunked_)
+                v[n++] = {"\r\n", 2};
+        }
+        next_.template writev<Chain>(v, n);
+        out_head_.clear();
+        return size;
+    }
+
+    template<typename Chain>
+    void flush() {
+        if (!out_head_.empty()) {
+            next_.template write<Chain>(out_head_.data(), out_head_.size());
+            out_head_.clear();
+        }
+        next_.template flush<Chain>();
+    }
+
+    template<typename Chain>
+    void pause_reading() {
+        next_.template pause_reading<Chain>();
+    }
+
+    template<typename Chain>
+    void resume_reading() {
+        next_.template resume_reading<Chain>();
+    }
+
+    size_t pending_output() const { return next_.pending_output(); }
+
+    template<typename Chain>
+    void on_drained() {
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_drained<Chain>();
+    }
+
+    size_t memory_footprint() const {
+        return partial_.capacity() + out_head_.capacity() + next_.memory_footprint();
+    }
+
+    template<typename Chain>
+    void on_received(const char* buf, size_t len) {
+        LOG_DEBUG("http1_layer.on_received len: {}", len);
+        if (failed())
+            return;
+        if (upgraded()) {
+            up<Chain>(buf, len);
+            return;
+        }
+        sink<Chain> s(*this);
+        if (!partial_.empty()) {
+            // a head split across buffers: parsed once it is all here
+            auto from = partial_.size() > 2 ? partial_.size() - 2 : 0;
+            partial_.append(buf, len);
+            if (partial_.find("\n\n", from) == std::string::npos && partial_.find("\n\r\n", from) == std::string::npos) {
+                if (partial_.size() > max_head)
+                    fail<Chain>("head too large");
+                return;
+            }
+            std::string input;
+            input.swap(partial_);
+            consume<Chain>(input.data(), input.size(), s);
+            if (input.capacity() <= max_head && partial_.empty()) {
+                input.clear();
+                partial_.swap(input); // keeps the storage
+            }
+            return;
+        }
+        consume<Chain>(buf, len, s);
+    }
+
+    template <typename Chain>
+    decltype(auto) last() {
+        return next_.template last<Chain>();
+    }
+    void* prev_;
+
+    Next& next() { return next_;}
+
+    std::function<void(const message&)> on_head_cb_;
+    std::function<void()> on_end_cb_;
+
+private:
+    static constexpr size_t max_head = parser_options{}.max_head;
+
+    template<typename Chain>
+    struct sink : public parser::handler {
+        sink(http1_layer& l): l_(l) {}
+        void on_head(message& m) override {
+            if (l_.on_head_cb_)
+                l_.on_head_cb_(m);
+        }
+        void on_body(const char* buf, size_t len) override {
+            l_.template up<Chain>(buf, len);
+        }
+        void on_end() override {
+            if (l_.on_end_cb_)
+                l_.on_end_cb_();
+        }
+        http1_layer& l_;
+    };
+
+    template<typename Chain>
+    void consume(const char* buf, size_t len, sink<Chain>& s) {
+        auto n = parser_.parse(buf, len, s);
+        if (parser_.status() == parser::state::error) {
+            fail<Chain>(parser_.error());
+            return;
+        }
+        if (n == len)
+            return;
+        if (upgraded())
+            up<Chain>(buf + n, len - n);
+        else
+            partial_.append(buf + n, len - n); // incomplete head
+    }
+
+    template<typename Chain>
+    void up(const char* buf, size_t len) {
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_received<Chain>(buf, len);
+    }
+
+    template<typename Chain>
+    void fail(const char* error) {
+        LOG_ERROR("http1_layer: {}", error);
+        failed_ = true;
+        std::string().swap(partial_);
+        if constexpr (requires { next_.template disconnect<Chain>(); })
+            disconnect_.schedule(io_, [this]() { next_.template disconnect<Chain>(); });
+    }
+
+    side_t side_;
+    next_type next_;
+    parser parser_;
+    async::io_context* io_ = nullptr;
+    async::deferred_disconnect disconnect_;
+    // a head split across receive buffers
+    std::string partial_;
+    // the head of the outgoing message, until its first write
+    std::string out_head_;
+    bool out_chunked_ = false;
+    bool failed_ = false;
+};
+
+} //namespace acpp::network::http
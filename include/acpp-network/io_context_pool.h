@@ -0,0 +1,85 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+
+#include <acpp-network/socket_base.h>
+
+namespace acpp::network::async {
+
+struct numa_node {
+    int id;
+    std::vector<int> cpus;
+};
+
+struct numa_topology {
+    std::vector<numa_node> nodes;
+
+    int node_of_cpu(int cpu) const;
+    size_t cpu_count() const;
+
+    // Detected once per process (sysfs on Linux, a single node elsewhere).
+    static const numa_topology& detect();
+};
+
+struct loop_placement {
+    int cpu = -1;        // -1: do not pin the loop thread
+    int numa_node = -1;  // -1: node of cpu
+};
+
+struct io_context_pool_config {
+    size_t size = 0;                          // loops to run, 0: one per cpu
+    std::vector<loop_placement> placements;   // explicit placement, overrides size
+    bool pin_threads = true;
+    bool numa_memory = true;                  // allocate loop objects on the loop's node
+    bool incoming_cpu = true;                 // steer listeners with SO_INCOMING_CPU
+};
+
+class io_context_pool {
+public:
+    explicit io_context_pool(io_context_pool_config config = {});
+    ~io_context_pool();
+
+    io_context_pool(const io_context_pool&) = delete;
+    io_context_pool& operator=(const io_context_pool&) = delete;
+
+    void start();
+    void stop();
+
+    size_t size() const { return loops_.size(); }
+    io_context& at(size_t i) { return loops_[i]->io; }
+    // Round robin over the loops.
+    io_context& next();
+
+    const loop_placement& placement(size_t i) const { return loops_[i]->placement; }
+    const numa_topology& topology() const { return *topology_; }
+
+    // Sets SO_INCOMING_CPU of a (SO_REUSEPORT) listener owned by loop i so the
+    // kernel hands it the connections whose packets are processed on that cpu.
+    bool steer_listener(async_socket_base& listener, size_t i);
+
+private:
+    struct loop {
+        loop_placement placement;
+        std::unique_ptr<std::pmr::memory_resource> memory;
+        io_context io;
+        std::thread thread;
+    };
+
+    io_context_pool_config config_;
+    const numa_topology* topology_;
+    std::vector<std::unique_ptr<loop>> loops_;
+    std::atomic<size_t> next_ = 0;
+    bool started_ = false;
+};
+
+} // namespace acpp::network::async
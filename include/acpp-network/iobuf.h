@@ -0,0 +1,131 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <acpp-network/socket_base.h>
+
+namespace acpp::network::async {
+
+// A refcounted piece of storage. Pool blocks have their bytes after the
+// header; wrapped ones point to the caller's and are destroyed, not pooled.
+struct iobuf_block {
+    std::atomic<uint32_t> refs;
+    uint32_t capacity;
+    char* base;
+    void (*destroy)(iobuf_block*) = nullptr;
+
+    char* data() { return base; }
+};
+
+// Free blocks of the thread's loop, in two sizes. Blocks released on another
+// thread go to that thread's pool.
+class iobuf_pool {
+public:
+    static constexpr size_t small_block = 4 * 1024;
+    static constexpr size_t large_block = 64 * 1024;
+
+    static iobuf_pool& local();
+
+    ~iobuf_pool();
+
+    // A block of small_block bytes if `size` fits, else of large_block
+    iobuf_block* take(size_t size);
+    void give(iobuf_block* block);
+
+    size_t size() const { return small_.size() + large_.size(); }
+
+private:
+    static constexpr size_t max_blocks = 64;
+    std::vector<iobuf_block*> small_;
+    std::vector<iobuf_block*> large_;
+};
+
+// A chain of slices of refcounted blocks. Copying, splitting and appending
+// another iobuf share the blocks instead of the bytes; the bytes are only
+// written when appended or prepended, into the room a block nobody else
+// holds has left, or into new blocks of the iobuf_pool.
+// The pieces are what a gathered write takes (writev).
+class iobuf {
+public:
+    iobuf() = default;
+    iobuf(const iobuf& other);
+    iobuf(iobuf&& other) noexcept;
+    iobuf& operator=(const iobuf& other);
+    iobuf& operator=(iobuf&& other) noexcept;
+    ~iobuf();
+
+    // `headroom` bytes are left free in front for prepend()
+    static iobuf copy(const char* buf, size_t len, size_t headroom = 0);
+    // `buf` itself, not a copy: it must stay valid until the last share is
+    // gone, then on_released is called there. Its bytes are never written.
+    static iobuf wrap(const char* buf, size_t len, std::function<void()>&& on_released);
+
+    size_t size() const { return size_; }
+    bool empty() const { return !size_; }
+    size_t pieces() const { return slices_.size() - head_; }
+    const_buffer piece(size_t i) const;
+    // The first pieces, up to `max_count`; returns how many
+    size_t fill(const_buffer* out, size_t max_count) const;
+    // f(const const_buffer*, count) with all the pieces
+    template<typename F>
+    decltype(auto) gather(F&& f) const {
+        constexpr size_t inline_count = 16;
+        if (pieces() <= inline_count) {
+            const_buffer v[inline_count];
+            return f(v, fill(v, inline_count));
+        }
+        std::vector<const_buffer> v(pieces());
+        return f(v.data(), fill(v.data(), v.size()));
+    }
+
+    void append(const char* buf, size_t len);
+    void append(const iobuf& other);
+    void append(iobuf&& other);
+    // In front of the first byte; a header usually fits the headroom
+    void prepend(const char* buf, size_t len);
+
+    // Takes the first `n` bytes out, into the result
+    iobuf split(size_t n);
+    // Drops the first `n` bytes
+    void consume(size_t n);
+    // Drops everything; the slice table is kept for what comes next
+    void clear();
+    // Frees the spent and spare slots of the slice table
+    void shrink_to_fit();
+
+    void copy_to(char* out) const;
+    std::string to_string() const;
+
+    // Blocks referenced, each counted once, plus the slice table
+    size_t memory_footprint() const;
+
+private:
+    struct slice {
+        iobuf_block* block;
+        uint32_t begin;
+        uint32_t size;
+    };
+
+    void push_front(const slice& s);
+    void drop_spent();
+    static bool writable(iobuf_block* block);
+    static void retain(iobuf_block* block);
+    static void release(iobuf_block* block);
+
+    // slices_[head_] is the first; the slots before it are spent
+    std::vector<slice> slices_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+} // namespace acpp::network::async
@@ -0,0 +1,109 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <acpp-network/socket_base.h>
+
+namespace acpp::network::async {
+
+struct relay_options {
+    // Bytes in flight per direction (the pipe size on Linux)
+    size_t buffer_size = 256 * 1024;
+};
+
+struct relay_stats {
+    uint64_t a_to_b = 0;
+    uint64_t b_to_a = 0;
+    // bytes moved kernel to kernel (splice) instead of copied
+    bool spliced = false;
+};
+
+struct relay_pimpl;
+
+// Joins two connected sockets of one io_context: what one receives the other
+// sends, both ways. On Linux the bytes go through a pipe per direction with
+// splice and never reach user space; elsewhere they are copied.
+// A direction stops reading while its destination can not take more, so at
+// most buffer_size bytes are in flight per direction. The end of one side's
+// input is passed on as a half-close (shutdown of the other's write side);
+// on_closed comes once both directions are done, or on an error. Destroy the
+// relay after it, not from inside the callback (io_context::exec).
+class relay {
+public:
+    using on_closed_callback = std::function<void(relay&)>;
+
+    relay(async_socket_base&& a, async_socket_base&& b, on_closed_callback&& on_closed = {}, relay_options options = {});
+    ~relay();
+
+    relay(const relay&) = delete;
+    relay& operator=(const relay&) = delete;
+
+    relay_stats stats() const;
+    bool closed() const;
+
+private:
+    std::unique_ptr<relay_pimpl> pimpl_;
+};
+
+// The copy path for streams with layers above the socket (ssl::stream): the
+// plaintext one side hands up is lent as is to the other side's write, there
+// is no buffer in between. A side stops reading while the other has output
+// pending, until it drains. A and B are stream<> tops; the relay takes over
+// their received, drained and disconnected callbacks. Streams can not
+// half-close, so the end of either side disconnects the other.
+template<typename A, typename B>
+class stream_relay {
+public:
+    stream_relay(A& a, B& b, std::function<void()>&& on_closed = {})
+    : a_(a), b_(b), on_closed_(std::move(on_closed)) {
+        a_.on_received_cb_ = [this](const char* buf, size_t len) {
+            stats_.a_to_b += len;
+            b_.write(buf, len);
+            if (b_.pending_output())
+                a_.pause_reading();
+        };
+        b_.on_received_cb_ = [this](const char* buf, size_t len) {
+            stats_.b_to_a += len;
+            a_.write(buf, len);
+            if (a_.pending_output())
+                b_.pause_reading();
+        };
+        a_.on_drained_cb_ = [this]() { b_.resume_reading(); };
+        b_.on_drained_cb_ = [this]() { a_.resume_reading(); };
+        a_.on_disconnected_cb_ = [this]() { ended(b_); };
+        b_.on_disconnected_cb_ = [this]() { ended(a_); };
+    }
+
+    stream_relay(const stream_relay&) = delete;
+    stream_relay& operator=(const stream_relay&) = delete;
+
+    relay_stats stats() const { return stats_; }
+    bool closed() const { return closed_; }
+
+private:
+    template<typename Other>
+    void ended(Other& other) {
+        if (closed_)
+            return;
+        closed_ = true;
+        other.disconnect();
+        if (on_closed_)
+            on_closed_();
+    }
+
+    A& a_;
+    B& b_;
+    std::function<void()> on_closed_;
+    relay_stats stats_;
+    bool closed_ = false;
+};
+
+} // namespace acpp::network::async
@@ -36,6 +36,7 @@ using in_port_t = decltype(sockaddr_in::sin_port);
 #endif
 
 #include <memory>
+#include <memory_resource>
 #include <functional>
 #include <string_view>
 #include <string>
@@ -90,6 +91,12 @@ private:
 
 namespace async {
 
+// One piece of a scatter-gather write
+struct const_buffer {
+    const char* data;
+    size_t size;
+};
+
 class io_context;
 class async_socket_base;
 struct socket_base_pimpl;
@@ -117,6 +124,7 @@ public:
     friend class socket_base_pimpl;
     friend class io_context;
     friend class io_context_pimpl;
+    friend struct relay_pimpl;
     
     using fd_type = int64_t;
     //async_socket_base();
@@ -144,6 +152,13 @@ public:
     //TOOD: remove return value
     //TODO: implement max internal buffering
     size_t write(const char* buffer, size_t);
+    // Sends the buffers in order as one write. Returns the bytes sent.
+    size_t writev(const const_buffer* buffers, size_t count);
+
+    // Stops and restarts reading. While paused, the socket's receive buffer
+    // fills up and TCP flow control holds the peer back.
+    void pause_reading();
+    void resume_reading();
 
     void close();
   
@@ -180,6 +195,8 @@ public:
     friend class socket_base_pimpl;
     friend class timer;
     friend class timer_impl;
+    friend struct relay_pimpl;
+    friend struct io_allocated;
 
     io_context();
     ~io_context();
@@ -196,8 +213,24 @@ public:
     void stop();
     int64_t fd() const;
 
+    // Placement of the loop (set by io_context_pool). -1 when not pinned.
+    int cpu() const { return cpu_; }
+    int numa_node() const { return numa_node_; }
+    // Socket and timer impls of this loop are allocated from here, in slabs
+    // taken when the loop needs more and given back once the io_context and
+    // all of its sockets and timers are gone: `mr` must outlive them.
+    std::pmr::memory_resource* memory_resource() const { return memory_resource_; }
+    void placement(int cpu, int numa_node, std::pmr::memory_resource* mr) {
+        cpu_ = cpu;
+        numa_node_ = numa_node;
+        memory_resource_ = mr ? mr : std::pmr::new_delete_resource();
+    }
+
 private:
     std::unique_ptr<io_context_pimpl> pimpl_;
+    int cpu_ = -1;
+    int numa_node_ = -1;
+    std::pmr::memory_resource* memory_resource_ = std::pmr::new_delete_resource();
 };
 
 
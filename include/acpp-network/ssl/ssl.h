@@ -3,6 +3,21 @@
 
 #include <string>
 #include <exception>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <list>
+#include <future>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <utility>
 
 #include <acpp-network/stream.h>
 
@@ -13,8 +28,10 @@ typedef struct ssl_ctx_st SSL_CTX;
 typedef struct bio_st BIO;
 typedef struct x509_st X509;
 typedef struct evp_pkey_st EVP_PKEY;
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
 
 typedef struct ssl_st SSL;
+typedef struct ssl_session_st SSL_SESSION;
 
 namespace acpp::network::ssl {
 
@@ -66,6 +83,14 @@ private:
                     Name& name(const std::string& v) { name##_ = v; return *this;} \
                     const std::string& name() const {return name##_;}
 
+enum class key_type { rsa, ecdsa_p256, ed25519 };
+
+struct key_spec {
+    key_type type = key_type::rsa;
+    int bits = 2048; // rsa only
+};
+
+// pkey and x509 own one reference to their handle; copies share it.
 class pkey {
 public:
     pkey();
@@ -74,6 +99,9 @@ public:
     pkey(pkey&& x);
     ~pkey();
     static pkey load_from_file(const std::string& file);
+    static pkey from_pem(const std::string& pem);
+    static pkey generate(const key_spec& spec = {});
+    std::string to_pem() const;
     void operator=(const pkey& x);
     EVP_PKEY* handle() const {return handle_;}
 private:
@@ -92,6 +120,7 @@ public:
     x509();
     x509(void *);
     x509(const X509& x);
+    x509(const x509& x);
     x509(x509&& x);
     //TODO: needede???
     x509(Name& n){
@@ -107,15 +136,23 @@ public:
     X509* handle() const {return handle_;}
 
     std::string to_string();
+    std::string to_pem() const;
     void save_to_file(const std::string& cert_file);
     //TODO: static???
     static x509 load_from_file(const std::string& cert_file);
+    static x509 from_pem(const std::string& pem);
 
     void sign(x509& ca_cert, pkey& pk);
 
-    static std::pair<x509, pkey> create_cert(const x509::Name&);
-    static std::pair<x509, pkey> create_self_signed_cert(const x509::Name&);
-    static std::pair<x509, pkey> create_signed_cert(x509& cert_ca, pkey& pk_ca, const x509::Name& n);
+    static std::pair<x509, pkey> create_cert(const x509::Name&, const key_spec& spec = {});
+    static std::pair<x509, pkey> create_cert(const x509::Name&, pkey key);
+    static std::pair<x509, pkey> create_self_signed_cert(const x509::Name&, const key_spec& spec = {});
+    static std::pair<x509, pkey> create_signed_cert(x509& cert_ca, pkey& pk_ca, const x509::Name& n, const key_spec& spec = {});
+    // With a pre-generated key only the signature is left on the caller's thread.
+    static std::pair<x509, pkey> create_signed_cert(x509& cert_ca, pkey& pk_ca, const x509::Name& n, pkey key);
+
+    // Random 159 bit serial number, safe to call from any thread.
+    static void set_random_serial(X509* cert);
 
     //operator bool() {return impl_; }
 private:
@@ -123,19 +160,345 @@ private:
 };
 
 
+// Keys for stateless session tickets. One instance is shared by the server
+// contexts of every io_context thread. The current key is replaced once it is
+// older than `rotation` (checked when a ticket is issued); the previous `keep`
+// keys still decrypt tickets, which are then renewed with the current key.
+class ticket_keys {
+public:
+    struct key {
+        unsigned char name[16];
+        unsigned char aes_key[32];
+        unsigned char hmac_key[32];
+        std::chrono::steady_clock::time_point created;
+    };
+
+    explicit ticket_keys(std::chrono::seconds rotation = std::chrono::hours(12), size_t keep = 2);
+
+    void rotate();
+    key current();
+    // false if no key has that name (expired or foreign ticket)
+    bool find(const unsigned char* name, key& k, bool& is_current);
+
+    size_t rotations() const { return rotations_; }
+
+private:
+    void rotate_locked();
+
+    std::mutex mutex_;
+    std::deque<key> keys_; // front is current
+    std::chrono::seconds rotation_;
+    size_t keep_;
+    std::atomic<size_t> rotations_ = 0;
+};
+
+// Client side sessions keyed by hostname, fed to SSL_set_session on the
+// next connection to the same host.
+class session_store {
+public:
+    explicit session_store(size_t max_entries = 1024);
+    ~session_store();
+
+    // Returns an owned copy (SSL_SESSION_free it) or nullptr.
+    SSL_SESSION* get(const std::string& hostname);
+    // Takes ownership of the reference.
+    void put(const std::string& hostname, SSL_SESSION* session);
+    void remove(const std::string& hostname);
+    size_t size();
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, SSL_SESSION*> sessions_;
+    size_t max_entries_;
+};
+
+// Reservoir of key pairs generated by background threads. The target depth
+// adapts to demand: it doubles whenever take() finds the reservoir empty (a
+// stall, the key is then generated inline) and shrinks back towards
+// min_depth after a target's worth of takes without one.
+class key_pool {
+public:
+    struct stats_t {
+        size_t depth = 0;
+        size_t target = 0;
+        uint64_t generated = 0;
+        uint64_t taken = 0;
+        uint64_t stalls = 0;
+    };
+
+    explicit key_pool(const key_spec& spec = {key_type::ecdsa_p256}, size_t min_depth = 16,
+                      size_t max_depth = 256, size_t threads = 1);
+    ~key_pool();
+    key_pool(const key_pool&) = delete;
+    key_pool& operator=(const key_pool&) = delete;
+
+    pkey take();
+    stats_t stats();
+
+private:
+    void run();
+
+    key_spec spec_;
+    size_t min_depth_;
+    size_t max_depth_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<pkey> keys_;
+    size_t target_;
+    size_t in_progress_ = 0;
+    size_t since_stall_ = 0;
+    bool stop_ = false;
+    stats_t stats_;
+    std::vector<std::thread> workers_;
+};
+
+// Leaf certificates minted on demand and keyed by hostname, for proxies that
+// terminate TLS for arbitrary hosts. Bounded LRU, shared by the server
+// contexts of every io_context thread. Concurrent misses for the same host
+// wait for a single generation.
+class cert_cache {
+public:
+    using entry = std::pair<x509, pkey>;
+    using mint_function = std::function<entry(const std::string& hostname)>;
+
+    struct stats_t {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t merged = 0; // misses that waited for another thread's generation
+        uint64_t evictions = 0;
+    };
+
+    cert_cache(mint_function mint, size_t capacity = 1024);
+    // Leaves signed by ca_cert
+    cert_cache(x509& ca_cert, pkey& ca_key, size_t capacity = 1024, const key_spec& leaf = {key_type::ecdsa_p256});
+    // Leaves signed by ca_cert with keys taken from `keys`
+    cert_cache(x509& ca_cert, pkey& ca_key, std::shared_ptr<key_pool> keys, size_t capacity = 1024);
+
+    // Throws whatever minting throws; failures are not cached.
+    entry get(const std::string& hostname);
+    size_t size();
+    stats_t stats();
+
+private:
+    using lru_list = std::list<std::pair<std::string, entry>>;
+
+    mint_function mint_;
+    size_t capacity_;
+    std::mutex mutex_;
+    lru_list lru_; // front is most recently used
+    std::unordered_map<std::string, lru_list::iterator> index_;
+    std::unordered_map<std::string, std::shared_future<entry>> pending_;
+    stats_t stats_;
+};
+
+// Worker threads for the CPU heavy steps of TLS handshakes (key exchange,
+// signatures), shared by every io_context so a handshake burst does not stall
+// the loops.
+class crypto_pool {
+public:
+    explicit crypto_pool(size_t threads = std::max(1u, std::thread::hardware_concurrency()));
+    ~crypto_pool();
+    crypto_pool(const crypto_pool&) = delete;
+    crypto_pool& operator=(const crypto_pool&) = delete;
+
+    void post(std::function<void()>&& job);
+    size_t pending();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// TLS 1.3 write keys of one connection, in the form kernel TLS wants them.
+struct traffic_keys {
+    enum class cipher_t { aes_128_gcm, aes_256_gcm, chacha20_poly1305 };
+    cipher_t cipher = cipher_t::aes_128_gcm;
+    std::vector<unsigned char> key;
+    std::array<unsigned char, 12> iv = {};
+    uint64_t seq = 0; // next record sequence number
+
+    // Derives the application write keys of `ssl` from the traffic secret
+    // captured during its handshake (see context::enable_ktls). false for
+    // TLS 1.2 and for ciphers kernel TLS does not do.
+    static bool tx(SSL* ssl, traffic_keys& keys);
+};
+
+// Number of TLS records in `len` bytes of a record stream
+size_t record_count(const char* buf, size_t len);
+
+// Seals TLS 1.3 records with traffic_keys in user space, as kernel TLS does.
+// Not thread safe: one per thread or batch.
+class record_sealer {
+public:
+    explicit record_sealer(const traffic_keys& keys);
+    ~record_sealer();
+    record_sealer(const record_sealer&) = delete;
+    record_sealer& operator=(const record_sealer&) = delete;
+
+    // Appends record number `seq` carrying `len` bytes (16 KB at most) of
+    // content `type` to `out`.
+    bool seal(uint64_t seq, unsigned char type, const char* buf, size_t len, std::string& out);
+
+    static constexpr size_t overhead = 5 + 1 + 16; // header, content type, tag
+
+private:
+    std::array<unsigned char, 12> iv_;
+    EVP_CIPHER_CTX* ctx_;
+};
+
+// Kernel TLS transmit offload. Linux only; every call fails cleanly on other
+// platforms or when the tls module is missing.
+namespace ktls {
+bool enable_tx(int64_t fd, const traffic_keys& keys);
+// With TX offloaded, alerts have to be sent as their own record type.
+bool send_close_notify(int64_t fd);
+int64_t sendfile(int64_t fd, int64_t in_fd, int64_t offset, size_t count);
+} // namespace ktls
+
+// Write coalescing and record sizing of the streams of a context.
+struct write_policy {
+    // Collect writes and seal them together when the io_context has handled
+    // the current events, when a full record is pending or on flush().
+    bool cork = false;
+    // Records start at `initial_record` bytes so each of the first ones fits
+    // in a TCP segment and can be decrypted as soon as it arrives. After
+    // `boost_after` bytes they grow to the 16 KB maximum, and go back to
+    // small after `idle_reset` without writes. 0: always full records.
+    size_t initial_record = 0;
+    size_t boost_after = 1024 * 1024;
+    std::chrono::milliseconds idle_reset = std::chrono::seconds(1);
+};
+
+// TLS 1.3 0-RTT: data sent with the ClientHello of a resumed session.
+struct early_data_policy {
+    // Server: most early data accepted per connection.
+    uint32_t max_size = 16 * 1024;
+    // Server: accept the early data of each ticket once. OpenSSL tracks used
+    // tickets in the session cache, which is enabled if needed. The tracking
+    // is per context: servers sharing ticket_keys do not see each other's.
+    bool anti_replay = true;
+};
+
+struct session_stats {
+    uint64_t handshakes = 0;
+    uint64_t resumed = 0;
+    double hit_rate() const { return handshakes ? double(resumed) / handshakes : 0.0; }
+};
+
 class context {
 public:
     context(side_t s);
     ~context();
+    context(const context&) = delete;
+    context& operator=(const context&) = delete;
+
     SSL_CTX* handle() { return handle_;}
     side_t side() { return side_;}
 
     void set_cert(x509& cert);
     void set_pkey(pkey& pkey);
 
+    // Server configurations are built once and shared by reference between
+    // all sessions and io_context threads; a session then only costs SSL_new.
+    static std::shared_ptr<context> make_server(x509& cert, pkey& key);
+    static std::shared_ptr<context> make_server_from_files(const std::string& cert_chain_file, const std::string& key_file);
+    static std::shared_ptr<context> make_server_from_memory(const std::string& cert_chain_pem, const std::string& key_pem);
+    // Proxy mode: the certificate is picked from `certs` by SNI hostname.
+    static std::shared_ptr<context> make_minting_server(std::shared_ptr<cert_cache> certs);
+
+    // Process wide contexts used when none is given. The server one carries a
+    // self signed certificate generated on first use.
+    static std::shared_ptr<context> default_server();
+    static std::shared_ptr<context> default_client();
+
+    // Server: stateful session cache.
+    void enable_session_cache(size_t size = 20 * 1024, std::chrono::seconds timeout = std::chrono::minutes(5));
+    // Server: stateless tickets encrypted with shared, rotating keys.
+    void enable_session_tickets(std::shared_ptr<ticket_keys> keys);
+    // Client: remember sessions by hostname and offer them on reconnect.
+    void enable_session_store(std::shared_ptr<session_store> store = std::make_shared<session_store>());
+    // Server: certificate per SNI hostname. Clients sending no SNI get the
+    // context certificate, if any.
+    void enable_sni_minting(std::shared_ptr<cert_cache> certs);
+    // Application protocols ("h2", "http/1.1", ...) in order of preference.
+    // Clients offer them, servers pick their most preferred one the client
+    // offers. With `required`, a server fails handshakes without a match
+    // instead of going on with no protocol selected.
+    void set_alpn(const std::vector<std::string>& protocols, bool required = false);
+    const std::vector<std::string>& alpn() const { return alpn_; }
+    bool alpn_required() const { return alpn_required_; }
+    // Client: what is written before the handshake completes goes out as
+    // early data when the stored session allows it, and again after the
+    // handshake if the server rejects it. Server: early data is handed up
+    // before the handshake completes, with stream::early_data() set.
+    // Early data can be replayed by an attacker: only send idempotent requests.
+    void enable_early_data(const early_data_policy& policy = {});
+    bool early_data() const { return early_data_; }
+    // Handshake steps of streams built with an io_context run on `pool`; the
+    // stream resumes on its loop when a step completes.
+    void enable_handshake_offload(std::shared_ptr<crypto_pool> pool);
+    // Once connected, streams over a socket hand the record encryption of
+    // what they write to the kernel (TLS 1.3, AES-GCM or ChaCha20-Poly1305).
+    // Reading stays in OpenSSL. Streams fall back to OpenSSL's record layer
+    // when the kernel or the negotiated cipher does not support it.
+    void enable_ktls();
+    bool ktls() const { return ktls_; }
+    // Once connected, the records of large writes are sealed on `pool` in
+    // batches of `batch` bytes while the loop keeps them in order, so one
+    // connection can use more than one core. Same ciphers and limits as
+    // enable_ktls, which takes precedence; small writes with nothing in
+    // flight are sealed on the loop.
+    void enable_tx_pipeline(std::shared_ptr<crypto_pool> pool, size_t batch = 64 * 1024);
+
+    // Decrypted data is handed up in chunks of up to `plaintext_chunk` bytes
+    // (default: one full record). A non zero `read_ahead` lets OpenSSL pull
+    // that many bytes of records per read instead of one header at a time.
+    void set_buffer_sizes(size_t plaintext_chunk, size_t read_ahead = 0);
+    size_t plaintext_chunk() const { return plaintext_chunk_; }
+
+    // For many mostly idle connections: OpenSSL frees its record buffers
+    // (SSL_MODE_RELEASE_BUFFERS) and streams give their plaintext buffer back
+    // to the thread's async::buffer_pool whenever they are drained.
+    void enable_buffer_release();
+    bool buffer_release() const { return buffer_release_; }
+
+    void set_write_policy(const write_policy& policy) { write_policy_ = policy; }
+    const write_policy& writes() const { return write_policy_; }
+
+    ticket_keys* tickets() { return tickets_.get(); }
+    session_store* sessions() { return sessions_.get(); }
+    cert_cache* certs() { return certs_.get(); }
+    crypto_pool* offload() { return offload_.get(); }
+    crypto_pool* tx_pipeline() { return tx_pipeline_.get(); }
+    size_t tx_batch() const { return tx_batch_; }
+
+    // Resumption hit rate of the handshakes completed with this context.
+    void record_handshake(bool resumed);
+    session_stats stats() const { return {handshakes_, resumed_}; }
+
+    static context* from_handle(SSL_CTX* handle);
+
 private:
     side_t side_;
     SSL_CTX* handle_;
+    std::shared_ptr<ticket_keys> tickets_;
+    std::shared_ptr<session_store> sessions_;
+    std::shared_ptr<cert_cache> certs_;
+    std::shared_ptr<crypto_pool> offload_;
+    std::shared_ptr<crypto_pool> tx_pipeline_;
+    size_t tx_batch_ = 64 * 1024;
+    bool ktls_ = false;
+    std::vector<std::string> alpn_;
+    bool alpn_required_ = false;
+    bool early_data_ = false;
+    bool buffer_release_ = false;
+    size_t plaintext_chunk_ = 16 * 1024;
+    write_policy write_policy_;
+    std::atomic<uint64_t> handshakes_ = 0;
+    std::atomic<uint64_t> resumed_ = 0;
 };
 
 class ssl_stream_context {
@@ -143,6 +506,7 @@ public:
     // ssl_stream_context(acpp::network::async::io_context& io, side_t side, const std::string& hostname)
     // :io_(io), side_(side), hostname_(hostname){}
     ssl_stream_context(acpp::network::async::io_context& io, side_t side, const std::string& hostname);
+    ssl_stream_context(acpp::network::async::io_context& io, std::shared_ptr<context> ctx, const std::string& hostname = "");
     side_t side() { return side_;}
     const std::string& hostname() { return hostname_;}
     acpp::network::async::io_context& io() { return io_;}
@@ -155,6 +519,76 @@ private:
 };
 
 
+// Heap bytes of a string, 0 while it fits in the string object itself.
+inline size_t heap_bytes(const std::string& s) {
+    return s.capacity() > std::string().capacity() ? s.capacity() : 0;
+}
+
+// The BIO under an ssl::stream. OpenSSL reads straight from the buffer given
+// to on_received and writes straight to the next layer, so no bytes are
+// copied between the two. Received bytes OpenSSL has not consumed yet are
+// kept for the next read.
+class stream_bio {
+public:
+    using write_function = void (*)(void* owner, const char* buf, size_t len);
+
+    // Creates the BIO, owned by whoever takes it (SSL_set_bio).
+    BIO* make();
+
+    void input(const char* buf, size_t len);
+    // Keeps what was not consumed of the current input.
+    void done_input();
+    // Moves the current input to storage owned by this object, for handshake
+    // steps that run on another thread.
+    void own_input();
+
+    // Output goes to `write` unless collecting, or discarding: once records
+    // are sealed outside OpenSSL (kernel TLS), what it writes can not be sent.
+    void write_to(void* owner, write_function write) { owner_ = owner; write_ = write; }
+    void collect(bool c) { collect_ = c; }
+    void discard(bool d) { discard_ = d; }
+    // Bytes dropped while discarding since the last call
+    size_t take_discarded() { return std::exchange(discarded_, 0); }
+    std::string take_output() { return std::move(out_); }
+    // Frees the storage of drained buffers.
+    void release();
+    size_t memory_footprint() const { return heap_bytes(kept_) + heap_bytes(out_); }
+
+private:
+    static int read(BIO* b, char* buf, int len);
+    static int write(BIO* b, const char* buf, int len);
+    static long ctrl(BIO* b, int cmd, long num, void* ptr);
+
+    const char* in_ = nullptr;
+    size_t in_len_ = 0;
+    bool in_kept_ = false; // in_ points into kept_
+    std::string kept_;
+    std::string out_;
+    bool collect_ = false;
+    bool discard_ = false;
+    size_t discarded_ = 0;
+    void* owner_ = nullptr;
+    write_function write_ = nullptr;
+};
+
+// Shared between a stream and its deferred work: the handshake step running
+// on a crypto_pool, cork flushes queued on the io_context.
+struct handshake_job {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool running = false; // a worker is in the handshake step
+    bool alive = true; // cleared by the stream destructor
+};
+
+// Records of one write being sealed on the tx pipeline
+struct tx_batch {
+    std::string plaintext;
+    std::string records;
+    uint64_t seq = 0; // of the first record
+    bool done = false;
+    bool failed = false; // records is not the whole batch
+};
+
 template<typename Next = acpp::network::async::null_layer>
 class stream  {
 public:
@@ -182,6 +616,10 @@ public:
     template<typename Chain>
     size_t write(const char* buf, size_t len);
 
+    // The buffers share records instead of sealing one record (or more) each
+    template<typename Chain>
+    size_t writev(const async::const_buffer* buffers, size_t count);
+
     template <typename Chain>
     void on_connected();
 
@@ -190,6 +628,23 @@ public:
 
     template <typename Chain>
     void disconnect();
+
+    // Seals what corking has collected
+    template <typename Chain>
+    void flush();
+
+    template <typename Chain>
+    void pause_reading();
+
+    template <typename Chain>
+    void resume_reading();
+
+    // Plaintext on the tx pipeline plus what the layers below hold. Corked
+    // bytes are not counted, they go down before the loop waits again.
+    size_t pending_output() const;
+
+    template <typename Chain>
+    void on_drained();
  
     void set_cert(x509& x509);
     void set_pkey(pkey& pk);
@@ -198,6 +653,19 @@ public:
     x509 peer_cert();
     void set_cert();
     void set_hostname(const std::string& hostname) { hostname_ = hostname;}
+    // true while on_received delivers 0-RTT data, which may be a replay
+    bool early_data() const { return early_data_in_; }
+    // Whether the peer took the early data, known from on_connected.
+    bool early_data_accepted() const;
+    // Protocol negotiated with context::set_alpn, available from on_connected.
+    // Empty when the peer did not take part.
+    std::string alpn() const;
+
+    // true once writes are encrypted by the kernel (context::enable_ktls)
+    bool ktls_tx() const { return ktls_tx_; }
+    // Sends `count` bytes of in_fd straight from the page cache. Needs ktls_tx()
+    // to be true; returns -1 otherwise.
+    int64_t sendfile(int64_t in_fd, int64_t offset, size_t count);
 
     void* prev_;
 
@@ -208,10 +676,63 @@ public:
 
     Next& next() {return next_;}
 
+    // Heap held by this layer and the ones below. OpenSSL's own buffers,
+    // about 34 KB while in use, are not included.
+    size_t memory_footprint() const;
+
 private:
     template<typename Chain>
     void do_connect(const char* buf, size_t len);
 
+    int handshake_step();
+
+    template<typename Chain>
+    void on_handshake_step(int e, int err);
+
+    template<typename Chain>
+    void start_handshake_job();
+
+    // SSL_write with the record size of the write_policy. false when the
+    // bytes could not be sealed.
+    template<typename Chain>
+    bool seal(const char* buf, size_t len);
+
+    // Picks the record size for the next SSL_write
+    void size_records();
+
+    // Writes what OpenSSL has queued for the peer
+    template<typename Chain>
+    void flush_output();
+
+    void try_enable_ktls(uint64_t seq);
+
+    void try_enable_tx_pipeline(uint64_t seq);
+
+    template<typename Chain>
+    bool pipeline_write(const char* buf, size_t len);
+
+    // Writes the sealed batches at the head of the queue
+    template<typename Chain>
+    void pipeline_drain();
+
+    // OpenSSL sealed a record that could not be sent (an alert), or holds a
+    // KeyUpdate the peer asked for: the connection can not go on. false once
+    // it is failing.
+    template<typename Chain>
+    bool check_discarded();
+
+    // Records can no longer be sent in sequence: the transport is closed
+    template<typename Chain>
+    void fail_tx(const char* error);
+
+    // Binds the BIO output to next_ for this chain
+    template<typename Chain>
+    void bind_output();
+
+    char* plaintext();
+    // context::enable_buffer_release
+    void release_buffers();
+
     template<typename Chain>
     void do_shutdown(const char* buf, size_t len);
 
@@ -220,10 +741,32 @@ private:
     std::shared_ptr<context> ctx_;
     status status_;
 
-    BIO *int_bio;
-    BIO *ext_bio;
+    stream_bio bio_;
+    std::vector<char> plaintext_;
     SSL *ssl_;
     std::string hostname_;
+    acpp::network::async::io_context* io_ = nullptr;
+    std::shared_ptr<handshake_job> job_;
+    bool handshake_in_flight_ = false;
+    std::string pending_input_; // received while a handshake step is off-loop
+    bool ktls_tx_ = false;
+    bool ktls_close_notify_sent_ = false;
+    bool tx_failed_ = false;
+    acpp::network::async::deferred_disconnect disconnect_;
+    std::shared_ptr<const traffic_keys> tx_keys_; // set while the tx pipeline is on
+    std::unique_ptr<record_sealer> tx_sealer_;
+    uint64_t tx_seq_ = 0;
+    std::deque<std::shared_ptr<tx_batch>> tx_queue_;
+    bool tx_close_notify_sent_ = false;
+    std::string cork_; // also what is written before the handshake completes
+    std::string early_out_; // client: the part of cork_ sent as early data
+    std::string early_in_;  // server: early data read by a handshake step
+    bool early_data_in_ = false;
+    bool early_done_ = false;
+    bool flush_queued_ = false;
+    size_t record_size_ = 0; // current max_send_fragment, 0 before the first write
+    size_t sent_since_idle_ = 0;
+    std::chrono::steady_clock::time_point last_write_;
     Next next_;
     Next* next2_;
 
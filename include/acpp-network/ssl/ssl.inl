@@ -3,49 +3,38 @@
 #include <acpp-network/ssl/ssl.h>
 
 #include <openssl/ssl.h>
-
-
-//#include <openssl/ssl.h>
-#include <array>
+#include <openssl/err.h>
 
 namespace acpp::network::ssl {
 
-
-using buffer = std::array<char, 1024*20>; //ojo!!
+// Layers sitting directly on a socket (socket_stream)
+template<typename T>
+concept socket_layer = requires (T& t) {
+    t.socket().fd();
+    t.pending_output();
+};
 
 
 template<typename Next>
 stream<Next>::stream(side_t side)
-:side_(side), next_(side), ctx_(std::make_shared<context>(side)), status_(status::closed)
+:side_(side), next_(side), 
+ ctx_(side == side_t::server ? context::default_server() : context::default_client()), 
+ status_(status::closed)
 {
     LOG_DEBUG("ssl::stream<Next>::stream side: {} status: {}", (int)side_, (int)status_); 
     next_.prev_ = this;
 
-    if (side == side_t::server) {
-        auto c = x509::create_self_signed_cert(x509::Name().cn("xxx").l("l").o("o").st("st"));
-        LOG_DEBUG("ssl::stream<Next>::stream: cert: {}", c.first.to_string());
-        ctx_->set_cert(c.first);
-        ctx_->set_pkey(c.second);
-        //ssl_ = std::make_unique<ssl::Stream>(context_);
-
-    }
-
-
 
     ssl_ = SSL_new(ctx_->handle());
-    BIO_new_bio_pair(&int_bio, /*0*/ 1024 * 50, &ext_bio, /*0*/ 1024 * 50);
-    SSL_set_bio(ssl_, int_bio, int_bio);
-    int size = 0;
-    BIO_get_write_buf_size(ext_bio, size);
-    LOG_DEBUG("BIO_get_write_buf_size(ext_bio) {}", size); 
-
+    auto bio = bio_.make();
+    SSL_set_bio(ssl_, bio, bio);
 }
 
  
 template<typename Next>
 template<typename Context> 
 stream<Next>::stream(Context& c)
-:side_(c.side()), next_(c), ctx_(c.ctx()), status_(status::closed)
+:side_(c.side()), next_(c), ctx_(c.ctx()), status_(status::closed), hostname_(c.hostname()), io_(&c.io())
 {
     LOG_DEBUG("ssl::stream<Next>::stream side: {} status: {}", (int)side_, (int)status_); 
     next_.prev_ = this;
@@ -71,12 +60,8 @@ stream<Next>::stream(Context& c)
 
 
     ssl_ = SSL_new(ctx_->handle());
-    BIO_new_bio_pair(&int_bio, /*0*/ 1024 * 5, &ext_bio, /*0*/ 1024 * 5);
-    SSL_set_bio(ssl_, int_bio, int_bio);
-    int size = 0;
-    BIO_get_write_buf_size(ext_bio, size);
-    LOG_DEBUG("BIO_get_write_buf_size(ext_bio) {}", size); 
-
+    auto bio = bio_.make();
+    SSL_set_bio(ssl_, bio, bio);
 }
 
 
@@ -88,6 +73,18 @@ stream<Next>::stream(Context& c)
 
 template<typename Next>
 stream<Next>::~stream() {
+    if (job_) {
+        // a step still queued is dropped; one on a worker owns the ssl
+        // object until it is over
+        std::unique_lock<std::mutex> l(job_->mutex);
+        job_->alive = false;
+        job_->cv.wait(l, [this]() { return !job_->running; });
+    }
+    // SSL_free drops the session from the server cache unless close_notify
+    // was sent; connections usually just end, and the cache holds the single
+    // use tickets of early data.
+    if (ssl_ && status_ == status::connected)
+        SSL_set_shutdown(ssl_, SSL_get_shutdown(ssl_) | SSL_SENT_SHUTDOWN);
     if (ssl_)
         SSL_free(ssl_);
     ssl_ = nullptr;    
@@ -110,7 +107,24 @@ template<typename Next>
 x509 stream<Next>::cert() {
     if (!ssl_)
         return x509();
-    return x509(SSL_get_certificate(ssl_));
+    auto c = SSL_get_certificate(ssl_);
+    if (c)
+        X509_up_ref(c); // SSL_get_certificate does not take a reference
+    return x509(c);
+}
+
+template<typename Next>
+bool stream<Next>::early_data_accepted() const {
+    return ssl_ && SSL_get_early_data_status(ssl_) == SSL_EARLY_DATA_ACCEPTED;
+}
+
+template<typename Next>
+std::string stream<Next>::alpn() const {
+    const unsigned char* proto = nullptr;
+    unsigned int len = 0;
+    if (ssl_)
+        SSL_get0_alpn_selected(ssl_, &proto, &len);
+    return proto ? std::string((const char*)proto, len) : std::string();
 }
 
 template<typename Next>
@@ -123,6 +137,70 @@ x509 stream<Next>::peer_cert() {
     return result;
 }
 
+template<typename Next>
+template<typename Chain>
+void stream<Next>::bind_output() {
+    bio_.write_to(this, [](void* owner, const char* buf, size_t len) {
+        static_cast<stream*>(owner)->next_.template write<Chain>(buf, len);
+    });
+}
+
+template<typename Next>
+char* stream<Next>::plaintext() {
+    if (plaintext_.empty()) {
+        plaintext_ = acpp::network::async::buffer_pool::local().take();
+        plaintext_.resize(ctx_->plaintext_chunk());
+    }
+    return plaintext_.data();
+}
+
+template<typename Next>
+void stream<Next>::release_buffers() {
+    if (!ctx_->buffer_release())
+        return;
+    if (!plaintext_.empty())
+        acpp::network::async::buffer_pool::local().give(plaintext_);
+    if (cork_.empty())
+        std::string().swap(cork_);
+    bio_.release();
+}
+
+template<typename Next>
+size_t stream<Next>::memory_footprint() const {
+    return plaintext_.capacity() + heap_bytes(cork_) + heap_bytes(early_out_) + heap_bytes(early_in_)
+         + heap_bytes(pending_input_) + bio_.memory_footprint() + next_.memory_footprint();
+}
+
+template<typename Next>
+size_t stream<Next>::pending_output() const {
+    size_t size = 0;
+    for (auto& batch: tx_queue_)
+        size += batch->plaintext.size();
+    return size + next_.pending_output();
+}
+
+template<typename Next>
+template<typename Chain>
+void stream<Next>::pause_reading() {
+    next_.template pause_reading<Chain>();
+}
+
+template<typename Next>
+template<typename Chain>
+void stream<Next>::resume_reading() {
+    next_.template resume_reading<Chain>();
+}
+
+template<typename Next>
+template<typename Chain>
+void stream<Next>::on_drained() {
+    if (!tx_queue_.empty())
+        return; // pipeline_drain tells
+    auto prior = acpp::network::async::get_prev<Chain, it>(prev_);
+    if (prior)
+        prior->template on_drained<Chain>();
+}
+
 template<typename Next>
 template<typename Chain>
 void stream<Next>::connect() {  
@@ -144,66 +222,343 @@ template<typename Next>
 template <typename Chain>
 void stream<Next>::do_connect(const char* buf, size_t len) {
     LOG_DEBUG("ssl::stream::do_connect side: {} status: {}", (int)side_, (int)status_);
-    int e;
-    if (len) {
-        e = BIO_write(ext_bio, buf, len);
-        LOG_DEBUG("ssl::stream::do_connect  side: {} BIO_write e:{} len: {}", (int)side_, e, len); 
+    if (handshake_in_flight_) {
+        pending_input_.append(buf, len);
+        return;
     }
+    bind_output<Chain>();
+    bio_.input(buf, len);
+    int e;
     if (status_ == status::closed || status_ == status::connecting) {
-        if (side_ == side_t::server) {
-            LOG_DEBUG("ssl::stream::do_connect  side: {} SSL_accept", (int)side_); 
-            e =  SSL_accept(ssl_);
-        }
-        else {
-            if (!hostname_.empty()) {
-                LOG_DEBUG("ssl::stream::do_connect set SNI: {}", hostname_);
-                SSL_set_tlsext_host_name(ssl_, hostname_.c_str());
+        if (side_ == side_t::client && !hostname_.empty()) {
+            LOG_DEBUG("ssl::stream::do_connect set SNI: {}", hostname_);
+            SSL_set_tlsext_host_name(ssl_, hostname_.c_str());
+            if (status_ == status::closed && ctx_->sessions()) {
+                if (auto session = ctx_->sessions()->get(hostname_)) {
+                    SSL_set_session(ssl_, session);
+                    if (ctx_->early_data() && !cork_.empty() && cork_.size() <= SSL_SESSION_get_max_early_data(session))
+                        early_out_ = cork_;
+                    SSL_SESSION_free(session);
+                }
             }
-            LOG_DEBUG("ssl::stream::do_connect  side: {} SSL_connect", (int)side_); 
-            e = SSL_connect(ssl_);    
-            //TODO: SSL_get_verify_result   SSL_CTX_set_verify  
-            // SSL_get0_peer_certificate/SSL_get1_peer_certificate
         }
+        //TODO: SSL_get_verify_result   SSL_CTX_set_verify  
+        // SSL_get0_peer_certificate/SSL_get1_peer_certificate
         status_  = status::connecting;
     } else {
         LOG_ERROR("connecting in invalid state status_: {}", (int)status_);
         throw exception(std::format("connecting in invalid state status_: {}", (int)status_));  
     }
+    // handshake flights are collected and written by on_handshake_step
+    bio_.collect(true);
+    if (io_ && ctx_->offload()) {
+        bio_.own_input();
+        start_handshake_job<Chain>();
+        return;
+    }
+    e = handshake_step();
+    on_handshake_step<Chain>(e, SSL_get_error(ssl_, e));
+    bio_.done_input();
+    if (status_ == status::connected)
+        release_buffers();
+}
+
+template<typename Next>
+int stream<Next>::handshake_step() {
+    LOG_DEBUG("ssl::stream::handshake_step side: {}", (int)side_); 
+    if (side_ == side_t::client && !early_out_.empty() && !early_done_) {
+        // ClientHello and the early data go out in the same flight
+        early_done_ = true;
+        size_t written = 0;
+        if (SSL_write_early_data(ssl_, early_out_.data(), early_out_.size(), &written) != 1) {
+            LOG_DEBUG("ssl::stream::handshake_step: early data not sent");
+            ERR_clear_error();
+            early_out_.clear(); // sent once connected instead
+        }
+    }
+    if (side_ == side_t::server && ctx_->early_data() && !early_done_) {
+        size_t n = 0;
+        for (;;) {
+            int r = SSL_read_early_data(ssl_, plaintext(), ctx_->plaintext_chunk(), &n);
+            if (r == SSL_READ_EARLY_DATA_SUCCESS) {
+                early_in_.append(plaintext_.data(), n);
+            } else if (r == SSL_READ_EARLY_DATA_FINISH) {
+                early_done_ = true;
+                break;
+            } else {
+                return -1; // SSL_get_error tells whether more input is needed
+            }
+        }
+    }
+    return side_ == side_t::server ? SSL_accept(ssl_) : SSL_connect(ssl_);
+}
+
+// Runs the handshake step on the context's crypto_pool. Input arriving in the
+// meantime is queued and fed back once the result is back on the loop.
+template<typename Next>
+template <typename Chain>
+void stream<Next>::start_handshake_job() {
+    if (!job_)
+        job_ = std::make_shared<handshake_job>();
+    auto job = job_;
+    auto io = io_;
+    handshake_in_flight_ = true;
+    ctx_->offload()->post([this, job, io]() {
+        {
+            std::lock_guard<std::mutex> l(job->mutex);
+            if (!job->alive)
+                return;
+            job->running = true;
+        }
+        ERR_clear_error(); // the error queue is per thread
+        int e = handshake_step();
+        int err = SSL_get_error(ssl_, e);
+        {
+            std::lock_guard<std::mutex> l(job->mutex);
+            job->running = false;
+        }
+        job->cv.notify_all();
+        io->exec([this, job, e, err]() {
+            if (!job->alive)
+                return;
+            handshake_in_flight_ = false;
+            on_handshake_step<Chain>(e, err);
+            bio_.done_input();
+            if (!pending_input_.empty() && !handshake_in_flight_) {
+                auto input = std::move(pending_input_);
+                pending_input_.clear();
+                on_received<Chain>(input.data(), input.size());
+            } else if (status_ == status::connected) {
+                release_buffers();
+            }
+        });
+    });
+}
+
+template<typename Next>
+template <typename Chain>
+void stream<Next>::on_handshake_step(int e, int err) {
     // check error
     if (e < 0)  {
-        if (SSL_get_error(ssl_, e) == SSL_ERROR_WANT_READ)  {
+        if (err == SSL_ERROR_WANT_READ)  {
             LOG_DEBUG("ssl::stream::do_connect  side: {}  SSL_ERROR_WANT_READ", (int)side_);
-        } else if (SSL_get_error(ssl_, e) == SSL_ERROR_WANT_WRITE)  {
+        } else if (err == SSL_ERROR_WANT_WRITE)  {
             LOG_DEBUG("ssl::stream::do_connect  side: {}  SSL_ERROR_WANT_WRITE", (int)side_);
         } else  {
-            int err = SSL_get_error(ssl_, e);
             LOG_DEBUG("ssl::stream::do_connect  side: {}  ERROR.... err: {}", (int)side_, err);
         }
     } else if (e == 0){
-        int err = SSL_get_error(ssl_, e);
         LOG_ERROR("ssl::stream::do_connect  ERROR: {}", err);
         status_ = status::closed; // do we need error status?
  
     } else if (e == 1){
-        LOG_DEBUG("ssl::stream::do_connect OK ");
+        LOG_DEBUG("ssl::stream::do_connect OK resumed: {}", SSL_session_reused(ssl_));
         status_ = status::connected;
+        ctx_->record_handshake(SSL_session_reused(ssl_) == 1);
     }
-    buffer b;
     int n;
     
     auto prior = acpp::network::async::get_prev<Chain, it>(prev_);
 
-
-    while (n = ::BIO_read(ext_bio, b.data(), b.size()), n > 0) {
-        next_.template write<Chain>(b.data(), n); //*** 
+    auto flight = bio_.take_output();
+    bio_.collect(false);
+    if (!flight.empty())
+        next_.template write<Chain>(flight.data(), flight.size());
+    // the last flight of a server carries its session tickets, already
+    // sealed with the application keys: kernel TLS must continue after them
+    if (status_ == status::connected && ctx_->ktls() && !ktls_tx_)
+        try_enable_ktls(side_ == side_t::server ? record_count(flight.data(), flight.size()) : 0);
+    if (status_ == status::connected && ctx_->tx_pipeline() && io_ && !ktls_tx_ && !tx_keys_)
+        try_enable_tx_pipeline(side_ == side_t::server ? record_count(flight.data(), flight.size()) : 0);
+    if (!early_in_.empty() && prior) {
+        auto early = std::move(early_in_);
+        early_in_.clear();
+        early_data_in_ = true;
+        prior->template on_received<Chain>(early.data(), early.size());
+        early_data_in_ = false;
+    }
+    if (status_ == status::connected) {
+        // what was written while connecting, less what the server took as early data
+        if (!early_out_.empty() && early_data_accepted())
+            cork_.erase(0, early_out_.size());
+        early_out_.clear();
+        flush<Chain>();
     }
     if(status_ == status::connected && prior) 
         prior->template on_connected<Chain>();
 
-    while(n= SSL_read(ssl_, b.data(), b.size()), n > 0) {
-        prior->template on_received<Chain>(b.data(), n);
+    // SSL_read would take the early data as if it came after the handshake
+    if (side_ == side_t::server && ctx_->early_data() && !early_done_)
+        return;
+    while(n= SSL_read(ssl_, plaintext(), (int)ctx_->plaintext_chunk()), n > 0) {
+        if (!check_discarded<Chain>())
+            return;
+        prior->template on_received<Chain>(plaintext_.data(), n);
+    }
+    check_discarded<Chain>();
+}
+template<typename Next>
+template <typename Chain>
+void stream<Next>::flush_output() {
+    auto out = bio_.take_output();
+    if (!out.empty()) {
+        LOG_DEBUG("ssl::stream::flush_output: {}", out.size());
+        next_.template write<Chain>(out.data(), out.size());
+    }
+    if (ktls_tx_ && !ktls_close_notify_sent_ && (SSL_get_shutdown(ssl_) & SSL_SENT_SHUTDOWN)) {
+        ktls_close_notify_sent_ = true;
+        if constexpr (socket_layer<Next>) {
+            if (next_.pending_output() || !ktls::send_close_notify(next_.socket().fd()))
+                LOG_DEBUG("ssl::stream::flush_output: close_notify not sent");
+        }
+    }
+    if (tx_keys_ && !tx_close_notify_sent_ && (SSL_get_shutdown(ssl_) & SSL_SENT_SHUTDOWN)) {
+        // queued behind the batches still being sealed
+        tx_close_notify_sent_ = true;
+        const char alert[] = {SSL3_AL_WARNING, SSL3_AD_CLOSE_NOTIFY};
+        auto batch = std::make_shared<tx_batch>();
+        if (!tx_failed_ && tx_sealer_->seal(tx_seq_, SSL3_RT_ALERT, alert, sizeof(alert), batch->records)) {
+            tx_seq_++;
+            batch->done = true;
+            tx_queue_.push_back(batch);
+            pipeline_drain<Chain>();
+        }
+    }
+}
+
+template<typename Next>
+void stream<Next>::try_enable_ktls(uint64_t seq) {
+    if constexpr (socket_layer<Next>) {
+        traffic_keys keys;
+        // queued bytes are records sealed by OpenSSL, the kernel would seal them again
+        if (next_.pending_output() || !traffic_keys::tx(ssl_, keys))
+            return;
+        keys.seq = seq;
+        ktls_tx_ = ktls::enable_tx(next_.socket().fd(), keys);
+        // With kernel TLS, records sealed by OpenSSL (key updates, alerts)
+        // can not be sent: the kernel would encrypt them again. check_discarded
+        // closes the connection if there are any.
+        bio_.discard(ktls_tx_);
+        LOG_DEBUG("ssl::stream::try_enable_ktls seq: {} enabled: {}", seq, ktls_tx_);
+    }
+}
+
+template<typename Next>
+template<typename Chain>
+bool stream<Next>::check_discarded() {
+    if (tx_failed_)
+        return false;
+    if (auto n = bio_.take_discarded()) {
+        LOG_ERROR("ssl::stream: {} bytes sealed by OpenSSL can not be sent", n);
+        fail_tx<Chain>("post-handshake message not supported");
+    } else if ((ktls_tx_ || tx_keys_) && SSL_get_key_update_type(ssl_) != SSL_KEY_UPDATE_NONE) {
+        // OpenSSL holds the KeyUpdate the peer asked for until the next SSL_write
+        fail_tx<Chain>("KeyUpdate requested, not supported with records sealed outside OpenSSL");
+    }
+    return !tx_failed_;
+}
+
+template<typename Next>
+template<typename Chain>
+void stream<Next>::fail_tx(const char* error) {
+    LOG_ERROR("ssl::stream: {}", error);
+    tx_failed_ = true;
+    tx_queue_.clear();
+    // not from inside the receive path of the layers below
+    if constexpr (requires { next_.template disconnect<Chain>(); })
+        disconnect_.schedule(io_, [this]() { next_.template disconnect<Chain>(); });
+}
+
+template<typename Next>
+void stream<Next>::try_enable_tx_pipeline(uint64_t seq) {
+    traffic_keys keys;
+    if (!traffic_keys::tx(ssl_, keys))
+        return;
+    keys.seq = seq;
+    tx_seq_ = seq;
+    tx_sealer_ = std::make_unique<record_sealer>(keys);
+    tx_keys_ = std::make_shared<const traffic_keys>(std::move(keys));
+    if (!job_)
+        job_ = std::make_shared<handshake_job>();
+    // as with kernel TLS, what OpenSSL seals now can not be sent:
+    // check_discarded closes the connection if there is any
+    bio_.discard(true);
+    LOG_DEBUG("ssl::stream::try_enable_tx_pipeline seq: {}", seq);
+}
+
+// Large writes are cut in batches sealed on the crypto_pool; batches are
+// written in sequence order as they complete.
+template<typename Next>
+template<typename Chain>
+bool stream<Next>::pipeline_write(const char* buf, size_t len) {
+    static constexpr size_t max_record = SSL3_RT_MAX_PLAIN_LENGTH;
+    if (tx_queue_.empty() && len <= max_record) {
+        std::string record;
+        // the sequence number is only used up by a record that goes out
+        if (!tx_sealer_->seal(tx_seq_, SSL3_RT_APPLICATION_DATA, buf, len, record)) {
+            fail_tx<Chain>("tx pipeline: sealing failed");
+            return false;
+        }
+        tx_seq_++;
+        next_.template write<Chain>(record.data(), record.size());
+        return true;
+    }
+    while (len) {
+        size_t n = std::min(len, ctx_->tx_batch());
+        auto batch = std::make_shared<tx_batch>();
+        batch->plaintext.assign(buf, n);
+        batch->seq = tx_seq_;
+        tx_seq_ += (n + max_record - 1) / max_record;
+        tx_queue_.push_back(batch);
+        ctx_->tx_pipeline()->post([this, batch, keys = tx_keys_, job = job_, io = io_]() {
+            record_sealer sealer(*keys);
+            auto& in = batch->plaintext;
+            batch->records.reserve(in.size() + (in.size() / max_record + 1) * record_sealer::overhead);
+            uint64_t seq = batch->seq;
+            for (size_t i = 0; i < in.size() && !batch->failed; i += max_record)
+                batch->failed = !sealer.seal(seq++, SSL3_RT_APPLICATION_DATA, in.data() + i, std::min(max_record, in.size() - i), batch->records);
+            io->exec([this, batch, job]() {
+                if (!job->alive)
+                    return;
+                batch->done = true;
+                pipeline_drain<Chain>();
+            });
+        });
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+template<typename Next>
+template<typename Chain>
+void stream<Next>::pipeline_drain() {
+    bool wrote = false;
+    while (!tx_queue_.empty() && tx_queue_.front()->done) {
+        if (tx_queue_.front()->failed) {
+            // the peer would see a gap in the record sequence
+            fail_tx<Chain>("tx pipeline: sealing failed");
+            return;
+        }
+        auto& records = tx_queue_.front()->records;
+        next_.template write<Chain>(records.data(), records.size());
+        tx_queue_.pop_front();
+        wrote = true;
     }
+    // the queue was pending output too
+    if (wrote && tx_queue_.empty() && !next_.pending_output())
+        on_drained<Chain>();
 }
+
+template<typename Next>
+int64_t stream<Next>::sendfile(int64_t in_fd, int64_t offset, size_t count) {
+    if constexpr (socket_layer<Next>) {
+        if (ktls_tx_ && !next_.pending_output())
+            return ktls::sendfile(next_.socket().fd(), in_fd, offset, count);
+    }
+    return -1;
+}
+
 // write_input -> to app
 // write_output -> to socket
 
@@ -213,6 +568,13 @@ template <typename Chain>
 void stream<Next>::on_disconnected() { 
     LOG_DEBUG("ssl::stream::on_disconnected status:{} ctx_.type():{}", (int)status_, (int)ctx_.side());
     //do_shutdown<Chain>(nullptr, 0);
+    // a completed close_notify exchange has told the layers above already;
+    // otherwise the transport went away under them
+    if (status_ == status::closed && ssl_ && SSL_get_shutdown(ssl_) == (SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN))
+        return;
+    status_ = status::closed;
+    if (auto prior = acpp::network::async::get_prev<Chain, it>(prev_))
+        prior->template on_disconnected<Chain>();
 }
 
 
@@ -222,15 +584,13 @@ void stream<Next>::do_shutdown(const char* buf, size_t len) {
     LOG_DEBUG("ssl::stream::do_shutdown status_: {}", (int)status_); 
     auto prior = acpp::network::async::get_prev<Chain, it>(prev_);
 
+    bind_output<Chain>();
+    bio_.input(buf, len);
     int e;
-    if (len) {
-        e = BIO_write(ext_bio, buf, len);
-        LOG_DEBUG("ssl::stream::do_shutdown BIO_write e: {} len: {}", e, len); 
-
-    }
     if (status_ == status::closing) {
         LOG_DEBUG("ssl::stream::do_shutdown  going shutdown");
         e = SSL_shutdown(ssl_);
+        bio_.take_discarded(); // the close_notify, flush_output sends it
         int ssls = SSL_get_shutdown(ssl_);
         LOG_DEBUG("ssl::stream::do_shutdown ssls(1): {}", ssls);
         //status_  = Status::closing;
@@ -256,19 +616,17 @@ void stream<Next>::do_shutdown(const char* buf, size_t len) {
         status_ = status::closed;
         // prior connected ...
     }
-    buffer b;
     int n;
 
-    while (n = ::BIO_read(ext_bio, b.data(), b.size()), n > 0) {
-        next_.template write<Chain>(b.data(), n);
-    }
+    flush_output<Chain>();
     if(status_ == status::closed && prior) 
         prior->template on_disconnected<Chain>();
 
-    while(n= SSL_read(ssl_, b.data(), b.size()), n > 0) {
+    while(n= SSL_read(ssl_, plaintext(), (int)ctx_->plaintext_chunk()), n > 0) {
         if (prior)
-            prior->template on_received<Chain>(b.data(), n);
+            prior->template on_received<Chain>(plaintext_.data(), n);
     }
+    bio_.done_input();
     int ssls = SSL_get_shutdown(ssl_);
     LOG_DEBUG("ssl::stream::do_shutdown ssls(2): {}", ssls);
 
@@ -279,6 +637,7 @@ template<typename Chain>
 void stream<Next>::disconnect() {
     LOG_DEBUG("ssl::stream::disconnect begin");
     if (status_ == status::connected) {
+        flush<Chain>();
         status_ = status::closing;
         do_shutdown<Chain>(nullptr, 0);
     } else {
@@ -305,40 +664,34 @@ void stream<Next>::on_received(const char* buf, size_t len)  {
     {
         //const char* hostname = SSL_get_servername(ssl_, TLSEXT_NAMETYPE_host_name);
 
+        bind_output<Chain>();
+        bio_.input(buf, len);
         int n = 0;
-        int tot_n =0;
-        buffer b;
-        while (tot_n < len) {
-            n = BIO_write(ext_bio, buf + tot_n, len - tot_n); 
-            tot_n += n;
-            LOG_DEBUG("*ssl::stream::on_received BIO_write: n: {} len: {} tot_n: {}", n, len, tot_n);
-
-            while(n = ::SSL_read(ssl_, b.data(), b.size()), n > 0) {
-                LOG_DEBUG("ssl::stream::on_received SSL_read: {}", n);
-                    prior->template on_received<Chain>(b.data(), n);
-            } 
-            if (n <= 0) {
-                //SSL_get_error(ssl_, e) == SSL_ERROR_WANT_WRITE);
-                LOG_DEBUG("ssl::stream::on_received SSL_read: {} error: {}", n, SSL_get_error(ssl_, n));
-            }
-            //shutdown_st = SSL_get_shutdown(ssl_);
-            while (n = ::BIO_read(ext_bio, b.data(), b.size()), n > 0) {
-                LOG_DEBUG("ssl::stream::on_received BIO_read: {}", n);
-                    next_.template write<Chain>(b.data(), n);
-            }        
+        while(n = ::SSL_read(ssl_, plaintext(), (int)ctx_->plaintext_chunk()), n > 0) {
+            LOG_DEBUG("ssl::stream::on_received SSL_read: {}", n);
+            // nothing more goes up once the connection is failing
+            if (!check_discarded<Chain>())
+                break;
+            prior->template on_received<Chain>(plaintext_.data(), n);
+        } 
+        if (n <= 0) {
+            //SSL_get_error(ssl_, e) == SSL_ERROR_WANT_WRITE);
+            LOG_DEBUG("ssl::stream::on_received SSL_read: {} error: {}", n, SSL_get_error(ssl_, n));
         }
+        bio_.done_input();
+        if (!check_discarded<Chain>())
+            return;
 
         int shutdown_st = SSL_get_shutdown(ssl_);
         if (shutdown_st ==  SSL_RECEIVED_SHUTDOWN)    {
             status_ = status::peer_closing;
             shutdown_st = SSL_shutdown(ssl_);
+            bio_.take_discarded(); // the close_notify, flush_output sends it
             LOG_DEBUG("ssl::stream::on_received SSL_shutdown");;
         }
 
-        while (n = ::BIO_read(ext_bio, b.data(), b.size()), n > 0) {
-            LOG_DEBUG("ssl::stream::on_received BIO_read(2): {}", n);
-            next_.template write<Chain>(b.data(), n);
-        }
+        flush_output<Chain>();
+        release_buffers();
 
 //SSL_SENT_SHUTDOWN
 //SSL_RECEIVED_SHUTDOWN
@@ -352,40 +705,169 @@ template<typename Next>
 template<typename Chain>
 size_t stream<Next>::write(const char* buf, size_t len)  {
     LOG_DEBUG("ssl::stream::write_output len: {}", len);
-    auto prior = acpp::network::async::get_prev<Chain, it>(prev_);
-    if (status_ == status::connected) {
-        int totalLen = 0;
-        while (totalLen < len)  {
-            int e = SSL_write(ssl_, buf + totalLen, len - totalLen);
-            //SSL_MODE_ENABLE_PARTIAL_WRITE option of SSL_CTX_set_mode(3). 
-            LOG_DEBUG("ssl::stream::write_output len: {} written {}", len, e);
-            if (e > 0)  {
-                totalLen += e;
-            }
-            else {
-                break;
-            }
-            buffer b;
-            int n;
-            while (n = ::BIO_read(ext_bio, b.data(), b.size()), n > 0) {
-                LOG_DEBUG("ssl::stream::write_output BIO_read: n {}", n);
-                next_.template write<Chain>(b.data(), n);       
-                //break;    //todo: why???
+    const size_t size = len;
+    if (status_ == status::closed || status_ == status::connecting) {
+        // sent once connected, or as early data (context::enable_early_data)
+        cork_.append(buf, len);
+        return len;
+    }
+    if (status_ != status::connected) {
+        LOG_DEBUG("ssl::stream::write_output invalid state");
+        //throw Exception("ssl::stream::write_output: invalid state");
+        return len;
+    }
+    if (!ctx_->writes().cork || !io_)
+        return seal<Chain>(buf, len) ? len : 0;
+
+    // full records go now, the rest waits for the end of the loop iteration
+    constexpr size_t max_record = SSL3_RT_MAX_PLAIN_LENGTH;
+    if (cork_.empty() && len >= max_record) {
+        size_t full = len - len % max_record;
+        if (!seal<Chain>(buf, full))
+            return 0;
+        buf += full;
+        len -= full;
+    }
+    cork_.append(buf, len);
+    if (cork_.size() >= max_record) {
+        size_t full = cork_.size() - cork_.size() % max_record;
+        bool sealed = seal<Chain>(cork_.data(), full);
+        cork_.erase(0, full);
+        if (!sealed)
+            return 0;
+    }
+    if (!cork_.empty() && !flush_queued_) {
+        if (!job_)
+            job_ = std::make_shared<handshake_job>();
+        flush_queued_ = true;
+        io_->exec([this, job = job_]() {
+            if (!job->alive)
+                return;
+            flush_queued_ = false;
+            flush<Chain>();
+        });
+    }
+    return size;
+}
+
+template<typename Next>
+template<typename Chain>
+size_t stream<Next>::writev(const async::const_buffer* buffers, size_t count)  {
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++)
+        size += buffers[i].size;
+    if (status_ == status::connected && ktls_tx_) {
+        if (tx_failed_)
+            return 0;
+        // the kernel builds the records
+        next_.template writev<Chain>(buffers, count);
+        return size;
+    }
+    if (status_ != status::connected || ctx_->writes().cork) {
+        // corked already
+        for (size_t i = 0; i < count; i++)
+            write<Chain>(buffers[i].data, buffers[i].size);
+        return size;
+    }
+
+    // small pieces are staged into full records, large ones sealed in place
+    constexpr size_t max_record = SSL3_RT_MAX_PLAIN_LENGTH;
+    std::string staged;
+    for (size_t i = 0; i < count; i++) {
+        auto buf = buffers[i].data;
+        auto len = buffers[i].size;
+        if (staged.empty() && len >= max_record) {
+            size_t full = len - len % max_record;
+            if (!seal<Chain>(buf, full))
+                return 0;
+            buf += full;
+            len -= full;
+        }
+        while (len) {
+            if (staged.empty())
+                staged.reserve(max_record);
+            auto n = std::min(len, max_record - staged.size());
+            staged.append(buf, n);
+            buf += n;
+            len -= n;
+            if (staged.size() == max_record) {
+                if (!seal<Chain>(staged.data(), staged.size()))
+                    return 0;
+                staged.clear();
             }
         }
-        int n;
-        buffer b;
-        while (n = ::BIO_read(ext_bio, b.data(), b.size()), n > 0) {
-            LOG_DEBUG("ssl::stream::write_output BIO_read: n {}", n);
-            next_.template write<Chain>(b.data(), n);       
-            //break;    //todo: why???
+    }
+    if (!staged.empty() && !seal<Chain>(staged.data(), staged.size()))
+        return 0;
+    return size;
+}
+
+template<typename Next>
+template<typename Chain>
+void stream<Next>::flush()  {
+    if (cork_.empty() || status_ != status::connected)
+        return;
+    seal<Chain>(cork_.data(), cork_.size());
+    cork_.clear();
+}
+
+template<typename Next>
+template<typename Chain>
+bool stream<Next>::seal(const char* buf, size_t len)  {
+    if (tx_failed_)
+        return false;
+    if (ktls_tx_) {
+        // the kernel builds the records
+        next_.template write<Chain>(buf, len);
+        return true;
+    }
+    if (tx_keys_)
+        return pipeline_write<Chain>(buf, len);
+    // records go down from the BIO as SSL_write seals them
+    bind_output<Chain>();
+    auto& policy = ctx_->writes();
+    size_t totalLen = 0;
+    while (totalLen < len)  {
+        size_records();
+        size_t n = len - totalLen;
+        if (record_size_ && record_size_ < SSL3_RT_MAX_PLAIN_LENGTH && sent_since_idle_ < policy.boost_after)
+            n = std::min(n, std::max(policy.boost_after - sent_since_idle_, record_size_));
+        int e = SSL_write(ssl_, buf + totalLen, (int)n);
+        //SSL_MODE_ENABLE_PARTIAL_WRITE option of SSL_CTX_set_mode(3). 
+        LOG_DEBUG("ssl::stream::write_output len: {} written {}", len, e);
+        if (e > 0)  {
+            totalLen += e;
+            sent_since_idle_ += e;
+        }
+        else {
+            LOG_ERROR("ssl::stream::write: SSL_write error: {}", SSL_get_error(ssl_, e));
+            return false;
         }
+    }
+    return true;
+}
 
-    } else {
-        LOG_DEBUG("ssl::stream::write_output invalid state");
-        //throw Exception("ssl::stream::write_output: invalid state");
+template<typename Next>
+void stream<Next>::size_records()  {
+    auto& policy = ctx_->writes();
+    if (!policy.initial_record)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    size_t size = record_size_;
+    if (!record_size_ || now - last_write_ >= policy.idle_reset) {
+        // new or idle connection: the peer's congestion window is small again
+        sent_since_idle_ = 0;
+        size = policy.initial_record;
+    }
+    last_write_ = now;
+    if (sent_since_idle_ >= policy.boost_after)
+        size = SSL3_RT_MAX_PLAIN_LENGTH;
+    size = std::clamp<size_t>(size, 512, SSL3_RT_MAX_PLAIN_LENGTH);
+    if (size != record_size_) {
+        SSL_set_max_send_fragment(ssl_, size);
+        SSL_set_split_send_fragment(ssl_, size); // lowered along with the max, not raised
+        record_size_ = size;
     }
-    return len;
 }
 
 
@@ -2,7 +2,12 @@
 
 //#include <cstdio>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include <acpp-network/address.h>
+#include <acpp-network/iobuf.h>
 #include <acpp-network/socket_base.h>
 #include <detail/common.h>
 
@@ -27,6 +32,42 @@ using append_to_tuple_t = typename append_to_tuple<Tuple, T>::type;
 
 class null_layer;
 
+// Drained plaintext buffers of the ssl::stream connections of a thread, when
+// their context releases buffers. The next connection that needs one takes it
+// back, so idle connections do not each keep the largest buffer they ever
+// used. Queued output is not pooled here: socket_stream keeps it in an iobuf.
+class buffer_pool {
+public:
+    static buffer_pool& local() {
+        thread_local buffer_pool pool;
+        return pool;
+    }
+
+    // An empty buffer, with the capacity of the last one given back if any
+    std::vector<char> take() {
+        if (free_.empty())
+            return {};
+        auto result = std::move(free_.back());
+        free_.pop_back();
+        return result;
+    }
+
+    // Leaves `buffer` empty and without storage
+    void give(std::vector<char>& buffer) {
+        buffer.clear();
+        if (buffer.capacity() && buffer.capacity() <= max_capacity && free_.size() < max_buffers)
+            free_.push_back(std::move(buffer));
+        std::vector<char>().swap(buffer);
+    }
+
+    size_t size() const { return free_.size(); }
+
+private:
+    static constexpr size_t max_buffers = 64;
+    static constexpr size_t max_capacity = 256 * 1024;
+    std::vector<std::vector<char>> free_;
+};
+
 template<typename Chain, int Int>
 auto get_prev(void* p) {
     if constexpr (Int + 1 < std::tuple_size<Chain>()) {
@@ -38,6 +79,63 @@ auto get_prev(void* p) {
     }
 }
 
+// A disconnect a layer asks for from inside the receive path of the layers
+// below, run by the loop once it is out of it. Dropped if the layer is
+// destroyed, or cancel()ed, first.
+class deferred_disconnect {
+public:
+    deferred_disconnect() = default;
+    deferred_disconnect(const deferred_disconnect&) = delete;
+    deferred_disconnect& operator=(const deferred_disconnect&) = delete;
+
+    ~deferred_disconnect() {
+        cancel();
+    }
+
+    // No-op without a loop
+    template<typename Disconnect>
+    void schedule(io_context* io, Disconnect&& disconnect) {
+        if (!io)
+            return;
+        if (!alive_)
+            alive_ = std::make_shared<bool>(true);
+        io->exec([alive = alive_, disconnect = std::forward<Disconnect>(disconnect)]() mutable {
+            if (*alive)
+                disconnect();
+        });
+    }
+
+    void cancel() {
+        if (alive_) {
+            *alive_ = false;
+            alive_.reset();
+        }
+    }
+
+private:
+    std::shared_ptr<bool> alive_;
+};
+
+// A prefix (a frame header) and the buffers of its body go down as one
+// gathered write: `writev(v, count)` gets them in a vector on the stack up to
+// a few buffers, the body is not copied.
+template<typename Writev>
+void writev_prefixed(const const_buffer& prefix, const const_buffer* buffers, size_t count, Writev&& writev) {
+    constexpr size_t inline_count = 8;
+    if (count < inline_count) {
+        const_buffer v[inline_count];
+        v[0] = prefix;
+        std::copy(buffers, buffers + count, v + 1);
+        writev(v, count + 1);
+    } else {
+        std::vector<const_buffer> v;
+        v.reserve(count + 1);
+        v.push_back(prefix);
+        v.insert(v.end(), buffers, buffers + count);
+        writev(v.data(), v.size());
+    }
+}
+
 
 class null_layer {
 public:    
@@ -61,6 +159,20 @@ public:
         return 0;
     }
 
+    template<typename Chain> 
+    size_t writev(const const_buffer* buffers, size_t count) { 
+        LOG_DEBUG("null_layer.writev");
+        return 0;
+    }
+
+    template<typename Chain> 
+    void pause_reading() {}
+
+    template<typename Chain> 
+    void resume_reading() {}
+
+    size_t pending_output() const { return 0; }
+
     template<typename Chain> 
     void on_received(const char* buf, size_t s) { 
         LOG_DEBUG("null_layer.on_received");
@@ -74,6 +186,8 @@ public:
         return (null_layer&)*this;
     }
 
+    size_t memory_footprint() const { return 0; }
+
     //Next& next() { return next_;}
 
     private:
@@ -103,6 +217,7 @@ public:
 
     stream(side_t side):side_(side), next_(side) {
         next_.prev_ = this;
+        wire();
         LOG_DEBUG("stream this: {}", (void*) this);
     }
 
@@ -110,6 +225,7 @@ public:
     stream(Context& c)
     :side_(c.side()), next_(c) {
         next_.prev_ = this;
+        wire();
         LOG_DEBUG("stream this: {}", (void*) this);
     }
     
@@ -134,6 +250,44 @@ public:
         next_.template disconnect<chain_type>();
     }
 
+    // Pushes down what the layers are holding back (ssl corking)
+    void flush() {
+        next_.template flush<chain_type>();
+    }
+
+    // Bytes used by this connection: the layers plus the buffers they hold
+    size_t memory_footprint() const {
+        return sizeof(*this) + next_.memory_footprint();
+    }
+
+    // Back to a fresh state for another connection, keeping the callbacks
+    // (stream_server recycles its sessions so). Only when every layer can.
+    void reset() requires requires (Next& n) { n.reset(); } {
+        next_.reset();
+    }
+
+    // The socket stops reading, and TCP flow control holds the peer back.
+    // What the layers below had already read may still come up.
+    void pause_reading() {
+        next_.template pause_reading<chain_type>();
+    }
+
+    void resume_reading() {
+        next_.template resume_reading<chain_type>();
+    }
+
+    // Written bytes the socket has not taken yet. on_drained_cb_ tells when
+    // they are gone.
+    size_t pending_output() const {
+        return next_.pending_output();
+    }
+
+    template<typename Chain> 
+    void on_drained() { 
+        if (on_drained_cb_)
+            on_drained_cb_();
+    }
+
     template<typename Chain> 
     void on_disconnected() { 
         LOG_DEBUG("stream.on_disconnected side_ {}", (int)side_);
@@ -147,6 +301,23 @@ public:
         return next_.template write<chain_type>(buf, s);
     }
 
+    // The buffers go down as one message (a framing layer sends them as one frame)
+    size_t writev(const const_buffer* buffers, size_t count) { 
+        return next_.template writev<chain_type>(buffers, count);
+    }
+
+    // Shared, not copied, down to a socket_stream; through other layers it
+    // goes as one gathered write
+    size_t write(const iobuf& buf) {
+        if constexpr (requires { next_.template write<chain_type>(buf); }) {
+            return next_.template write<chain_type>(buf);
+        } else {
+            return buf.gather([&](const const_buffer* v, size_t count) {
+                return next_.template writev<chain_type>(v, count);
+            });
+        }
+    }
+
     template<typename Chain> 
     void on_received(const char* buf, size_t s) { 
         LOG_DEBUG("stream.on_received side: {} msg: {}", (int)side_, std::string(buf, s));
@@ -172,8 +343,15 @@ public:
     std::function<void()> on_connected_cb_;
     std::function<void()> on_disconnected_cb_;
     std::function<void(const char*, size_t)> on_received_cb_;
+    std::function<void()> on_drained_cb_;
 
 private:
+    // The socket's callbacks, once the chain is whole
+    void wire() {
+        if constexpr (requires (last_type& l) { l.template last<chain_type>(); })
+            next_.template last<chain_type>();
+    }
+
     void* prev_;
     Next next_;
     side_t side_;
@@ -202,6 +380,40 @@ public:
         return next_.template write<Chain>(buf, s);
     }
 
+    template<typename Chain> 
+    size_t writev(const const_buffer* buffers, size_t count) { 
+        return next_.template writev<Chain>(buffers, count);
+    }
+
+    template<typename Chain> 
+    void flush() { 
+        next_.template flush<Chain>();
+    }
+
+    size_t memory_footprint() const { return next_.memory_footprint(); }
+
+    void reset() requires requires (Next& n) { n.reset(); } {
+        next_.reset();
+    }
+
+    template<typename Chain> 
+    void pause_reading() { 
+        next_.template pause_reading<Chain>();
+    }
+
+    template<typename Chain> 
+    void resume_reading() { 
+        next_.template resume_reading<Chain>();
+    }
+
+    size_t pending_output() const { return next_.pending_output(); }
+
+    template<typename Chain> 
+    void on_drained() { 
+        auto p = get_prev<Chain, it>(prev_);
+        if (p) p->template on_drained<Chain>();
+    }
+
     template<typename Chain> 
     void on_received(const char* buf, size_t s) { 
         LOG_DEBUG("layer.on_received");
@@ -295,20 +507,14 @@ public:
         };
         socket_.callbacks().on_sent = [&](async::async_socket_base& s, size_t length) {
             //LOG_DEBUG("socket_stream on_sent fd:" + std::to_string(s.fd()) + " "  + std::to_string(length));
-            if (!pending_data_.empty()) {
-                auto n = socket_.write(pending_data_.data(), pending_data_.size());
-                if (n > 0) {
-                    //TODO: find a better way
-                    pending_data_.erase(pending_data_.begin(), pending_data_.begin() + n);
-                }
-            }
+            if (!pending_.empty() && send(pending_))
+                on_drained<Chain>();
         };
 
     }
     void* prev_; 
 
     acpp::network::side_t side_;
-    std::vector<char> pending_data_;
 
     template<typename Chain, typename Address > 
     void connect(const Address& adr) { 
@@ -332,6 +538,38 @@ public:
         socket_.close();
     }
 
+    template<typename Chain> 
+    void flush() {}
+
+    // Heap held for this connection besides the socket itself
+    size_t memory_footprint() const { return pending_.memory_footprint(); }
+
+    // Closes the socket and drops what it did not take
+    void reset() {
+        socket_.close();
+        pending_.clear();
+        pending_.shrink_to_fit();
+    }
+
+    template<typename Chain> 
+    void pause_reading() { 
+        socket_.pause_reading();
+    }
+
+    template<typename Chain> 
+    void resume_reading() { 
+        socket_.resume_reading();
+    }
+
+    size_t pending_output() const { return pending_.size(); }
+
+    template<typename Chain> 
+    void on_drained() { 
+        auto prior = acpp::network::async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_drained<Chain>();
+    }
+
     template<typename Chain> 
     void on_disconnected() { 
         LOG_DEBUG("socket_stream.on_disconnected side: {}", (int)side_);
@@ -344,7 +582,7 @@ public:
     template<typename Chain> 
     auto last() {
         using wrapper_type = wrapper<socket_stream, Chain>;
-        //TODO: NYAPA ALERT!!!! do this in constructor!!!!
+        // the top of the chain comes here from its constructor
         if (!callback_init_) {
             callback_init_ = true;
             callback_init<Chain>();
@@ -355,14 +593,42 @@ public:
     template<typename Chain> 
     size_t write(const char* buf, size_t size) {
         LOG_DEBUG("socket_stream.write side: {} size: {}", (int)side_, size);
-        auto n = socket_.write(buf, size);
+        // behind queued data the buffer is queued too, to keep the order
+        size_t n = pending_.empty() ? socket_.write(buf, size) : 0;
+        if (n < size)
+            pending_.append(buf + n, size - n);
+        return size;
+    }
+
+    template<typename Chain> 
+    size_t writev(const const_buffer* buffers, size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; i++)
+            size += buffers[i].size;
+        LOG_DEBUG("socket_stream.writev side: {} size: {}", (int)side_, size);
+        // behind queued data the buffers are queued too, to keep the order
+        size_t n = pending_.empty() ? socket_.writev(buffers, count) : 0;
         if (n < size) {
-            //TODO: find better way
-            pending_data_.insert(pending_data_.end(), buf, buf + size);
+            for (size_t i = 0; i < count; i++) {
+                auto skip = std::min(n, buffers[i].size);
+                n -= skip;
+                pending_.append(buffers[i].data + skip, buffers[i].size - skip);
+            }
         }
         return size;
     }
 
+    // What the socket does not take is held as a share of the blocks, not copied
+    template<typename Chain> 
+    size_t write(const iobuf& buf) {
+        LOG_DEBUG("socket_stream.write side: {} iobuf size: {}", (int)side_, buf.size());
+        iobuf rest(buf);
+        if (pending_.empty())
+            send(rest);
+        pending_.append(std::move(rest));
+        return buf.size();
+    }
+
     template<typename Chain> 
     void on_received(const char* buf, size_t size) {
         LOG_DEBUG("socket_stream.on_received side: {} size: {} prev: {}", (int)side_, size, (void*)prev_);
@@ -380,7 +646,27 @@ public:
         callback_init<Chain>();
     }
 private:    
+    // Gathered from the blocks until the socket takes less than offered;
+    // true once `buf` is all sent
+    bool send(iobuf& buf) {
+        constexpr size_t max_pieces = 16;
+        const_buffer pieces[max_pieces];
+        while (!buf.empty()) {
+            auto count = buf.fill(pieces, max_pieces);
+            size_t offered = 0;
+            for (size_t i = 0; i < count; i++)
+                offered += pieces[i].size;
+            auto n = socket_.writev(pieces, count);
+            buf.consume(n);
+            if (n < offered)
+                return false;
+        }
+        return true;
+    }
+
     async_socket_base socket_;
+    // what the socket did not take yet
+    iobuf pending_;
     bool callback_init_ = false;
 
 };
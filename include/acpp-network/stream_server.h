@@ -0,0 +1,182 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <acpp-network/address.h>
+#include <acpp-network/socket_base.h>
+#include <acpp-network/stream.h>
+
+namespace acpp::network::async {
+
+struct stream_server_options {
+    // While this many sessions are open the listener stops accepting; new
+    // connections wait in the kernel's backlog
+    size_t max_sessions = 1024;
+    int backlog = 512;
+};
+
+struct stream_server_stats {
+    size_t accepted = 0;
+    size_t active = 0;
+    // chain objects built; the other accepts reused a closed session's
+    size_t created = 0;
+};
+
+// Accepts connections into session chains (stream<...> tops) it owns. A
+// closed session goes to a free list and is reset() for the next connection,
+// or destroyed and built again in place when a layer of the chain can not
+// reset, so in steady state an accept allocates nothing for the chain.
+// Hooks: on_created once per chain object (its stream callbacks set there stay
+// across connections), on_open for each connection and on_close when it ends.
+// The server owns the sessions' on_disconnected_cb_.
+template<typename Chain>
+class stream_server {
+public:
+    using session_callback = std::function<void(Chain&)>;
+
+    template<typename Context>
+    stream_server(Context& c, const ip_socketaddress& adr, stream_server_options options = {})
+    : io_(c.io()), options_(options),
+      make_([c]() mutable { return std::make_unique<Chain>(c); }),
+      rebuild_([c](Chain* p) mutable { std::destroy_at(p); std::construct_at(p, c); }),
+      listener_(get_family(adr), SOCK_STREAM, IPPROTO_TCP, c.io(),
+        socket_callbacks {
+            .on_accepted = [this](async_socket_base&, async_socket_base&& s) { accepted(std::move(s)); }
+        }),
+      token_(new token{this}) {
+        if (!listener_.bind(to_sockaddr(adr)))
+            throw socket_exception("stream_server bind");
+        listener_.listen(options_.backlog);
+    }
+
+    ~stream_server() {
+        // a recycle already scheduled finds the server gone
+        if (token_->pending)
+            token_->server = nullptr;
+        else
+            delete token_;
+    }
+
+    stream_server(const stream_server&) = delete;
+    stream_server& operator=(const stream_server&) = delete;
+
+    // Ends the session; it is recycled once out of its callbacks
+    void close(Chain& session) {
+        auto it = index_.find(&session);
+        if (it == index_.end())
+            return;
+        session.disconnect();
+        closed(*it->second);
+    }
+
+    const stream_server_stats& stats() const { return stats_; }
+    size_t free_sessions() const { return free_.size(); }
+
+    session_callback on_created_;
+    session_callback on_open_;
+    session_callback on_close_;
+
+private:
+    struct slot {
+        std::unique_ptr<Chain> chain;
+        bool open = false;
+    };
+
+    // What a scheduled recycle holds instead of the server, which may be gone
+    // by then; a raw pointer keeps the exec callback from allocating
+    struct token {
+        stream_server* server;
+        size_t pending = 0;
+    };
+
+    void accepted(async_socket_base&& s) {
+        slot* session;
+        if (!free_.empty()) {
+            session = free_.back();
+            free_.pop_back();
+        } else {
+            slots_.push_back(std::make_unique<slot>());
+            session = slots_.back().get();
+            session->chain = make_();
+            index_.emplace(session->chain.get(), session);
+            // the lists hold at most every slot: they never grow on a recycle
+            free_.reserve(slots_.size());
+            closing_.reserve(slots_.size());
+            created(*session);
+        }
+        session->open = true;
+        session->chain->last().socket(std::move(s));
+        stats_.accepted++;
+        stats_.active++;
+        if (stats_.active >= options_.max_sessions)
+            listener_.pause_reading();
+        if (on_open_)
+            on_open_(*session->chain);
+    }
+
+    void created(slot& session) {
+        stats_.created++;
+        session.chain->on_disconnected_cb_ = [this, s = &session]() { closed(*s); };
+        if (on_created_)
+            on_created_(*session.chain);
+    }
+
+    void closed(slot& session) {
+        if (!session.open)
+            return;
+        session.open = false;
+        stats_.active--;
+        if (on_close_)
+            on_close_(*session.chain);
+        closing_.push_back(&session);
+        // not from inside the session's own callbacks
+        if (!token_->pending) {
+            token_->pending++;
+            io_.exec([t = token_]() {
+                t->pending--;
+                if (t->server)
+                    t->server->recycle();
+                else if (!t->pending)
+                    delete t;
+            });
+        }
+    }
+
+    void recycle() {
+        for (auto session: closing_) {
+            if constexpr (requires (Chain& c) { c.reset(); }) {
+                session->chain->reset();
+            } else {
+                rebuild_(session->chain.get());
+                created(*session);
+            }
+            free_.push_back(session);
+        }
+        closing_.clear();
+        if (stats_.active < options_.max_sessions)
+            listener_.resume_reading();
+    }
+
+    io_context& io_;
+    stream_server_options options_;
+    std::function<std::unique_ptr<Chain>()> make_;
+    std::function<void(Chain*)> rebuild_;
+    async_socket_base listener_;
+    token* token_;
+    std::vector<std::unique_ptr<slot>> slots_;
+    std::unordered_map<Chain*, slot*> index_;
+    std::vector<slot*> free_;
+    std::vector<slot*> closing_;
+    stream_server_stats stats_;
+};
+
+} // namespace acpp::network::async
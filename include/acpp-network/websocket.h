@@ -0,0 +1,572 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <acpp-network/stream.h>
+#include <acpp-network/http1.h>
+
+namespace acpp::network::websocket {
+
+enum class opcode : uint8_t { continuation = 0, text = 1, binary = 2, close = 8, ping = 9, pong = 10 };
+
+struct options {
+    // Request target and subprotocol of the client's handshake
+    std::string path = "/";
+    std::string protocol;
+    // Type of the messages sent with write
+    opcode type = opcode::binary;
+};
+
+using mask_key = std::array<uint8_t, 4>;
+
+// dst = src ^ key, the key starting at byte `phase`. Returns the phase after
+// len bytes. dst may be src.
+size_t mask(char* dst, const char* src, size_t len, const mask_key& key, size_t phase = 0);
+mask_key random_mask();
+// Masking kernel in use (the 128 bit one is SSE2), as for http::scan_level
+http::simd mask_level();
+http::simd mask_level(http::simd level);
+
+// Frame header with the payload length and, from clients, the mask key. Returns its size.
+static constexpr size_t max_frame_header = 14;
+size_t write_frame_header(char* out, opcode op, bool fin, uint64_t len, const mask_key* key);
+
+std::string make_client_key();
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key
+std::string accept_key(std::string_view client_key);
+
+// WebSocket (RFC 6455) over a byte stream (socket_stream, ssl::stream).
+// After the HTTP upgrade on_connected goes up, each write is one message and
+// the payload of received messages goes up as on_received, fragment by
+// fragment as it arrives: large messages are never assembled. Message
+// boundaries come with on_message_begin_cb_ and on_message_end_cb_. Pings
+// are answered; disconnect starts the close handshake.
+// Text payloads are not validated as UTF-8.
+template<typename Next = async::null_layer>
+class websocket_layer {
+public:
+    enum {it = Next::it+1,};
+    using next_type = Next;
+    using chain_type = async::append_to_tuple_t<typename next_type::chain_type, websocket_layer* >;
+    using last_type = next_type::last_type;
+
+    enum class status { handshake, open, closing, closed };
+
+    websocket_layer(side_t side): side_(side), next_(side), parser_(side) {
+        next_.prev_ = this;
+    }
+
+    // Options come from the context when it has websocket()
+    template<typename Context>
+    websocket_layer(Context& c): side_(c.side()), next_(c), parser_(c.side()) {
+        next_.prev_ = this;
+        if constexpr (requires { c.websocket(); })
+            options_ = c.websocket();
+        if constexpr (requires { c.hostname(); })
+            host_ = c.hostname();
+        if constexpr (requires { c.io(); })
+            io_ = &c.io();
+    }
+
+    void options(const websocket::options& o) { options_ = o; }
+    const websocket::options& options() const { return options_; }
+    status state() const { return status_; }
+    // Subprotocol of the handshake
+    const std::string& protocol() const { return protocol_; }
+
+    std::function<void(opcode)> on_message_begin_cb_;
+    std::function<void()> on_message_end_cb_;
+    // Close code and reason from the peer, 1006 when the connection dropped
+    std::function<void(uint16_t, std::string_view)> on_close_cb_;
+
+    template<typename Chain>
+    void connect() {
+        next_.template connect<Chain>();
+    }
+
+    // Transport up: the client starts the handshake
+    template<typename Chain>
+    void on_connected() {
+        if (side_ != side_t::client || status_ != status::handshake)
+            return;
+        key_ = make_client_key();
+        std::string head;
+        if (options_.protocol.empty()) {
+            http::write_request_head(head, "GET", options_.path,
+                {{"Host", host_}, {"Upgrade", "websocket"}, {"Connection", "Upgrade"},
+                 {"Sec-WebSocket-Key", key_}, {"Sec-WebSocket-Version", "13"}}, 0);
+        } else {
+            http::write_request_head(head, "GET", options_.path,
+                {{"Host", host_}, {"Upgrade", "websocket"}, {"Connection", "Upgrade"},
+                 {"Sec-WebSocket-Key", key_}, {"Sec-WebSocket-Version", "13"},
+                 {"Sec-WebSocket-Protocol", options_.protocol}}, 0);
+        }
+        parser_.sent_request("GET");
+        next_.template write<Chain>(head.data(), head.size());
+    }
+
+    // Starts the close handshake
+    template<typename Chain>
+    void disconnect() {
+        if (status_ == status::open) {
+            status_ = status::closing;
+            uint8_t code[2] = {1000 >> 8, 1000 & 0xff};
+            async::const_buffer payload{(const char*)code, 2};
+            send_frame<Chain>(opcode::close, &payload, 1);
+            return;
+        }
+        next_.template disconnect<Chain>();
+    }
+
+    template<typename Chain>
+    void on_disconnected() {
+        bool was_open = status_ == status::open || status_ == status::closing;
+        status_ = status::closed;
+        std::string().swap(partial_);
+        if (was_open && on_close_cb_)
+            on_close_cb_(1006, {});
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_disconnected<Chain>();
+    }
+
+    template<typename Chain>
+    size_t write(const char* buf, size_t s) {
+        async::const_buffer payload{buf, s};
+        return writev<Chain>(&payload, 1);
+    }
+
+    // One message in one frame
+    template<typename Chain>
+    size_t writev(const async::const_buffer* buffers, size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; i++)
+            size += buffers[i].size;
+        if (status_ == status::closing || status_ == status::closed)
+            return 0;
+        send_frame<Chain>(options_.type, buffers, count);
+        return size;
+    }
+
+    template<typename Chain>
+    void flush() {
+        next_.template flush<Chain>();
+    }
+
+    template<typename Chain>
+    void pause_reading() {
+        next_.template pause_reading<Chain>();
+    }
+
+    template<typename Chain>
+    void resume_reading() {
+        next_.template resume_reading<Chain>();
+    }
+
+    size_t pending_output() const { return next_.pending_output(); }
+
+    template<typename Chain>
+    void on_drained() {
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_drained<Chain>();
+    }
+
+    size_t memory_footprint() const {
+        return partial_.capacity() + masked_.capacity() + pending_.capacity() + next_.memory_footprint();
+    }
+
+    template<typename Chain>
+    void on_received(const char* buf, size_t len) {
+        LOG_DEBUG("websocket_layer.on_received len: {}", len);
+        if (status_ == status::handshake) {
+            handshake<Chain>(buf, len);
+            return;
+        }
+        if (status_ != status::closed)
+            frames<Chain>(buf, len);
+    }
+
+    template <typename Chain>
+    decltype(auto) last() {
+        return next_.template last<Chain>();
+    }
+    void* prev_;
+
+    Next& next() { return next_;}
+
+private:
+    template<typename Chain>
+    struct handshake_sink : public http::parser::handler {
+        handshake_sink(websocket_layer& l): l_(l) {}
+        void on_head(http::message& m) override {
+            ok_ = l_.side_ == side_t::server ? l_.template accept<Chain>(m) : l_.accepted(m);
+            if (l_.side_ == side_t::server)
+                l_.parser_.upgrade();
+        }
+        void on_body(const char*, size_t) override {}
+        void on_end() override {}
+        websocket_layer& l_;
+        bool ok_ = false;
+    };
+
+    template<typename Chain>
+    void handshake(const char* buf, size_t len) {
+        // the head may come in pieces
+        std::string input;
+        if (!partial_.empty()) {
+            partial_.append(buf, len);
+            input.swap(partial_);
+            buf = input.data();
+            len = input.size();
+        }
+        handshake_sink<Chain> s(*this);
+        auto n = parser_.parse(buf, len, s);
+        if (parser_.status() == http::parser::state::head) {
+            if (len > http::parser_options{}.max_head) {
+                fail<Chain>(1002, "handshake too large");
+                return;
+            }
+            partial_.assign(buf, len);
+            return;
+        }
+        if (parser_.status() != http::parser::state::upgraded || !s.ok_) {
+            fail<Chain>(1002, parser_.error() ? parser_.error() : "handshake refused");
+            return;
+        }
+
+        status_ = status::open;
+        if (!pending_.empty()) {
+            next_.template write<Chain>(pending_.data(), pending_.size());
+            std::string().swap(pending_);
+        }
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (prior)
+            prior->template on_connected<Chain>();
+        if (n < len && status_ == status::open)
+            frames<Chain>(buf + n, len - n);
+    }
+
+    // Server: answers the upgrade request
+    template<typename Chain>
+    bool accept(const http::message& m) {
+        auto key = m.get("Sec-WebSocket-Key");
+        bool ok = m.method == "GET" && m.upgrade && contains(m.get("Upgrade"), "websocket")
+               && m.get("Sec-WebSocket-Version") == "13" && key.size() == 24;
+        std::string head;
+        if (!ok) {
+            http::write_response_head(head, 400, "Bad Request", {{"Sec-WebSocket-Version", "13"}}, 0);
+            next_.template write<Chain>(head.data(), head.size());
+            return false;
+        }
+        auto requested = m.get("Sec-WebSocket-Protocol");
+        if (!options_.protocol.empty() && contains(requested, options_.protocol))
+            protocol_ = options_.protocol;
+        auto accept = accept_key(key);
+        if (protocol_.empty()) {
+            http::write_response_head(head, 101, "Switching Protocols",
+                {{"Upgrade", "websocket"}, {"Connection", "Upgrade"}, {"Sec-WebSocket-Accept", accept}}, 0);
+        } else {
+            http::write_response_head(head, 101, "Switching Protocols",
+                {{"Upgrade", "websocket"}, {"Connection", "Upgrade"}, {"Sec-WebSocket-Accept", accept},
+                 {"Sec-WebSocket-Protocol", protocol_}}, 0);
+        }
+        next_.template write<Chain>(head.data(), head.size());
+        return true;
+    }
+
+    // Client: checks the server's answer
+    bool accepted(const http::message& m) {
+        if (m.status != 101 || m.get("Sec-WebSocket-Accept") != accept_key(key_))
+            return false;
+        protocol_ = std::string(m.get("Sec-WebSocket-Protocol"));
+        return true;
+    }
+
+    static bool contains(std::string_view list, std::string_view token) {
+        for (size_t i = 0; i + token.size() <= list.size(); i++) {
+            size_t j = 0;
+            while (j < token.size() && std::tolower((unsigned char)list[i + j]) == std::tolower((unsigned char)token[j]))
+                j++;
+            if (j == token.size())
+                return true;
+        }
+        return false;
+    }
+
+    template<typename Chain>
+    void frames(const char* buf, size_t len) {
+        while (len && status_ != status::closed) {
+            if (!in_payload_) {
+                // the header may be split too
+                auto n = std::min(len, header_size() - header_len_);
+                std::memcpy(header_ + header_len_, buf, n);
+                header_len_ += n;
+                buf += n;
+                len -= n;
+                if (header_len_ < header_size())
+                    continue;
+                if (!begin_frame<Chain>())
+                    return;
+                if (!payload_left_)
+                    end_frame<Chain>();
+                continue;
+            }
+            auto n = (size_t)std::min<uint64_t>(len, payload_left_);
+            payload<Chain>(buf, n);
+            buf += n;
+            len -= n;
+            payload_left_ -= n;
+            if (!payload_left_)
+                end_frame<Chain>();
+        }
+    }
+
+    // Bytes of the header so far needed: 2, then the length and mask key
+    size_t header_size() const {
+        if (header_len_ < 2)
+            return 2;
+        size_t size = 2 + ((header_[1] & 0x80) ? 4 : 0);
+        auto len7 = header_[1] & 0x7f;
+        return size + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0);
+    }
+
+    template<typename Chain>
+    bool begin_frame() {
+        header_len_ = 0;
+        bool fin = header_[0] & 0x80;
+        auto op = (opcode)(header_[0] & 0x0f);
+        bool masked = header_[1] & 0x80;
+        uint64_t len = header_[1] & 0x7f;
+        size_t pos = 2;
+        if (len == 126) {
+            len = (uint64_t)header_[2] << 8 | header_[3];
+            pos = 4;
+        } else if (len == 127) {
+            len = 0;
+            for (int i = 0; i < 8; i++)
+                len = len << 8 | header_[2 + i];
+            pos = 10;
+        }
+        if (header_[0] & 0x70)
+            return fail<Chain>(1002, "reserved bits set");
+        // client frames are masked, server ones are not
+        if (masked != (side_ == side_t::server))
+            return fail<Chain>(1002, "invalid masking");
+        if (len >> 63)
+            return fail<Chain>(1002, "invalid length");
+        bool control = (uint8_t)op & 0x08;
+        if (control) {
+            if (!fin || len > 125 || (op != opcode::close && op != opcode::ping && op != opcode::pong))
+                return fail<Chain>(1002, "invalid control frame");
+        } else if (op == opcode::continuation) {
+            if (!in_message_)
+                return fail<Chain>(1002, "unexpected continuation");
+        } else if (op == opcode::text || op == opcode::binary) {
+            if (in_message_)
+                return fail<Chain>(1002, "expected continuation");
+            in_message_ = true;
+            if (on_message_begin_cb_)
+                on_message_begin_cb_(op);
+        } else {
+            return fail<Chain>(1002, "invalid opcode");
+        }
+        if (masked)
+            std::memcpy(key_bytes_.data(), header_ + pos, 4);
+        frame_op_ = op;
+        frame_fin_ = fin;
+        masked_frame_ = masked;
+        phase_ = 0;
+        payload_left_ = len;
+        in_payload_ = true;
+        return true;
+    }
+
+    template<typename Chain>
+    void payload(const char* buf, size_t len) {
+        if ((uint8_t)frame_op_ & 0x08) {
+            auto from = control_.size();
+            control_.append(buf, len);
+            if (masked_frame_)
+                phase_ = mask(control_.data() + from, control_.data() + from, len, key_bytes_, phase_);
+            return;
+        }
+        auto prior = async::get_prev<Chain, it>(prev_);
+        if (!masked_frame_) {
+            if (prior)
+                prior->template on_received<Chain>(buf, len);
+            return;
+        }
+        // unmasked into a bounded scratch buffer, piece by piece
+        constexpr size_t piece = 64 * 1024;
+        while (len) {
+            auto n = std::min(len, piece);
+            if (masked_.size() < n)
+                masked_.resize(std::max(n, std::min(piece, masked_.size() * 2)));
+            phase_ = mask(masked_.data(), buf, n, key_bytes_, phase_);
+            if (prior)
+                prior->template on_received<Chain>(masked_.data(), n);
+            buf += n;
+            len -= n;
+        }
+    }
+
+    template<typename Chain>
+    void end_frame() {
+        in_payload_ = false;
+        switch (frame_op_) {
+        case opcode::ping: {
+            async::const_buffer payload{control_.data(), control_.size()};
+            send_frame<Chain>(opcode::pong, &payload, 1);
+            break;
+        }
+        case opcode::pong:
+            break;
+        case opcode::close:
+            on_close<Chain>();
+            break;
+        default:
+            if (frame_fin_) {
+                in_message_ = false;
+                if (on_message_end_cb_)
+                    on_message_end_cb_();
+            }
+            break;
+        }
+        control_.clear();
+    }
+
+    template<typename Chain>
+    void on_close() {
+        uint16_t code = 1005; // no status
+        std::string_view reason;
+        if (control_.size() >= 2) {
+            code = (uint16_t)((uint8_t)control_[0] << 8 | (uint8_t)control_[1]);
+            reason = std::string_view(control_).substr(2);
+        }
+        if (status_ == status::open) {
+            // echo the code back
+            async::const_buffer payload{control_.data(), std::min<size_t>(control_.size(), 2)};
+            send_frame<Chain>(opcode::close, &payload, 1);
+        }
+        status_ = status::closed;
+        if (on_close_cb_)
+            on_close_cb_(code, reason);
+        // the server closes the connection, the client waits for it
+        if (side_ == side_t::server)
+            disconnect_later<Chain>();
+    }
+
+    template<typename Chain>
+    void send_frame(opcode op, const async::const_buffer* buffers, size_t count) {
+        size_t size = 0;
+        for (size_t i = 0; i < count; i++)
+            size += buffers[i].size;
+        char header[max_frame_header];
+        mask_key key;
+        bool client = side_ == side_t::client;
+        if (client)
+            key = random_mask();
+        auto header_len = write_frame_header(header, op, true, size, client ? &key : nullptr);
+
+        if (status_ == status::handshake) {
+            // sent once the handshake is done
+            pending_.append(header, header_len);
+            auto from = pending_.size();
+            for (size_t i = 0; i < count; i++)
+                pending_.append(buffers[i].data, buffers[i].size);
+            if (client)
+                mask(pending_.data() + from, pending_.data() + from, size, key);
+            return;
+        }
+        if (!client) {
+            // header and payload go down together, the payload is not copied
+            async::writev_prefixed({header, header_len}, buffers, count, [this](const async::const_buffer* v, size_t n) {
+                next_.template writev<Chain>(v, n);
+            });
+            return;
+        }
+        // a client masks a copy of the payload
+        masked_.resize(std::max(masked_.size(), size));
+        size_t phase = 0, pos = 0;
+        for (size_t i = 0; i < count; i++) {
+            phase = mask(masked_.data() + pos, buffers[i].data, buffers[i].size, key, phase);
+            pos += buffers[i].size;
+        }
+        async::const_buffer v[2] = {{header, header_len}, {masked_.data(), size}};
+        next_.template writev<Chain>(v, 2);
+        if (masked_.capacity() > 256 * 1024)
+            std::vector<char>().swap(masked_);
+    }
+
+    template<typename Chain>
+    bool fail(uint16_t code, const char* error) {
+        LOG_ERROR("websocket_layer: {}", error);
+        if (status_ == status::open) {
+            uint8_t payload[2] = {(uint8_t)(code >> 8), (uint8_t)(code & 0xff)};
+            async::const_buffer b{(const char*)payload, 2};
+            send_frame<Chain>(opcode::close, &b, 1);
+        }
+        bool was_open = status_ == status::open || status_ == status::closing;
+        status_ = status::closed;
+        std::string().swap(partial_);
+        if (was_open && on_close_cb_)
+            on_close_cb_(code, error);
+        disconnect_later<Chain>();
+        return false;
+    }
+
+    template<typename Chain>
+    void disconnect_later() {
+        if constexpr (requires { next_.template disconnect<Chain>(); })
+            disconnect_.schedule(io_, [this]() { next_.template disconnect<Chain>(); });
+    }
+
+    side_t side_;
+    next_type next_;
+    websocket::options options_;
+    std::string host_;
+    async::io_context* io_ = nullptr;
+    async::deferred_disconnect disconnect_;
+    status status_ = status::handshake;
+
+    // handshake
+    http::parser parser_;
+    std::string partial_;
+    std::string key_;
+    std::string protocol_;
+    // frames written before the handshake completed
+    std::string pending_;
+
+    // frame being received
+    uint8_t header_[max_frame_header];
+    size_t header_len_ = 0;
+    bool in_payload_ = false;
+    bool in_message_ = false;
+    opcode frame_op_ = opcode::continuation;
+    bool frame_fin_ = false;
+    bool masked_frame_ = false;
+    mask_key key_bytes_{};
+    size_t phase_ = 0;
+    uint64_t payload_left_ = 0;
+    std::string control_;
+    // unmasked payload (server) or masked copy (client)
+    std::vector<char> masked_;
+};
+
+} //namespace acpp::network::websocket
@@ -0,0 +1,49 @@
+#include <detail/cpu.h>
+
+namespace acpp::network::detail {
+
+namespace {
+
+struct cpu_features {
+    bool sse42 = false;
+    bool avx2 = false;
+
+    cpu_features() {
+#if ACPP_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+        int r[4];
+        __cpuid(r, 0);
+        int max_leaf = r[0];
+        __cpuid(r, 1);
+        sse42 = r[2] & (1 << 20);
+        bool osxsave = r[2] & (1 << 27);
+        // AVX state saved by the OS
+        if (max_leaf >= 7 && osxsave && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(r, 7, 0);
+            avx2 = r[1] & (1 << 5);
+        }
+#else
+        __builtin_cpu_init();
+        sse42 = __builtin_cpu_supports("sse4.2");
+        avx2 = __builtin_cpu_supports("avx2");
+#endif
+#endif
+    }
+};
+
+const cpu_features& features() {
+    static const cpu_features f;
+    return f;
+}
+
+} // namespace
+
+bool cpu_has_sse42() {
+    return features().sse42;
+}
+
+bool cpu_has_avx2() {
+    return features().avx2;
+}
+
+} // namespace acpp::network::detail
@@ -0,0 +1,35 @@
+#pragma once
+
+// CPU features for the SIMD kernels (http1.cpp, websocket.cpp). Kernels are
+// compiled with ACPP_TARGET so the library itself needs no -m flags, and
+// are only called after checking the feature at runtime.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ACPP_X86 1
+#include <immintrin.h>
+#include <nmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define ACPP_TARGET(x)
+#else
+#define ACPP_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+namespace acpp::network::detail {
+
+bool cpu_has_sse42();
+bool cpu_has_avx2();
+
+// Index of the lowest set bit, mask != 0
+inline int lowest_bit(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return (int)i;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+} // namespace acpp::network::detail
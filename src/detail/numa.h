@@ -0,0 +1,22 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+
+#include <acpp-network/io_context_pool.h>
+
+// Platform hooks used by io_context_pool. Implemented in <platform>/numa.cpp.
+
+namespace acpp::network::detail {
+
+async::numa_topology detect_numa_topology();
+
+bool pin_current_thread(int cpu);
+
+// Memory resource whose pages are bound to the given node. Falls back to the
+// default heap when the platform has no NUMA support.
+std::unique_ptr<std::pmr::memory_resource> make_node_memory_resource(int node);
+
+bool set_incoming_cpu(int64_t fd, int cpu);
+
+} // namespace acpp::network::detail
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Memory of the objects an io_context walks (linux/socket_base.cpp): a slab
+// of blocks per size class and the handles epoll events carry instead of
+// the handlers' addresses.
+
+namespace acpp::network::detail {
+
+// Generation-checked names for the event handlers of a loop. A handle is the
+// entry's generation and index; releasing it bumps the generation, so an
+// event queued for a handler destroyed since (earlier in the same epoll_wait
+// batch, or whose fd number was taken again) finds a newer generation and is
+// dropped. Entries sit in fixed chunks that never move: get() takes no lock,
+// it reads the generation around the target, so a handle released (and the
+// entry taken again) by another thread meanwhile reads as released. That
+// covers the entry, not the handler: it must still not be destroyed while
+// the loop is running it.
+class handle_table {
+public:
+    using handle = uint64_t;
+
+    handle_table(): chunks_(std::make_unique<std::atomic<entry*>[]>(max_chunks)) {}
+    handle_table(const handle_table&) = delete;
+    handle_table& operator=(const handle_table&) = delete;
+
+    ~handle_table() {
+        for (size_t i = 0; i < chunks_used_; i++)
+            delete[] chunks_[i].load();
+    }
+
+    // never 0: generations start at 1
+    handle acquire(void* target) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_ == none) {
+            if (chunks_used_ == max_chunks)
+                throw std::bad_alloc();
+            auto c = new entry[chunk_entries];
+            auto base = (uint32_t)(chunks_used_ * chunk_entries);
+            for (uint32_t i = 0; i < chunk_entries; i++)
+                c[i].next_free = i + 1 < chunk_entries ? base + i + 1 : none;
+            chunks_[chunks_used_++].store(c, std::memory_order_release);
+            free_ = base;
+        }
+        auto index = free_;
+        auto& e = at(index);
+        free_ = e.next_free;
+        e.target.store(target, std::memory_order_release);
+        return (handle)e.generation.load(std::memory_order_relaxed) << 32 | index;
+    }
+
+    void release(handle h) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto index = (uint32_t)h;
+        auto& e = at(index);
+        auto generation = e.generation.load(std::memory_order_relaxed) + 1;
+        // before the target: a reader that sees the new target sees it too
+        e.generation.store(generation ? generation : 1, std::memory_order_release);
+        e.target.store(nullptr, std::memory_order_release);
+        e.next_free = free_;
+        free_ = index;
+    }
+
+    // nullptr when the handle was released
+    void* get(handle h) const {
+        auto& e = at((uint32_t)h);
+        auto generation = (uint32_t)(h >> 32);
+        if (e.generation.load(std::memory_order_acquire) != generation)
+            return nullptr;
+        auto target = e.target.load(std::memory_order_acquire);
+        return e.generation.load(std::memory_order_acquire) == generation ? target : nullptr;
+    }
+
+private:
+    struct entry {
+        std::atomic<void*> target = nullptr;
+        std::atomic<uint32_t> generation = 1;
+        // under the mutex only
+        uint32_t next_free = none;
+    };
+    static constexpr uint32_t none = ~0u;
+    static constexpr size_t chunk_entries = 1024;
+    static constexpr size_t max_chunks = 4096;
+
+    entry& at(uint32_t index) const {
+        return chunks_[index / chunk_entries].load(std::memory_order_acquire)[index % chunk_entries];
+    }
+
+    std::mutex mutex_;
+    std::unique_ptr<std::atomic<entry*>[]> chunks_;
+    size_t chunks_used_ = 0;
+    uint32_t free_ = none;
+};
+
+// Fixed-size blocks carved from chunks of a memory resource, one free list
+// per size class. The loop's sockets, timers and relays are few sizes, so
+// they end up next to each other instead of scattered in the heap, and a
+// freed block is the next one handed out. Blocks are cache-line multiples.
+// The loop owns the pool, but its objects may outlive it: release() leaves
+// the pool to its last block.
+class slab_pool {
+public:
+    static constexpr size_t alignment = 64;
+    static constexpr size_t chunk_bytes = 64 * 1024;
+
+    slab_pool() = default;
+    slab_pool(const slab_pool&) = delete;
+    slab_pool& operator=(const slab_pool&) = delete;
+
+    ~slab_pool() {
+        for (auto& c: chunks_)
+            c.mr->deallocate(c.data, c.size, alignment);
+    }
+
+    // new chunks come from mr: the loop's resource when they are needed
+    void* allocate(size_t size, std::pmr::memory_resource* mr) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& c = size_class_of(size);
+        if (!c.free)
+            grow(c, mr);
+        auto block = c.free;
+        c.free = block->next;
+        live_++;
+        return block;
+    }
+
+    void deallocate(void* p, size_t size) {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& c = size_class_of(size);
+            auto block = static_cast<free_block*>(p);
+            block->next = c.free;
+            c.free = block;
+            last = --live_ == 0 && orphaned_;
+        }
+        if (last)
+            delete this;
+    }
+
+    // The owner is gone
+    void release() {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last = live_ == 0;
+            orphaned_ = !last;
+        }
+        if (last)
+            delete this;
+    }
+
+    struct releaser {
+        void operator()(slab_pool* p) const { p->release(); }
+    };
+
+    // blocks handed out, and chunks taken from the memory resources
+    size_t live() const { return live_; }
+    size_t chunks() const { return chunks_.size(); }
+
+    handle_table handles;
+
+private:
+    struct free_block {
+        free_block* next;
+    };
+    struct size_class {
+        size_t size;
+        free_block* free = nullptr;
+    };
+    struct chunk {
+        void* data;
+        size_t size;
+        std::pmr::memory_resource* mr;
+    };
+
+    size_class& size_class_of(size_t size) {
+        size = (size + alignment - 1) & ~(alignment - 1);
+        for (auto& c: classes_)
+            if (c.size == size)
+                return c;
+        return classes_.emplace_back(size_class{size});
+    }
+
+    // threaded backwards: blocks go out in address order
+    void grow(size_class& c, std::pmr::memory_resource* mr) {
+        auto n = std::max<size_t>(chunk_bytes / c.size, 8);
+        auto data = static_cast<char*>(mr->allocate(n * c.size, alignment));
+        chunks_.push_back({data, n * c.size, mr});
+        for (size_t i = n; i-- > 0;) {
+            auto block = reinterpret_cast<free_block*>(data + i * c.size);
+            block->next = c.free;
+            c.free = block;
+        }
+    }
+
+    std::mutex mutex_;
+    std::vector<size_class> classes_;
+    std::vector<chunk> chunks_;
+    size_t live_ = 0;
+    bool orphaned_ = false;
+};
+
+} // namespace acpp::network::detail
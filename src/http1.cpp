@@ -0,0 +1,555 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+
+#include <acpp-network/http1.h>
+#include <detail/common.h>
+#include <detail/cpu.h>
+
+namespace acpp::network::http {
+
+namespace {
+
+// Bytes that stop a scan, as up to 8 inclusive ranges (the pcmpestri
+// operand) and as a table for the scalar kernel.
+struct charset {
+    alignas(16) char ranges[16] = {};
+    int size = 0;
+    bool stop[256] = {};
+
+    constexpr charset(std::initializer_list<std::pair<uint8_t, uint8_t>> r) {
+        for (auto [lo, hi]: r) {
+            ranges[size++] = (char)lo;
+            ranges[size++] = (char)hi;
+            for (int c = lo; c <= hi; c++)
+                stop[c] = true;
+        }
+    }
+};
+
+// Not tchar (RFC 9110 5.6.2), except '|' and '~' that the last range takes in
+constexpr charset token_stop{{0x00, 0x20}, {'"', '"'}, {'(', ')'}, {',', ','}, {'/', '/'},
+                             {':', '@'}, {'[', ']'}, {'{', 0xff}};
+// Controls and space end a request target
+constexpr charset target_stop{{0x00, 0x20}, {0x7f, 0x7f}};
+// Controls but tab end a field value or reason phrase
+constexpr charset value_stop{{0x00, 0x08}, {0x0a, 0x1f}, {0x7f, 0x7f}};
+
+template<const charset& cs>
+const char* find_scalar(const char* p, const char* end) {
+    while (p < end && !cs.stop[(uint8_t)*p])
+        p++;
+    return p;
+}
+
+#if ACPP_X86
+
+template<const charset& cs>
+ACPP_TARGET("sse4.2")
+const char* find_sse42(const char* p, const char* end) {
+    auto ranges = _mm_load_si128((const __m128i*)cs.ranges);
+    while (end - p >= 16) {
+        auto b = _mm_loadu_si128((const __m128i*)p);
+        int i = _mm_cmpestri(ranges, cs.size, b, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (i != 16)
+            return p + i;
+        p += 16;
+    }
+    return find_scalar<cs>(p, end);
+}
+
+// b in [lo, hi] is (b - lo) <= (hi - lo), unsigned. The ranges are known at
+// compile time, so the loop over them unrolls into constants.
+template<const charset& cs>
+ACPP_TARGET("avx2")
+const char* find_avx2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        auto b = _mm256_loadu_si256((const __m256i*)p);
+        auto hit = _mm256_setzero_si256();
+        for (int i = 0; i < cs.size / 2; i++) {
+            auto lo = (uint8_t)cs.ranges[2 * i];
+            auto span = (uint8_t)((uint8_t)cs.ranges[2 * i + 1] - lo);
+            auto d = _mm256_sub_epi8(b, _mm256_set1_epi8((char)lo));
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char)span)), d));
+        }
+        auto mask = (uint32_t)_mm256_movemask_epi8(hit);
+        if (mask) {
+            // back to legacy SSE code without the transition penalty
+            _mm256_zeroupper();
+            return p + detail::lowest_bit(mask);
+        }
+        p += 32;
+    }
+    _mm256_zeroupper();
+    return find_sse42<cs>(p, end);
+}
+
+#endif
+
+simd detect() {
+    return detail::cpu_has_avx2() ? simd::avx2 : detail::cpu_has_sse42() ? simd::sse42 : simd::scalar;
+}
+
+using find_fn = const char* (*)(const char*, const char*);
+
+// One scan per charset
+struct kernels {
+    find_fn token;
+    find_fn target;
+    find_fn value;
+};
+
+kernels kernels_for(simd level) {
+#if ACPP_X86
+    switch (level) {
+    case simd::avx2:  return {find_avx2<token_stop>, find_avx2<target_stop>, find_avx2<value_stop>};
+    case simd::sse42: return {find_sse42<token_stop>, find_sse42<target_stop>, find_sse42<value_stop>};
+    default:          break;
+    }
+#endif
+    return {find_scalar<token_stop>, find_scalar<target_stop>, find_scalar<value_stop>};
+}
+
+// Header fields are mostly shorter than a 32 byte AVX2 block: SSE 4.2 scans
+// them as fast or faster (see Http1Tests.parse_benchmark), so it is the default.
+const simd cpu_level = detect();
+simd current_level = std::min(cpu_level, simd::sse42);
+kernels scan = kernels_for(current_level);
+
+const char* find_token_end(const char* p, const char* end) {
+    while (true) {
+        p = scan.token(p, end);
+        if (p == end || (*p != '|' && *p != '~'))
+            return p;
+        p++;
+    }
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i]))
+            return false;
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        s.remove_suffix(1);
+    return s;
+}
+
+// Calls f for each element of a comma separated list
+template<typename F>
+void for_each_token(std::string_view list, F f) {
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        f(trim(list.substr(0, comma)));
+        if (comma == std::string_view::npos)
+            break;
+        list.remove_prefix(comma + 1);
+    }
+}
+
+} // namespace
+
+simd scan_level() {
+    return current_level;
+}
+
+simd scan_level(simd level) {
+    current_level = std::min(level, cpu_level);
+    scan = kernels_for(current_level);
+    return current_level;
+}
+
+std::string_view message::get(std::string_view name) const {
+    for (auto& h: headers) {
+        if (iequals(h.name, name))
+            return h.value;
+    }
+    return {};
+}
+
+parser::parser(side_t side, parser_options options)
+: side_(side), options_(options) {}
+
+void parser::sent_request(std::string_view method) {
+    head_requests_.push_back(method == "HEAD");
+}
+
+void parser::upgrade() {
+    upgrade_ = true;
+    if (state_ == state::head)
+        state_ = state::upgraded;
+}
+
+size_t parser::fail(const char* error) {
+    error_ = error;
+    state_ = state::error;
+    return 0;
+}
+
+void parser::end_message(handler& h) {
+    state_ = upgrade_ ? state::upgraded : state::head;
+    h.on_end();
+}
+
+bool parser::close(handler& h) {
+    if (state_ == state::until_close) {
+        end_message(h);
+        return true;
+    }
+    return state_ == state::head || state_ == state::upgraded;
+}
+
+size_t parser::parse(const char* buf, size_t len, handler& h) {
+    size_t pos = 0;
+    while (pos < len) {
+        switch (state_) {
+        case state::head: {
+            auto n = parse_head(buf + pos, len - pos, h);
+            if (!n)
+                return pos;
+            pos += n;
+            break;
+        }
+        case state::body:
+        case state::chunk_data: {
+            auto n = (size_t)std::min<uint64_t>(remaining_, len - pos);
+            h.on_body(buf + pos, n);
+            pos += n;
+            remaining_ -= n;
+            if (!remaining_) {
+                if (state_ == state::body)
+                    end_message(h);
+                else
+                    state_ = state::chunk_end;
+            }
+            break;
+        }
+        case state::until_close:
+            h.on_body(buf + pos, len - pos);
+            pos = len;
+            break;
+        case state::chunk_size: {
+            bool complete;
+            pos += take_line(buf + pos, len - pos, complete);
+            if (!complete)
+                break;
+            uint64_t size = 0;
+            size_t digits = 0;
+            for (; digits < line_.size() && std::isxdigit((unsigned char)line_[digits]); digits++) {
+                if (digits == 15)
+                    return fail("chunk size too large");
+                auto c = std::tolower((unsigned char)line_[digits]);
+                size = size * 16 + (c <= '9' ? c - '0' : c - 'a' + 10);
+            }
+            // chunk extensions are ignored
+            if (!digits || (digits < line_.size() && line_[digits] != ';' && line_[digits] != ' ' && line_[digits] != '\t'))
+                return fail("invalid chunk size");
+            line_.clear();
+            remaining_ = size;
+            state_ = size ? state::chunk_data : state::trailers;
+            break;
+        }
+        case state::chunk_end: {
+            bool complete;
+            pos += take_line(buf + pos, len - pos, complete);
+            if (!complete)
+                break;
+            if (!line_.empty())
+                return fail("invalid chunk end");
+            state_ = state::chunk_size;
+            break;
+        }
+        case state::trailers: {
+            bool complete;
+            pos += take_line(buf + pos, len - pos, complete);
+            if (!complete)
+                break;
+            // trailer fields are dropped
+            if (line_.empty())
+                end_message(h);
+            line_.clear();
+            break;
+        }
+        case state::upgraded:
+        case state::error:
+            return pos;
+        }
+        if (state_ == state::error)
+            return pos;
+    }
+    return pos;
+}
+
+// Adds to line_ up to a LF. The line ends up without its CRLF.
+size_t parser::take_line(const char* buf, size_t len, bool& complete) {
+    auto lf = (const char*)std::memchr(buf, '\n', len);
+    auto n = lf ? lf - buf : len;
+    if (line_.size() + n > 4096) {
+        complete = false;
+        fail("line too long");
+        return len;
+    }
+    line_.append(buf, n);
+    complete = lf != nullptr;
+    if (complete && !line_.empty() && line_.back() == '\r')
+        line_.pop_back();
+    return lf ? n + 1 : n;
+}
+
+// nullptr when more bytes are needed, end on error
+const char* parser::parse_request_line(const char* p, const char* end) {
+    auto method_end = find_token_end(p, end);
+    if (method_end == end)
+        return nullptr;
+    if (method_end == p || *method_end != ' ') {
+        fail("invalid method");
+        return end;
+    }
+    message_.method = std::string_view(p, method_end - p);
+    p = method_end + 1;
+    auto target_end = scan.target(p, end);
+    if (target_end == end)
+        return nullptr;
+    if (target_end == p || *target_end != ' ') {
+        fail("invalid request target");
+        return end;
+    }
+    message_.target = std::string_view(p, target_end - p);
+    p = target_end + 1;
+    if (end - p < 9)
+        return nullptr;
+    if (std::memcmp(p, "HTTP/1.", 7) != 0 || (p[7] != '0' && p[7] != '1')) {
+        fail("invalid version");
+        return end;
+    }
+    message_.version = 10 + (p[7] - '0');
+    p += 8;
+    if (*p == '\r')
+        p++;
+    if (p == end)
+        return nullptr;
+    if (*p != '\n') {
+        fail("invalid request line");
+        return end;
+    }
+    return p + 1;
+}
+
+const char* parser::parse_status_line(const char* p, const char* end) {
+    if (end - p < 13)
+        return nullptr;
+    if (std::memcmp(p, "HTTP/1.", 7) != 0 || (p[7] != '0' && p[7] != '1') || p[8] != ' '
+        || !std::isdigit((unsigned char)p[9]) || !std::isdigit((unsigned char)p[10]) || !std::isdigit((unsigned char)p[11])) {
+        fail("invalid status line");
+        return end;
+    }
+    message_.version = 10 + (p[7] - '0');
+    message_.status = (p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0');
+    p += 12;
+    if (*p == ' ')
+        p++;
+    auto reason_end = scan.value(p, end);
+    if (reason_end == end)
+        return nullptr;
+    message_.reason = std::string_view(p, reason_end - p);
+    p = reason_end;
+    if (*p == '\r')
+        p++;
+    if (p == end)
+        return nullptr;
+    if (*p != '\n') {
+        fail("invalid status line");
+        return end;
+    }
+    return p + 1;
+}
+
+size_t parser::parse_head(const char* buf, size_t len, handler& h) {
+    const char* p = buf;
+    const char* end = buf + len;
+    // empty lines before a request are ignored (RFC 9112 2.2)
+    while (p < end && (*p == '\r' || *p == '\n'))
+        p++;
+
+    message_.method = message_.target = message_.reason = {};
+    message_.status = 0;
+    message_.headers.clear();
+    auto incomplete = [&]() {
+        return len > options_.max_head ? fail("head too large") : 0;
+    };
+
+    p = side_ == side_t::server ? parse_request_line(p, end) : parse_status_line(p, end);
+    if (!p)
+        return incomplete();
+    if (state_ == state::error)
+        return 0;
+
+    while (true) {
+        if (p == end)
+            return incomplete();
+        if (*p == '\r' || *p == '\n') {
+            if (*p == '\r') {
+                if (p + 1 == end)
+                    return incomplete();
+                if (p[1] != '\n')
+                    return fail("invalid header");
+                p++;
+            }
+            p++;
+            break;
+        }
+        auto name_end = find_token_end(p, end);
+        if (name_end == end)
+            return incomplete();
+        if (name_end == p || *name_end != ':')
+            return fail("invalid header name");
+        auto v = name_end + 1;
+        auto v_end = scan.value(v, end);
+        if (v_end == end)
+            return incomplete();
+        auto next = v_end;
+        if (*next == '\r') {
+            if (++next == end)
+                return incomplete();
+        }
+        if (*next != '\n')
+            return fail("invalid header value");
+        if (message_.headers.size() == options_.max_headers)
+            return fail("too many headers");
+        message_.headers.push_back({std::string_view(p, name_end - p), trim(std::string_view(v, v_end - v))});
+        p = next + 1;
+    }
+    if ((size_t)(p - buf) > options_.max_head)
+        return fail("head too large");
+    if (!interpret())
+        return 0;
+
+    size_t used = p - buf;
+    bool body = true;
+    if (side_ == side_t::client) {
+        auto status = message_.status;
+        if (status >= 100 && status < 200 && status != 101) {
+            // interim response, the final one follows
+            h.on_head(message_);
+            return used;
+        }
+        bool head_request = false;
+        if (!head_requests_.empty()) {
+            head_request = head_requests_.front();
+            head_requests_.pop_front();
+        }
+        if (status == 101)
+            upgrade_ = true;
+        body = !head_request && status != 101 && status != 204 && status != 304;
+    }
+    h.on_head(message_);
+
+    if (state_ == state::error)
+        return used;
+    if (!body) {
+        end_message(h);
+    } else if (message_.chunked) {
+        state_ = state::chunk_size;
+    } else if (message_.content_length > 0) {
+        remaining_ = message_.content_length;
+        state_ = state::body;
+    } else if (message_.content_length == 0 || message_.request()) {
+        end_message(h);
+    } else {
+        message_.keep_alive = false;
+        state_ = state::until_close;
+    }
+    return used;
+}
+
+// Framing and connection headers
+bool parser::interpret() {
+    message_.content_length = -1;
+    message_.chunked = false;
+    message_.keep_alive = message_.version == 11;
+    message_.upgrade = false;
+    bool transfer_encoding = false;
+    for (auto& h: message_.headers) {
+        if (iequals(h.name, "content-length")) {
+            if (h.value.empty() || h.value.size() > 18
+                || !std::all_of(h.value.begin(), h.value.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                fail("invalid content-length");
+                return false;
+            }
+            int64_t n = 0;
+            for (auto c: h.value)
+                n = n * 10 + (c - '0');
+            if (message_.content_length >= 0 && message_.content_length != n) {
+                fail("conflicting content-length");
+                return false;
+            }
+            message_.content_length = n;
+        } else if (iequals(h.name, "transfer-encoding")) {
+            transfer_encoding = true;
+            message_.chunked = false;
+            for_each_token(h.value, [&](std::string_view coding) {
+                message_.chunked = iequals(coding, "chunked");
+            });
+        } else if (iequals(h.name, "connection")) {
+            for_each_token(h.value, [&](std::string_view option) {
+                if (iequals(option, "close"))
+                    message_.keep_alive = false;
+                else if (iequals(option, "keep-alive"))
+                    message_.keep_alive = true;
+                else if (iequals(option, "upgrade"))
+                    message_.upgrade = true;
+            });
+        }
+    }
+    if (transfer_encoding) {
+        // RFC 9112 6.1: a request with both, or not ending in chunked, is an attack or an error
+        if (message_.request() && (message_.content_length >= 0 || !message_.chunked)) {
+            fail("invalid transfer-encoding");
+            return false;
+        }
+        message_.content_length = -1;
+    }
+    return true;
+}
+
+static void append_headers(std::string& out, std::initializer_list<header> headers, int64_t content_length, bool omit_zero) {
+    for (auto& h: headers) {
+        out.append(h.name).append(": ").append(h.value).append("\r\n");
+    }
+    if (content_length < 0)
+        out.append("Transfer-Encoding: chunked\r\n");
+    else if (content_length > 0 || !omit_zero)
+        out.append("Content-Length: ").append(std::to_string(content_length)).append("\r\n");
+    out.append("\r\n");
+}
+
+void write_request_head(std::string& out, std::string_view method, std::string_view target,
+                        std::initializer_list<header> headers, int64_t content_length) {
+    out.append(method).append(" ").append(target).append(" HTTP/1.1\r\n");
+    append_headers(out, headers, content_length, true);
+}
+
+void write_response_head(std::string& out, int status, std::string_view reason,
+                         std::initializer_list<header> headers, int64_t content_length) {
+    out.append("HTTP/1.1 ").append(std::to_string(status)).append(" ").append(reason).append("\r\n");
+    bool no_body = !response_has_body(status);
+    append_headers(out, headers, no_body ? 0 : content_length, no_body);
+}
+
+} // namespace acpp::network::http
@@ -0,0 +1,119 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <algorithm>
+
+#include <acpp-network/io_context_pool.h>
+#include <detail/numa.h>
+#include <detail/common.h>
+
+namespace acpp::network::async {
+
+int numa_topology::node_of_cpu(int cpu) const {
+    for (auto& n: nodes) {
+        if (std::find(n.cpus.begin(), n.cpus.end(), cpu) != n.cpus.end())
+            return n.id;
+    }
+    return nodes.empty() ? -1 : nodes.front().id;
+}
+
+size_t numa_topology::cpu_count() const {
+    size_t result = 0;
+    for (auto& n: nodes)
+        result += n.cpus.size();
+    return result;
+}
+
+const numa_topology& numa_topology::detect() {
+    static const numa_topology topology = detail::detect_numa_topology();
+    return topology;
+}
+
+// cpus interleaved by node (n0c0, n1c0, n0c1, ...) so consecutive loops land
+// on different sockets.
+static std::vector<int> interleaved_cpus(const numa_topology& t) {
+    std::vector<int> result;
+    for (size_t i = 0; result.size() < t.cpu_count(); i++) {
+        for (auto& n: t.nodes) {
+            if (i < n.cpus.size())
+                result.push_back(n.cpus[i]);
+        }
+    }
+    return result;
+}
+
+io_context_pool::io_context_pool(io_context_pool_config config)
+: config_(std::move(config)), topology_(&numa_topology::detect())
+{
+    auto placements = config_.placements;
+    if (placements.empty()) {
+        auto cpus = interleaved_cpus(*topology_);
+        size_t n = config_.size ? config_.size : std::max<size_t>(cpus.size(), 1);
+        for (size_t i = 0; i < n; i++) {
+            loop_placement p;
+            if (!cpus.empty())
+                p.cpu = cpus[i % cpus.size()];
+            placements.push_back(p);
+        }
+    }
+
+    for (auto& p: placements) {
+        auto l = std::make_unique<loop>();
+        l->placement = p;
+        if (l->placement.numa_node < 0 && l->placement.cpu >= 0)
+            l->placement.numa_node = topology_->node_of_cpu(l->placement.cpu);
+        if (config_.numa_memory && l->placement.numa_node >= 0)
+            l->memory = detail::make_node_memory_resource(l->placement.numa_node);
+        l->io.placement(l->placement.cpu, l->placement.numa_node, l->memory.get());
+        loops_.push_back(std::move(l));
+    }
+}
+
+io_context_pool::~io_context_pool() {
+    stop();
+}
+
+void io_context_pool::start() {
+    if (started_)
+        return;
+    started_ = true;
+    for (auto& l: loops_) {
+        l->thread = std::thread([this, &l = *l]() {
+            if (config_.pin_threads && l.placement.cpu >= 0) {
+                if (!detail::pin_current_thread(l.placement.cpu))
+                    LOG_ERROR("io_context_pool: unable to pin loop to cpu {}", l.placement.cpu);
+            }
+            l.io.wait_for_input();
+        });
+    }
+}
+
+void io_context_pool::stop() {
+    if (!started_)
+        return;
+    for (auto& l: loops_) {
+        auto& io = l->io;
+        io.exec([&io]() { io.stop(); });
+    }
+    for (auto& l: loops_) {
+        if (l->thread.joinable())
+            l->thread.join();
+    }
+    started_ = false;
+}
+
+io_context& io_context_pool::next() {
+    return at(next_++ % loops_.size());
+}
+
+bool io_context_pool::steer_listener(async_socket_base& listener, size_t i) {
+    auto cpu = loops_[i]->placement.cpu;
+    if (!config_.incoming_cpu || cpu < 0)
+        return false;
+    return detail::set_incoming_cpu(listener.fd(), cpu);
+}
+
+} // namespace acpp::network::async
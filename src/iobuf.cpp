@@ -0,0 +1,341 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <acpp-network/iobuf.h>
+
+namespace acpp::network::async {
+
+namespace {
+
+iobuf_block* new_block(size_t capacity) {
+    auto block = static_cast<iobuf_block*>(::operator new(sizeof(iobuf_block) + capacity));
+    new (block) iobuf_block{{1}, (uint32_t)capacity, reinterpret_cast<char*>(block + 1)};
+    return block;
+}
+
+void delete_block(iobuf_block* block) {
+    block->~iobuf_block();
+    ::operator delete(block);
+}
+
+
+struct wrapped_block: iobuf_block {
+    std::function<void()> on_released;
+};
+
+}
+
+iobuf_pool& iobuf_pool::local() {
+    thread_local iobuf_pool pool;
+    return pool;
+}
+
+iobuf_pool::~iobuf_pool() {
+    for (auto block: small_)
+        delete_block(block);
+    for (auto block: large_)
+        delete_block(block);
+}
+
+iobuf_block* iobuf_pool::take(size_t size) {
+    auto& list = size <= small_block ? small_ : large_;
+    if (list.empty())
+        return new_block(size <= small_block ? small_block : large_block);
+    auto block = list.back();
+    list.pop_back();
+    block->refs.store(1, std::memory_order_relaxed);
+    return block;
+}
+
+void iobuf_pool::give(iobuf_block* block) {
+    auto& list = block->capacity == small_block ? small_ : large_;
+    if (list.size() < max_blocks)
+        list.push_back(block);
+    else
+        delete_block(block);
+}
+
+// Room around the slices of a pool block only this slice holds is free
+bool iobuf::writable(iobuf_block* block) {
+    return !block->destroy && block->refs.load(std::memory_order_acquire) == 1;
+}
+
+void iobuf::retain(iobuf_block* block) {
+    block->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void iobuf::release(iobuf_block* block) {
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    if (block->destroy)
+        block->destroy(block);
+    else
+        iobuf_pool::local().give(block);
+}
+
+iobuf::iobuf(const iobuf& other)
+: size_(other.size_) {
+    slices_.assign(other.slices_.begin() + other.head_, other.slices_.end());
+    for (auto& s: slices_)
+        retain(s.block);
+}
+
+iobuf::iobuf(iobuf&& other) noexcept
+: slices_(std::move(other.slices_)), head_(other.head_), size_(other.size_) {
+    other.slices_.clear();
+    other.head_ = 0;
+    other.size_ = 0;
+}
+
+iobuf& iobuf::operator=(const iobuf& other) {
+    if (this != &other) {
+        iobuf copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+iobuf& iobuf::operator=(iobuf&& other) noexcept {
+    if (this != &other) {
+        clear();
+        slices_ = std::move(other.slices_);
+        head_ = other.head_;
+        size_ = other.size_;
+        other.slices_.clear();
+        other.head_ = 0;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+iobuf::~iobuf() {
+    clear();
+}
+
+iobuf iobuf::copy(const char* buf, size_t len, size_t headroom) {
+    iobuf result;
+    if (headroom) {
+        auto block = iobuf_pool::local().take(headroom + len);
+        auto room = std::min<size_t>(headroom, block->capacity);
+        auto n = std::min<size_t>(len, block->capacity - room);
+        memcpy(block->data() + room, buf, n);
+        result.slices_.push_back({block, (uint32_t)room, (uint32_t)n});
+        result.size_ = n;
+        buf += n;
+        len -= n;
+    }
+    result.append(buf, len);
+    return result;
+}
+
+iobuf iobuf::wrap(const char* buf, size_t len, std::function<void()>&& on_released) {
+    if (len > UINT32_MAX)
+        throw std::length_error("iobuf::wrap: more than 4 GB");
+    auto block = new wrapped_block;
+    block->refs.store(1, std::memory_order_relaxed);
+    // no room before or after the bytes: nothing is ever written into them
+    block->capacity = (uint32_t)len;
+    block->base = const_cast<char*>(buf);
+    block->on_released = std::move(on_released);
+    block->destroy = [](iobuf_block* b) {
+        auto w = static_cast<wrapped_block*>(b);
+        auto on_released = std::move(w->on_released);
+        delete w;
+        if (on_released)
+            on_released();
+    };
+    iobuf result;
+    if (len) {
+        result.slices_.push_back({block, 0, (uint32_t)len});
+        result.size_ = len;
+    } else {
+        release(block);
+    }
+    return result;
+}
+
+const_buffer iobuf::piece(size_t i) const {
+    auto& s = slices_[head_ + i];
+    return {s.block->data() + s.begin, s.size};
+}
+
+size_t iobuf::fill(const_buffer* out, size_t max_count) const {
+    auto count = std::min(max_count, pieces());
+    for (size_t i = 0; i < count; i++)
+        out[i] = piece(i);
+    return count;
+}
+
+void iobuf::append(const char* buf, size_t len) {
+    size_ += len;
+    if (len && pieces()) {
+        auto& tail = slices_.back();
+        if (writable(tail.block)) {
+            auto n = std::min<size_t>(len, tail.block->capacity - tail.begin - tail.size);
+            memcpy(tail.block->data() + tail.begin + tail.size, buf, n);
+            tail.size += (uint32_t)n;
+            buf += n;
+            len -= n;
+        }
+    }
+    while (len) {
+        // small blocks for small buffers, large ones once the chain has grown
+        auto block = iobuf_pool::local().take(std::max(len, size_));
+        auto n = std::min<size_t>(len, block->capacity);
+        memcpy(block->data(), buf, n);
+        slices_.push_back({block, 0, (uint32_t)n});
+        buf += n;
+        len -= n;
+    }
+}
+
+void iobuf::append(const iobuf& other) {
+    for (auto i = other.head_; i < other.slices_.size(); i++) {
+        retain(other.slices_[i].block);
+        slices_.push_back(other.slices_[i]);
+    }
+    size_ += other.size_;
+}
+
+void iobuf::append(iobuf&& other) {
+    if (empty()) {
+        *this = std::move(other);
+        return;
+    }
+    slices_.insert(slices_.end(), other.slices_.begin() + other.head_, other.slices_.end());
+    size_ += other.size_;
+    other.slices_.clear();
+    other.head_ = 0;
+    other.size_ = 0;
+}
+
+void iobuf::prepend(const char* buf, size_t len) {
+    size_ += len;
+    if (len && pieces()) {
+        auto& first = slices_[head_];
+        if (writable(first.block)) {
+            auto n = std::min<size_t>(len, first.begin);
+            first.begin -= (uint32_t)n;
+            first.size += (uint32_t)n;
+            memcpy(first.block->data() + first.begin, buf + len - n, n);
+            len -= n;
+        }
+    }
+    // new blocks are filled from their end, to leave room for the next header
+    while (len) {
+        auto block = iobuf_pool::local().take(len);
+        auto n = std::min<size_t>(len, block->capacity);
+        auto begin = block->capacity - n;
+        memcpy(block->data() + begin, buf + len - n, n);
+        push_front({block, (uint32_t)begin, (uint32_t)n});
+        len -= n;
+    }
+}
+
+void iobuf::push_front(const slice& s) {
+    if (head_)
+        slices_[--head_] = s;
+    else
+        slices_.insert(slices_.begin(), s);
+}
+
+iobuf iobuf::split(size_t n) {
+    n = std::min(n, size_);
+    iobuf result;
+    result.size_ = n;
+    while (n) {
+        auto& s = slices_[head_];
+        if (n < s.size) {
+            // the slice is cut in two, both hold the block
+            retain(s.block);
+            result.slices_.push_back({s.block, s.begin, (uint32_t)n});
+            s.begin += (uint32_t)n;
+            s.size -= (uint32_t)n;
+            size_ -= n;
+            return result;
+        }
+        result.slices_.push_back(s);
+        n -= s.size;
+        size_ -= s.size;
+        head_++;
+    }
+    drop_spent();
+    return result;
+}
+
+void iobuf::consume(size_t n) {
+    n = std::min(n, size_);
+    size_ -= n;
+    while (n) {
+        auto& s = slices_[head_];
+        if (n < s.size) {
+            s.begin += (uint32_t)n;
+            s.size -= (uint32_t)n;
+            return;
+        }
+        n -= s.size;
+        release(s.block);
+        head_++;
+    }
+    drop_spent();
+}
+
+void iobuf::drop_spent() {
+    if (!size_) {
+        clear();
+        return;
+    }
+    // the spent slots go once they are the larger half
+    if (head_ >= 8 && head_ * 2 >= slices_.size()) {
+        slices_.erase(slices_.begin(), slices_.begin() + head_);
+        head_ = 0;
+    }
+}
+
+void iobuf::clear() {
+    for (auto i = head_; i < slices_.size(); i++)
+        release(slices_[i].block);
+    slices_.clear();
+    head_ = 0;
+    size_ = 0;
+}
+
+void iobuf::shrink_to_fit() {
+    slices_.erase(slices_.begin(), slices_.begin() + head_);
+    head_ = 0;
+    slices_.shrink_to_fit();
+}
+
+void iobuf::copy_to(char* out) const {
+    for (auto i = head_; i < slices_.size(); i++) {
+        memcpy(out, slices_[i].block->data() + slices_[i].begin, slices_[i].size);
+        out += slices_[i].size;
+    }
+}
+
+std::string iobuf::to_string() const {
+    std::string result(size_, '\0');
+    copy_to(result.data());
+    return result;
+}
+
+size_t iobuf::memory_footprint() const {
+    size_t size = slices_.capacity() * sizeof(slice);
+    iobuf_block* last = nullptr;
+    for (auto i = head_; i < slices_.size(); i++) {
+        if (slices_[i].block != last)
+            size += slices_[i].block->capacity;
+        last = slices_[i].block;
+    }
+    return size;
+}
+
+} // namespace acpp::network::async
@@ -0,0 +1,110 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+
+#include <acpp-network/ssl/ssl.h>
+#include <detail/common.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+namespace acpp::network::ssl::ktls {
+
+static void put_seq(unsigned char* rec_seq, uint64_t seq) {
+    for (int i = 7; i >= 0; i--, seq >>= 8)
+        rec_seq[i] = (unsigned char)seq;
+}
+
+// TLS 1.3 AES-GCM: the 12 byte iv splits into a 4 byte salt and an 8 byte iv.
+template<typename Info>
+static Info gcm_info(const traffic_keys& keys, unsigned short cipher) {
+    Info info;
+    memset(&info, 0, sizeof(info));
+    info.info.version = TLS_1_3_VERSION;
+    info.info.cipher_type = cipher;
+    memcpy(info.salt, keys.iv.data(), sizeof(info.salt));
+    memcpy(info.iv, keys.iv.data() + sizeof(info.salt), sizeof(info.iv));
+    memcpy(info.key, keys.key.data(), sizeof(info.key));
+    put_seq(info.rec_seq, keys.seq);
+    return info;
+}
+
+bool enable_tx(int64_t fd, const traffic_keys& keys) {
+    if (::setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+        LOG_DEBUG("ktls::enable_tx: TCP_ULP tls not available: {}", strerror(errno));
+        return false;
+    }
+    int e = -1;
+    switch (keys.cipher) {
+    case traffic_keys::cipher_t::aes_128_gcm: {
+        auto info = gcm_info<tls12_crypto_info_aes_gcm_128>(keys, TLS_CIPHER_AES_GCM_128);
+        e = ::setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+        break;
+    }
+    case traffic_keys::cipher_t::aes_256_gcm: {
+        auto info = gcm_info<tls12_crypto_info_aes_gcm_256>(keys, TLS_CIPHER_AES_GCM_256);
+        e = ::setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+        break;
+    }
+    case traffic_keys::cipher_t::chacha20_poly1305: {
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        tls12_crypto_info_chacha20_poly1305 info;
+        memset(&info, 0, sizeof(info));
+        info.info.version = TLS_1_3_VERSION;
+        info.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+        memcpy(info.iv, keys.iv.data(), sizeof(info.iv));
+        memcpy(info.key, keys.key.data(), sizeof(info.key));
+        put_seq(info.rec_seq, keys.seq);
+        e = ::setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+#endif
+        break;
+    }
+    }
+    if (e != 0) {
+        // The ULP stays attached but without TX state the socket still sends
+        // plain bytes, so OpenSSL keeps doing the record layer.
+        LOG_DEBUG("ktls::enable_tx: TLS_TX rejected: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool send_close_notify(int64_t fd) {
+    const unsigned char alert[2] = {1, 0}; // warning, close_notify
+    char control[CMSG_SPACE(sizeof(unsigned char))] = {};
+    iovec iov{(void*)alert, sizeof(alert)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(cmsg) = 21; // alert
+    return ::sendmsg(fd, &msg, MSG_NOSIGNAL) == sizeof(alert);
+}
+
+int64_t sendfile(int64_t fd, int64_t in_fd, int64_t offset, size_t count) {
+    off_t off = offset;
+    return ::sendfile(fd, in_fd, &off, count);
+}
+
+} // namespace acpp::network::ssl::ktls
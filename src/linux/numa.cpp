@@ -0,0 +1,152 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+#include <detail/numa.h>
+#include <detail/common.h>
+
+namespace acpp::network::detail {
+
+// "0-3,8-11" -> {0,1,2,3,8,9,10,11}
+static std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> result;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++)
+            result.push_back(cpu);
+    }
+    return result;
+}
+
+async::numa_topology detect_numa_topology() {
+    async::numa_topology result;
+    std::error_code ec;
+    const std::filesystem::path base("/sys/devices/system/node");
+    for (auto& entry: std::filesystem::directory_iterator(base, ec)) {
+        auto name = entry.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(name[4]))
+            continue;
+        std::ifstream f(entry.path() / "cpulist");
+        std::string list;
+        std::getline(f, list);
+        auto cpus = parse_cpu_list(list);
+        if (cpus.empty())
+            continue; // memory only node
+        result.nodes.push_back({std::stoi(name.substr(4)), std::move(cpus)});
+    }
+    std::sort(result.nodes.begin(), result.nodes.end(), [](auto& a, auto& b) { return a.id < b.id; });
+
+    if (result.nodes.empty()) {
+        async::numa_node n{0, {}};
+        for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); cpu++)
+            n.cpus.push_back(cpu);
+        result.nodes.push_back(std::move(n));
+    }
+    return result;
+}
+
+bool pin_current_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Chunks come straight from mmap and are bound with mbind before first touch,
+// so the pages are faulted in on the node regardless of the calling thread.
+// The pool above asks for chunks aligned to their block size, up to 64 KB:
+// past a page, the excess of a larger mapping is trimmed off.
+class node_chunk_resource : public std::pmr::memory_resource {
+public:
+    explicit node_chunk_resource(int node): node_(node) {}
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        static const size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+        size_t len = (bytes + page - 1) & ~(page - 1);
+        size_t extra = alignment > page ? alignment - page : 0;
+        void* m = ::mmap(nullptr, len + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED)
+            throw std::bad_alloc();
+        auto p = reinterpret_cast<char*>(((uintptr_t)m + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        if (extra) {
+            if (size_t head = p - static_cast<char*>(m))
+                ::munmap(m, head);
+            if (size_t tail = static_cast<char*>(m) + len + extra - (p + len))
+                ::munmap(p + len, tail);
+        }
+        unsigned long mask[16] = {};
+        if (node_ >= 0 && node_ < (int)(sizeof(mask) * 8)) {
+            mask[node_ / (8 * sizeof(unsigned long))] |= 1UL << (node_ % (8 * sizeof(unsigned long)));
+            if (::syscall(SYS_mbind, p, bytes, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0) {
+                LOG_DEBUG("node_chunk_resource: mbind node {} failed", node_);
+            }
+        }
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        ::munmap(p, bytes);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    int node_;
+};
+
+class node_memory_resource : public std::pmr::memory_resource {
+public:
+    explicit node_memory_resource(int node)
+    : chunks_(node), pool_(std::pmr::pool_options{0, 64 * 1024}, &chunks_) {}
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return pool_.allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        pool_.deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    node_chunk_resource chunks_;
+    // sockets may be closed from threads other than the loop's
+    std::pmr::synchronized_pool_resource pool_;
+};
+
+std::unique_ptr<std::pmr::memory_resource> make_node_memory_resource(int node) {
+    return std::make_unique<node_memory_resource>(node);
+}
+
+bool set_incoming_cpu(int64_t fd, int cpu) {
+    return ::setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == 0;
+}
+
+} // namespace acpp::network::detail
@@ -9,17 +9,21 @@
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <sys/eventfd.h>
+#include <sys/uio.h>
 
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
 #include <atomic>
 #include <queue>
+#include <vector>
 #include <mutex>
 #include <format>
 
 #include <acpp-network/socket_base.h>
+#include <acpp-network/relay.h>
 #include <detail/common.h>
+#include <detail/slab.h>
 
 
 namespace acpp::network {
@@ -106,15 +110,58 @@ namespace async {
 
 class event_handler{
 public:
-    virtual ~event_handler() = default;
+    virtual ~event_handler() {
+        if (handle_)
+            handles_->release(handle_);
+    }
     virtual void handle_event(uint32_t events) = 0;
+
+    // What the epoll events of this handler carry, taken on first use
+    uint64_t handle(detail::handle_table& handles) {
+        if (!handle_) {
+            handles_ = &handles;
+            handle_ = handles.acquire(this);
+        }
+        return handle_;
+    }
+
+private:
+    detail::handle_table* handles_ = nullptr;
+    detail::handle_table::handle handle_ = 0;
+};
+
+// Loop objects (sockets, timers, relays) live in the slab of their
+// io_context, carved from its memory resource: a pinned loop keeps them on
+// its own NUMA node, and next to each other. The slab and the block size
+// are stored in front of the object.
+struct io_allocated {
+    struct header {
+        detail::slab_pool* slab;
+        size_t size;
+    };
+    static constexpr size_t header_size = alignof(std::max_align_t);
+    static_assert(sizeof(header) <= header_size);
+
+    static void* operator new(size_t size, io_context& io);
+
+    static void operator delete(void* p) {
+        if (!p)
+            return;
+        auto base = static_cast<char*>(p) - header_size;
+        auto h = *reinterpret_cast<header*>(base);
+        h.slab->deallocate(base, h.size);
+    }
+
+    static void operator delete(void* p, io_context&) {
+        operator delete(p);
+    }
 };
 
 
 
 
 
-struct socket_base_pimpl: public event_handler {
+struct socket_base_pimpl: public event_handler, public io_allocated {
     friend class io_context_pimpl;
 public:    
     int domain_;
@@ -130,6 +177,9 @@ public:
     //buffered_writer<socket_base_pimpl> write_buffer_;
     bool write_enabled_;
     bool events_set_;
+    bool reading_ = true;
+    // hung up or failed while paused: out of the epoll set until resumed
+    bool hung_up_ = false;
 
     socket_base_pimpl(int domain, int type, int protocol, int fd, io_context& io, socket_callbacks&& callbacks)
     :   domain_(domain), type_(type), protocol_(protocol), 
@@ -183,6 +233,8 @@ public:
 
     size_t so_write(const char* buffer, size_t len);
 
+    size_t so_writev(const const_buffer* buffers, size_t count);
+
     bool write_enabled() {return write_enabled_;}
 
     size_t write(const char* buffer, size_t len);
@@ -202,6 +254,21 @@ public:
 
     void set_events(uint32_t events, const std::string& hint);
 
+    // EPOLLIN unless reading is paused
+    uint32_t read_events() const { return reading_ ? EPOLLIN : 0; }
+
+    void reading(bool on) {
+        if (reading_ == on)
+            return;
+        reading_ = on;
+        // back in the set after a hang up, the level triggered events
+        // bring what is left to read and then the end, from the loop
+        if (events_set_ || (on && hung_up_)) {
+            hung_up_ = false;
+            set_events(read_events() | (write_enabled_ ? 0 : EPOLLOUT), on ? "resume_reading" : "pause_reading");
+        }
+    }
+
     void handle_event(uint32_t events) override; 
 
 };
@@ -209,13 +276,13 @@ public:
 
 
 async_socket_base::async_socket_base(int domain, int type, int protocol, io_context& io, socket_callbacks&& callbacks) {
-    pimpl_ =  std::make_unique<socket_base_pimpl>(domain, type, protocol, io, std::move(callbacks));
+    pimpl_.reset(new (io) socket_base_pimpl(domain, type, protocol, io, std::move(callbacks)));
     pimpl_->parent_ = this;
     io.add_socket(*this);
 }
 
 async_socket_base::async_socket_base(int domain, int type, int protocol, fd_type fd, io_context& io, socket_callbacks&& callbacks) {
-    pimpl_ =  std::make_unique<socket_base_pimpl>(domain, type, protocol, fd, io, std::move(callbacks));
+    pimpl_.reset(new (io) socket_base_pimpl(domain, type, protocol, fd, io, std::move(callbacks)));
     pimpl_->parent_ = this;
     io.add_socket(*this);
 }
@@ -265,6 +332,18 @@ size_t async_socket_base::write(const char* buffer, size_t len) {
     return pimpl_->write(buffer, len);
 }
 
+size_t async_socket_base::writev(const const_buffer* buffers, size_t count) {
+    return pimpl_->so_writev(buffers, count);
+}
+
+void async_socket_base::pause_reading() {
+    pimpl_->reading(false);
+}
+
+void async_socket_base::resume_reading() {
+    pimpl_->reading(true);
+}
+
 void async_socket_base::close() {
     if (pimpl_) {
         pimpl_->close();
@@ -285,7 +364,7 @@ int64_t async_socket_base::fd() {
 
 
 
-class timer_impl: public event_handler {
+class timer_impl: public event_handler, public io_allocated {
 public:
 
     timer_impl(io_context& io, timer& parent, int milliseconds, timer::on_timeout_callback&& cb={});
@@ -360,10 +439,16 @@ public:
     std::atomic_bool run;
     int epollfd;
     std::mutex exec_mutex_;
-    std::queue<std::function<void()>> pending_callbacks_; 
+    std::vector<std::function<void()>> pending_callbacks_; 
+    // swapped with pending_callbacks_ to run them; both keep their capacity,
+    // so exec does not allocate once the loop is warm
+    std::vector<std::function<void()>> running_callbacks_;
 
     constexpr static size_t callback_id = 1;
+    constexpr static size_t exec_reserve = 64;
     io_context* parent_;
+    // before exec_handler_, whose handle it holds
+    std::unique_ptr<detail::slab_pool, detail::slab_pool::releaser> slabs_{new detail::slab_pool};
     exec_event_handler exec_handler_{*this};
     
 
@@ -374,14 +459,16 @@ public:
             log_error_func("epoll_create1");
             throw socket_exception("epoll_create1");
         }    
-
+        // the two swap: each must hold a burst of callbacks
+        pending_callbacks_.reserve(exec_reserve);
+        running_callbacks_.reserve(exec_reserve);
     }
 
 
     void exec(std::function<void()>&& f) {
         {
             std::lock_guard<std::mutex> lock(exec_mutex_);
-            pending_callbacks_.push(std::move(f));  
+            pending_callbacks_.push_back(std::move(f));  
         }
         exec_handler_.trigger();
     }
@@ -399,8 +486,9 @@ public:
                 throw socket_exception("epoll_wait");
             }
             for (int i = 0; i < nev; i++) {
-                auto data = (event_handler*)events[i].data.ptr;
-                data->handle_event(events[i].events);
+                // nullptr when an earlier handler of the batch destroyed it
+                if (auto handler = static_cast<event_handler*>(slabs_->handles.get(events[i].data.u64)))
+                    handler->handle_event(events[i].events);
             }    
         }
     }
@@ -418,24 +506,29 @@ exec_event_handler::exec_event_handler(io_context_pimpl& io_pimpl)
 
     struct epoll_event event;
     event.events = EPOLLIN;
-    event.data.ptr = this; 
+    event.data.u64 = handle(io_pimpl_->slabs_->handles);
 
     if (epoll_ctl(io_pimpl_->epollfd, EPOLL_CTL_ADD, fd_, &event) == -1) {
         throw socket_exception("epoll_ctl failed for eventfd");
     }
 }   
 
+void* io_allocated::operator new(size_t size, io_context& io) {
+    auto slab = io.pimpl_->slabs_.get();
+    auto p = static_cast<char*>(slab->allocate(size + header_size, io.memory_resource()));
+    new (p) header{slab, size + header_size};
+    return p + header_size;
+}
+
 void exec_event_handler::handle_event(uint32_t events) {
-    std::queue<std::function<void()>> callbacks;
+    auto& callbacks = io_pimpl_->running_callbacks_;
     {
         std::lock_guard<std::mutex> lock(io_pimpl_->exec_mutex_);
         std::swap(callbacks, io_pimpl_->pending_callbacks_);
     }
-    while (!callbacks.empty()) {
-        auto& cb = callbacks.front();
+    for (auto& cb: callbacks)
         cb();
-        callbacks.pop();
-    }
+    callbacks.clear();
 }
 
 
@@ -452,7 +545,7 @@ int socket_base_pimpl::listen(int backlog) {
 }
 
 bool socket_base_pimpl::connect(const sockaddr& adr) {
-    set_events(EPOLLIN | EPOLLOUT, "connect");
+    set_events(read_events() | EPOLLOUT, "connect");
     int res = ::connect(fd_, &adr, sizeof(sockaddr));
 
     return  (res == 0 || errno == EINPROGRESS); 
@@ -478,6 +571,51 @@ size_t socket_base_pimpl::so_write(const char* buffer, size_t len) {
     return result;
 }
 
+size_t socket_base_pimpl::so_writev(const const_buffer* buffers, size_t count) {
+    constexpr size_t max_iov = 64;
+    size_t result = 0;
+    size_t skip = 0; // of buffers[0], sent by the last sendmsg
+    while (count) {
+        iovec iov[max_iov];
+        size_t n_iov = std::min(count, max_iov);
+        size_t len = 0;
+        for (size_t i = 0; i < n_iov; i++) {
+            iov[i] = {(void*)buffers[i].data, buffers[i].size};
+            len += buffers[i].size;
+        }
+        iov[0] = {(void*)(buffers[0].data + skip), buffers[0].size - skip};
+        len -= skip;
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n_iov;
+        auto n = ::sendmsg(fd_, &msg, 0);
+        LOG_DEBUG("so_writev fd_: {} n: {} len: {}", fd_, n, len);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                write_enabled_ = false;
+                set_events(read_events() | EPOLLOUT, "so_writev");
+                return result; // kernel buffer full
+            }
+            log_error_func("sendmsg");
+            if (callbacks_.on_error) {
+                callbacks_.on_error(*parent_, errno, strerror(errno), "sendmsg");
+            }
+            return result;
+        }
+        result += n;
+        // a short write goes on from where it stopped, until the kernel
+        // buffer is full and the write event is armed
+        size_t sent = skip + n;
+        while (count && sent >= buffers[0].size) {
+            sent -= buffers[0].size;
+            buffers++;
+            count--;
+        }
+        skip = sent;
+    }
+    return result;
+}
+
 size_t socket_base_pimpl::so_write_internal(const char* buffer, size_t len) {
     auto n = ::send(fd_, buffer, len, 0);
     LOG_DEBUG("so_write_internal(1) fd_: {} n: {} len: {}", fd_, n, len);
@@ -487,7 +625,7 @@ size_t socket_base_pimpl::so_write_internal(const char* buffer, size_t len) {
         if(errno == EAGAIN || errno == EWOULDBLOCK) {
             LOG_DEBUG("so_write_internal(3) fd_: {} ask EPOLLOUT:  len: {}", fd_, len);
             write_enabled_ = false;
-            set_events(EPOLLIN | EPOLLOUT, "so_write_internal");
+            set_events(read_events() | EPOLLOUT, "so_write_internal");
             return 0; // nothing send, kernel buffer full
         }
         log_error_func("send");
@@ -506,10 +644,13 @@ size_t socket_base_pimpl::so_write_internal(const char* buffer, size_t len) {
 
 
 void socket_base_pimpl::handle_event(uint32_t events)  {   
+    // closed by an earlier handler of the same epoll_wait batch
+    if (!valid())
+        return;
     if (events & EPOLLOUT) {
         LOG_DEBUG("io_context::wait_for_input EPOLLOUT 0");
         //disable EPOLLOUT before calling callbacks
-        set_events(EPOLLIN, "handle_event(1)");
+        set_events(read_events(), "handle_event(1)");
         LOG_DEBUG("io_context::wait_for_input EPOLLOUT set_events");
 
         write_enabled_ = true;
@@ -541,6 +682,16 @@ void socket_base_pimpl::handle_event(uint32_t events)  {
             }
         }
     }  
+    // While paused, errors and hang ups are reported whatever the interest
+    // mask: nothing goes up until resume_reading, so the fd leaves the set
+    // instead of coming back on every wait.
+    if (!reading_ && !listening_ && (events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLOUT)) {
+        if (epoll_ctl(io_->pimpl_->epollfd, EPOLL_CTL_DEL, fd_, nullptr) == -1)
+            log_error_func("epoll_ctl del");
+        events_set_ = false;
+        hung_up_ = true;
+        return;
+    }
     if (events & EPOLLIN) {
         LOG_DEBUG("io_context::wait_for_input EPOLLIN");
         if (listening_) {
@@ -581,7 +732,7 @@ void socket_base_pimpl::set_events(uint32_t events, const std::string& hint) {
     LOG_DEBUG("io_context_pimpl::set_events fd: {}, events: {}, hint: {}", fd_, events, hint);
     struct epoll_event sd;
     sd.events = events;
-    sd.data.ptr = (event_handler*)this;
+    sd.data.u64 = handle(io_->pimpl_->slabs_->handles);
     int mode = EPOLL_CTL_ADD;
     if (events_set_) {
         mode = EPOLL_CTL_MOD;
@@ -597,6 +748,216 @@ void socket_base_pimpl::set_events(uint32_t events, const std::string& hint) {
 
 
 
+// Direction i goes from sockets_[i] to sockets_[1 - i] through pipes_[i]
+struct relay_pimpl: public io_allocated {
+    struct side_handler: public event_handler {
+        relay_pimpl* relay_;
+        int side_;
+        void handle_event(uint32_t events) override {
+            relay_->handle_event(side_, events);
+        }
+    };
+
+    struct direction {
+        int pipe[2] = {-1, -1};
+        size_t in_pipe = 0;
+        bool eof = false;
+        bool done = false;
+        uint64_t bytes = 0;
+    };
+
+    async_socket_base sockets_[2];
+    int fd_[2];
+    direction dir_[2];
+    side_handler handlers_[2];
+    // ~0u until set; `removed` once out of the epoll set
+    static constexpr uint32_t removed = ~0u - 1;
+    uint32_t events_[2] = {~0u, ~0u};
+    size_t buffer_size_;
+    io_context* io_;
+    relay* parent_;
+    relay::on_closed_callback on_closed_;
+    bool closed_ = false;
+
+    relay_pimpl(async_socket_base&& a, async_socket_base&& b, relay& parent, relay::on_closed_callback&& on_closed, relay_options options)
+    : sockets_{std::move(a), std::move(b)}, buffer_size_(options.buffer_size), io_(sockets_[0].pimpl_->io_),
+      parent_(&parent), on_closed_(std::move(on_closed)) {
+        if (sockets_[1].pimpl_->io_ != io_)
+            throw socket_exception("relay: sockets of different io_context");
+        for (int i = 0; i < 2; i++) {
+            // the relay reads them from now on
+            sockets_[i].callbacks(socket_callbacks{});
+            fd_[i] = (int)sockets_[i].fd();
+            handlers_[i].relay_ = this;
+            handlers_[i].side_ = i;
+            if (pipe2(dir_[i].pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+                auto error = errno;
+                log_error_func("pipe2");
+                close_pipes();
+                throw socket_exception(error, "relay: pipe2");
+            }
+            fcntl(dir_[i].pipe[1], F_SETPIPE_SZ, (int)buffer_size_);
+        }
+    }
+
+    ~relay_pimpl() {
+        close();
+    }
+
+    // In the memory of the sockets' loop
+    static relay_pimpl* create(async_socket_base&& a, async_socket_base&& b, relay& parent, relay::on_closed_callback&& on_closed, relay_options options) {
+        auto& io = *a.pimpl_->io_;
+        return new (io) relay_pimpl(std::move(a), std::move(b), parent, std::move(on_closed), options);
+    }
+
+    // Epoll reports errors and hang ups even for a socket the relay has no
+    // interest left in: they end the relay or take the socket out of the set,
+    // not to come back on every wait
+    void handle_event(int i, uint32_t events) {
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fd_[i], SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err || (events & EPOLLERR)) {
+                LOG_DEBUG("relay: error fd: {} {}", fd_[i], strerror(err));
+                finish();
+                return;
+            }
+            // a clean hang up: its input ended and its output was shut, what
+            // is left goes through the other socket
+            pump();
+            if (!closed_ && events_[i] != removed) {
+                epoll_ctl((int)io_->fd(), EPOLL_CTL_DEL, fd_[i], nullptr);
+                events_[i] = removed;
+            }
+            return;
+        }
+        pump();
+    }
+
+    // Moves what it can both ways, then sets the events that can unblock it
+    void pump() {
+        if (closed_)
+            return;
+        for (int i = 0; i < 2; i++) {
+            if (!pump(i)) {
+                finish();
+                return;
+            }
+        }
+        if (dir_[0].done && dir_[1].done) {
+            finish();
+            return;
+        }
+        for (int i = 0; i < 2; i++) {
+            // reads stop while the pipe has bytes the other side did not take
+            uint32_t events = 0;
+            if (!dir_[i].eof && !dir_[i].in_pipe)
+                events |= EPOLLIN;
+            if (dir_[1 - i].in_pipe)
+                events |= EPOLLOUT;
+            set_events(i, events);
+        }
+    }
+
+    bool pump(int i) {
+        auto& d = dir_[i];
+        int from = fd_[i], to = fd_[1 - i];
+        for (bool progress = true; progress;) {
+            progress = false;
+            if (!d.eof && d.in_pipe < buffer_size_) {
+                auto n = ::splice(from, nullptr, d.pipe[1], nullptr, buffer_size_ - d.in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n > 0) {
+                    d.in_pipe += n;
+                    progress = true;
+                } else if (n == 0) {
+                    d.eof = true;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    log_error_func("splice");
+                    return false;
+                }
+            }
+            if (d.in_pipe) {
+                auto n = ::splice(d.pipe[0], nullptr, to, nullptr, d.in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n > 0) {
+                    d.in_pipe -= n;
+                    d.bytes += n;
+                    progress = true;
+                } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    log_error_func("splice");
+                    return false;
+                }
+            }
+        }
+        if (d.eof && !d.in_pipe && !d.done) {
+            LOG_DEBUG("relay: half-close fd: {}", to);
+            d.done = true;
+            ::shutdown(to, SHUT_WR);
+        }
+        return true;
+    }
+
+    void set_events(int i, uint32_t events) {
+        if (events == events_[i] || events_[i] == removed)
+            return;
+        epoll_event ev;
+        ev.events = events;
+        ev.data.u64 = handlers_[i].handle(io_->pimpl_->slabs_->handles);
+        // the socket was registered with its own handler (or not yet)
+        auto mode = sockets_[i].pimpl_->events_set_ ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl((int)io_->fd(), mode, fd_[i], &ev) == -1) {
+            log_error_func("epoll_ctl relay");
+            return;
+        }
+        sockets_[i].pimpl_->events_set_ = true;
+        events_[i] = events;
+    }
+
+    void finish() {
+        close();
+        if (on_closed_)
+            on_closed_(*parent_);
+    }
+
+    void close() {
+        if (closed_)
+            return;
+        closed_ = true;
+        // closing the sockets takes them out of the epoll set
+        for (int i = 0; i < 2; i++)
+            sockets_[i].close();
+        close_pipes();
+    }
+
+    void close_pipes() {
+        for (auto& d: dir_) {
+            for (auto& fd: d.pipe) {
+                if (fd != -1)
+                    ::close(fd);
+                fd = -1;
+            }
+        }
+    }
+};
+
+relay::relay(async_socket_base&& a, async_socket_base&& b, on_closed_callback&& on_closed, relay_options options) {
+    pimpl_.reset(relay_pimpl::create(std::move(a), std::move(b), *this, std::move(on_closed), options));
+    // once pimpl_ is set: a socket already at its end calls on_closed, which may ask for stats()
+    pimpl_->pump();
+}
+
+relay::~relay() {}
+
+relay_stats relay::stats() const {
+    return {pimpl_->dir_[0].bytes, pimpl_->dir_[1].bytes, true};
+}
+
+bool relay::closed() const {
+    return pimpl_->closed_;
+}
+
+
+
 timer_impl::timer_impl(io_context& io, timer& parent, int milliseconds, timer::on_timeout_callback&& cb)
 : timer_fd_(-1), io_(&io), parent_(&parent), milliseconds_(milliseconds), callback_(std::move(cb)), events_set_(false) {
 
@@ -636,7 +997,7 @@ void timer_impl::set_events_once(uint32_t events) {
 
     struct epoll_event sd;
     sd.events = events|EPOLLONESHOT;
-    sd.data.ptr = (event_handler*)this;
+    sd.data.u64 = handle(io_->pimpl_->slabs_->handles);
     int mode = EPOLL_CTL_ADD;
     if (events_set_)
         mode = EPOLL_CTL_MOD;
@@ -650,7 +1011,7 @@ void timer_impl::set_events_once(uint32_t events) {
 
 
 timer::timer(io_context& io, int milliseconds, on_timeout_callback&& cb)
-: pimpl_(std::make_unique<timer_impl>(io, *this, milliseconds, std::move(cb))) {
+: pimpl_(new (io) timer_impl(io, *this, milliseconds, std::move(cb))) {
 
 }
 
@@ -0,0 +1,34 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <thread>
+
+#include <detail/numa.h>
+
+// macOS has neither NUMA nodes nor hard thread affinity: one node, no pinning.
+
+namespace acpp::network::detail {
+
+async::numa_topology detect_numa_topology() {
+    async::numa_node n{0, {}};
+    for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); cpu++)
+        n.cpus.push_back(cpu);
+    return async::numa_topology{{std::move(n)}};
+}
+
+bool pin_current_thread(int cpu) {
+    return false;
+}
+
+std::unique_ptr<std::pmr::memory_resource> make_node_memory_resource(int node) {
+    return nullptr;
+}
+
+bool set_incoming_cpu(int64_t fd, int cpu) {
+    return false;
+}
+
+} // namespace acpp::network::detail
@@ -6,14 +6,17 @@
 
 #include <fcntl.h>
 #include <sys/event.h>
+#include <sys/uio.h>
 
 #include <iostream>
 #include <sstream>
+#include <vector>
 #include <unordered_map>
 
 //#include <acpp-network/log.h>
 
 #include <acpp-network/socket_base.h>
+#include <acpp-network/relay.h>
 #include <detail/common.h>
 
 namespace acpp::network {
@@ -108,6 +111,8 @@ public:
     bool listening_ = false;
     static const int64_t invalid_fd = -1;
     std::vector<char> write_buffer_;
+    bool reading_ = true;
+    bool read_event_ = false; // the read filter is registered
 
 
     socket_base_pimpl(int domain, int type, int protocol, int fd, io_context& io, socket_callbacks&& callbacks)
@@ -151,12 +156,26 @@ public:
     void ask_read_event() {
         LOG_DEBUG("socket_base_pimpl::ask_read_event fd: {}", fd_);
         struct kevent ev_set = {0};
-        EV_SET(&ev_set, fd_, EVFILT_READ, EV_ADD|EV_ENABLE|EV_CLEAR, 0, 0, (void*)this);
+        EV_SET(&ev_set, fd_, EVFILT_READ, EV_ADD|(reading_ ? EV_ENABLE : EV_DISABLE)|EV_CLEAR, 0, 0, (void*)this);
         auto r = kevent(io_->fd(), &ev_set, 1, NULL, 0, NULL);  
         if (r < 0) {
             log_error_func("ask_read_event"); 
             throw socket_exception(errno, "ask_read_event");
         }
+        read_event_ = true;
+    }
+
+    // Disables the read filter; enabling it again reports what came meanwhile
+    void reading(bool on) {
+        if (reading_ == on)
+            return;
+        reading_ = on;
+        if (!read_event_)
+            return;
+        struct kevent ev_set = {0};
+        EV_SET(&ev_set, fd_, EVFILT_READ, on ? EV_ENABLE : EV_DISABLE, 0, 0, (void*)this);
+        if (kevent(io_->fd(), &ev_set, 1, NULL, 0, NULL) < 0)
+            log_error_func(on ? "resume_reading" : "pause_reading");
     }
 
     void ask_write_event() {
@@ -219,6 +238,50 @@ size_t so_write(const char* buffer, size_t len) {
     return result;
 }
 
+size_t so_writev(const const_buffer* buffers, size_t count) {
+    constexpr size_t max_iov = 64;
+    size_t result = 0;
+    size_t skip = 0; // of buffers[0], sent by the last sendmsg
+    while (count) {
+        iovec iov[max_iov];
+        size_t n_iov = std::min(count, max_iov);
+        size_t len = 0;
+        for (size_t i = 0; i < n_iov; i++) {
+            iov[i] = {(void*)buffers[i].data, buffers[i].size};
+            len += buffers[i].size;
+        }
+        iov[0] = {(void*)(buffers[0].data + skip), buffers[0].size - skip};
+        len -= skip;
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n_iov;
+        auto n = ::sendmsg(fd_, &msg, 0);
+        LOG_DEBUG("so_writev fd_: {} n: {} len: {}", fd_, n, len);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                ask_write_event();
+                return result; // kernel buffer full
+            }
+            log_error_func("sendmsg");
+            if (callbacks_.on_error) {
+                callbacks_.on_error(*parent_, errno, strerror(errno), "sendmsg");
+            }
+            return result;
+        }
+        result += n;
+        // a short write goes on from where it stopped, until the kernel
+        // buffer is full and the write event is armed
+        size_t sent = skip + n;
+        while (count && sent >= buffers[0].size) {
+            sent -= buffers[0].size;
+            buffers++;
+            count--;
+        }
+        skip = sent;
+    }
+    return result;
+}
+
 size_t so_write_internal(const char* buffer, size_t len) {
     auto n = ::send(fd_, buffer, len, 0);
     LOG_DEBUG("so_write_internal(1) fd_: {} n: {} len: {}", fd_, n, len);
@@ -315,6 +378,18 @@ size_t async_socket_base::write(const char* buffer, size_t len) {
     return pimpl_->write(buffer, len);
 }
 
+size_t async_socket_base::writev(const const_buffer* buffers, size_t count) {
+    return pimpl_->so_writev(buffers, count);
+}
+
+void async_socket_base::pause_reading() {
+    pimpl_->reading(false);
+}
+
+void async_socket_base::resume_reading() {
+    pimpl_->reading(true);
+}
+
 void async_socket_base::close() {
     if (pimpl_) {
         pimpl_->close();
@@ -366,8 +441,12 @@ struct io_context_pimpl {
     int kq_;
     std::mutex exec_mutex_;
     std::mutex timers_mutex_;
-    std::queue<std::function<void()>> pending_callbacks_; 
+    std::vector<std::function<void()>> pending_callbacks_; 
+    // swapped with pending_callbacks_ to run them; both keep their capacity,
+    // so exec does not allocate once the loop is warm
+    std::vector<std::function<void()>> running_callbacks_;
     constexpr static size_t callback_id = 1;
+    constexpr static size_t exec_reserve = 64;
     
     io_context_pimpl() : run_(false), kq_(-1) {
         kq_ = kqueue();
@@ -376,6 +455,9 @@ struct io_context_pimpl {
             log_error_func("kqueue");
             throw socket_exception(errno, "kqueue");
         }    
+        // the two swap: each must hold a burst of callbacks
+        pending_callbacks_.reserve(exec_reserve);
+        running_callbacks_.reserve(exec_reserve);
 
         struct kevent ev_set = {0};
         EV_SET(&ev_set, callback_id, EVFILT_USER, EV_ADD|EV_CLEAR, 0, 0, nullptr);
@@ -386,7 +468,7 @@ struct io_context_pimpl {
     void exec(std::function<void()>&& f) {
         {
             std::lock_guard<std::mutex> lock(exec_mutex_);
-            pending_callbacks_.push(std::move(f));  
+            pending_callbacks_.push_back(std::move(f));  
         }
         struct kevent ev_set = {0};
         EV_SET(&ev_set, 1, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
@@ -495,15 +577,14 @@ struct io_context_pimpl {
                         }
                     }
                 } else if (events[i].filter == EVFILT_USER) {
-                    std::queue<std::function<void()>> tasks;
+                    auto& tasks = running_callbacks_;
                     {
                         std::lock_guard<std::mutex> lock(exec_mutex_);
                         std::swap(tasks, pending_callbacks_);
                     }
-                    while (!tasks.empty()) {
-                        tasks.front()();
-                        tasks.pop();
-                    }
+                    for (auto& task: tasks)
+                        task();
+                    tasks.clear();
                 } else if (events[i].filter == EVFILT_TIMER) {
                     LOG_DEBUG("io_context::wait_for_input EVFILT_TIMER");
                     timer_impl* timer = (timer_impl*)events[i].ident;
@@ -590,6 +671,85 @@ int64_t io_context::fd() const  {
     return pimpl_->kq_;
 }
 
+// No splice here: the bytes are copied. What a destination does not take is
+// kept until it can, and its source stops reading meanwhile
+struct relay_pimpl {
+    async_socket_base sockets_[2];
+    // bytes waiting to be sent to sockets_[i]
+    std::vector<char> pending_[2];
+    uint64_t bytes_[2] = {0, 0};
+    bool eof_[2] = {false, false};
+    relay* parent_;
+    relay::on_closed_callback on_closed_;
+    bool closed_ = false;
+
+    relay_pimpl(async_socket_base&& a, async_socket_base&& b, relay& parent, relay::on_closed_callback&& on_closed, relay_options)
+    : sockets_{std::move(a), std::move(b)}, parent_(&parent), on_closed_(std::move(on_closed)) {
+        for (int i = 0; i < 2; i++) {
+            sockets_[i].callbacks(socket_callbacks{
+                .on_disconnected = [this, i](async_socket_base&) { end_of_input(i); },
+                .on_received = [this, i](async_socket_base&, const char* buf, size_t len) {
+                    bytes_[i] += len;
+                    send(1 - i, buf, len);
+                },
+                .on_sent = [this, i](async_socket_base&, size_t) { send(i, nullptr, 0); },
+                .on_error = [this](async_socket_base&, int, const std::string&, const std::string&) { finish(); },
+            });
+        }
+    }
+
+    void send(int to, const char* buf, size_t len) {
+        auto& pending = pending_[to];
+        if (pending.empty()) {
+            auto n = len ? sockets_[to].write(buf, len) : 0;
+            pending.insert(pending.end(), buf + n, buf + len);
+        } else {
+            pending.insert(pending.end(), buf, buf + len);
+            auto n = sockets_[to].write(pending.data(), pending.size());
+            pending.erase(pending.begin(), pending.begin() + n);
+            if (pending.empty() && !eof_[1 - to])
+                sockets_[1 - to].resume_reading();
+        }
+        if (!pending.empty())
+            sockets_[1 - to].pause_reading();
+        if (pending.empty() && eof_[1 - to])
+            ::shutdown((int)sockets_[to].fd(), SHUT_WR);
+    }
+
+    void end_of_input(int i) {
+        if (eof_[i])
+            return;
+        eof_[i] = true;
+        if (pending_[1 - i].empty())
+            ::shutdown((int)sockets_[1 - i].fd(), SHUT_WR);
+        if (eof_[0] && eof_[1])
+            finish();
+    }
+
+    void finish() {
+        if (closed_)
+            return;
+        closed_ = true;
+        for (auto& s: sockets_)
+            s.close();
+        if (on_closed_)
+            on_closed_(*parent_);
+    }
+};
+
+relay::relay(async_socket_base&& a, async_socket_base&& b, on_closed_callback&& on_closed, relay_options options)
+: pimpl_(std::make_unique<relay_pimpl>(std::move(a), std::move(b), *this, std::move(on_closed), options)) {}
+
+relay::~relay() {}
+
+relay_stats relay::stats() const {
+    return {pimpl_->bytes_[0], pimpl_->bytes_[1], false};
+}
+
+bool relay::closed() const {
+    return pimpl_->closed_;
+}
+
 } // namespace async
 
 
@@ -7,6 +7,16 @@
 #include <acpp-network/ssl/ssl.h>
 
 #include <openssl/x509v3.h>
+#include <openssl/pem.h>
+#include <openssl/err.h>
+
+#include <openssl/rand.h>
+#include <openssl/core_names.h>
+#include <openssl/kdf.h>
+
+#include <cstring>
+#include <algorithm>
+#include <optional>
 
 #include <detail/common.h>
 
@@ -20,12 +30,6 @@ BigNum create_big_numm() {
 }
 
 
-using Rsa = std::unique_ptr<::RSA, decltype(&::RSA_free)>;
-
-Rsa create_rsa() {
-    return Rsa(::RSA_new(), ::RSA_free);
-}
-
 using Bio = std::unique_ptr<::BIO, decltype(&::BIO_free)>;
 
 Bio create_bio() {
@@ -40,19 +44,99 @@ pkey::pkey()
 
 }
 
+pkey::pkey(void* handle)
+:handle_((EVP_PKEY*)handle)
+{
+
+}
+
+pkey::pkey(const pkey& x)
+:handle_(x.handle_)
+{
+    if (handle_)
+        EVP_PKEY_up_ref(handle_);
+}
+
 pkey::pkey(pkey&& x)
 :handle_(x.handle_) 
 {
     x.handle_ = nullptr;
 }
 
+pkey pkey::load_from_file(const std::string& file) {
+    Bio bio(::BIO_new_file(file.c_str(), "r"), ::BIO_free);
+    if (!bio)
+        throw exception("Unable to open key file: " + file);
+    auto handle = PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr);
+    if (!handle)
+        throw exception("Unable to read key file: " + file);
+    return pkey(handle);
+}
+
+pkey pkey::from_pem(const std::string& pem) {
+    Bio bio(::BIO_new_mem_buf(pem.data(), (int)pem.size()), ::BIO_free);
+    auto handle = PEM_read_bio_PrivateKey(bio.get(), nullptr, nullptr, nullptr);
+    if (!handle)
+        throw exception("Unable to read PEM key");
+    return pkey(handle);
+}
+
+pkey pkey::generate(const key_spec& spec) {
+    EVP_PKEY* handle = nullptr;
+    switch (spec.type) {
+    case key_type::rsa:
+        handle = EVP_PKEY_Q_keygen(nullptr, nullptr, "RSA", (size_t)spec.bits);
+        break;
+    case key_type::ecdsa_p256:
+        handle = EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256");
+        break;
+    case key_type::ed25519:
+        handle = EVP_PKEY_Q_keygen(nullptr, nullptr, "ED25519");
+        break;
+    }
+    if (!handle)
+        throw exception("Unable to generate key");
+    return pkey(handle);
+}
+
+// Ed25519 signs the message itself, no digest.
+static const EVP_MD* sign_digest(EVP_PKEY* key) {
+    return EVP_PKEY_get_id(key) == EVP_PKEY_ED25519 ? nullptr : EVP_sha256();
+}
+
+std::string pkey::to_pem() const {
+    auto bio = create_bio();
+    PEM_write_bio_PrivateKey(bio.get(), handle_, nullptr, nullptr, 0, nullptr, nullptr);
+    const char* buffer;
+    long n = BIO_get_mem_data(bio.get(), &buffer);
+    return std::string(buffer, n);
+}
+
+
+void pkey::operator=(const pkey& x) {
+    if (x.handle_)
+        EVP_PKEY_up_ref(x.handle_);
+    if (handle_)
+        EVP_PKEY_free(handle_);
+    handle_ = x.handle_;
+}
 
 pkey::~pkey() {
+    if (handle_)
+        EVP_PKEY_free(handle_);
+}
 
+void x509::operator=(const x509& x) {
+    if (x.handle_)
+        X509_up_ref(x.handle_);
+    if (handle_)
+        X509_free(handle_);
+    handle_ = x.handle_;
 }
 
 x509::~x509() {
-
+    if (handle_)
+        X509_free(handle_);
 }
 
 
@@ -88,12 +172,57 @@ x509::x509()
 
 }
 
+x509::x509(void* handle)
+:handle_((X509*)handle)
+{
+
+}
+
+x509::x509(const x509& x)
+:handle_(x.handle_)
+{
+    if (handle_)
+        X509_up_ref(handle_);
+}
+
 x509::x509(x509&& x)
 :handle_(x.handle_) 
 {
     x.handle_ = nullptr;
 }
 
+x509 x509::load_from_file(const std::string& cert_file) {
+    Bio bio(::BIO_new_file(cert_file.c_str(), "r"), ::BIO_free);
+    if (!bio)
+        throw exception("Unable to open cert file: " + cert_file);
+    auto handle = PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr);
+    if (!handle)
+        throw exception("Unable to read cert file: " + cert_file);
+    return x509(handle);
+}
+
+x509 x509::from_pem(const std::string& pem) {
+    Bio bio(::BIO_new_mem_buf(pem.data(), (int)pem.size()), ::BIO_free);
+    auto handle = PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr);
+    if (!handle)
+        throw exception("Unable to read PEM cert");
+    return x509(handle);
+}
+
+std::string x509::to_pem() const {
+    auto bio = create_bio();
+    PEM_write_bio_X509(bio.get(), handle_);
+    const char* buffer;
+    long n = BIO_get_mem_data(bio.get(), &buffer);
+    return std::string(buffer, n);
+}
+
+void x509::save_to_file(const std::string& cert_file) {
+    Bio bio(::BIO_new_file(cert_file.c_str(), "w"), ::BIO_free);
+    if (!bio || !PEM_write_bio_X509(bio.get(), handle_))
+        throw exception("Unable to write cert file: " + cert_file);
+}
+
 
 
 std::string x509::to_string() {
@@ -109,25 +238,27 @@ std::string x509::to_string() {
 }
 
 
-std::pair<x509, pkey>  x509::create_cert(const x509::Name& n) {
-    // Step 1: Generate RSA key
-    std::pair<x509, pkey> result;
-    pkey& pkey = result.second;
-    auto pk = pkey.handle();
-    Rsa rsa = create_rsa(); 
+void x509::set_random_serial(X509* cert) {
     BigNum bn = create_big_numm();
-    BN_set_word(bn.get(), RSA_F4);
-    RSA_generate_key_ex(rsa.get(), 2048, bn.get(), nullptr);
-    EVP_PKEY_assign_RSA(pk, rsa.get());
-    //TODO: why is this needed???
-    rsa.release();
+    // RAND_bytes is thread safe; positive 159 bit value as RFC 5280 allows 20 octets
+    if (BN_rand(bn.get(), 159, BN_RAND_TOP_ANY, BN_RAND_BOTTOM_ANY) != 1)
+        throw exception("Unable to generate serial number");
+    if (!BN_to_ASN1_INTEGER(bn.get(), X509_get_serialNumber(cert)))
+        throw exception("Unable to set serial number");
+}
+
+std::pair<x509, pkey>  x509::create_cert(const x509::Name& n, const key_spec& spec) {
+    return create_cert(n, pkey::generate(spec));
+}
+
+std::pair<x509, pkey>  x509::create_cert(const x509::Name& n, pkey key) {
+    std::pair<x509, pkey> result(x509(), std::move(key));
+    auto pk = result.second.handle();
 
     auto x509 = result.first.handle();
 
     X509_set_version(x509, 2); // Version 3
-    //TODO: lock ... atomic inc
-    static int cont=0;
-    ASN1_INTEGER_set(X509_get_serialNumber(x509), ++cont); // Serial number
+    set_random_serial(x509);
     // Set the certificate's validity period
     X509_gmtime_adj(X509_get_notBefore(x509), 0);
     X509_gmtime_adj(X509_get_notAfter(x509), 31536000L); // Valid for one year
@@ -158,9 +289,9 @@ std::pair<x509, pkey>  x509::create_cert(const x509::Name& n) {
 
 
 
-std::pair<x509, pkey>  x509::create_self_signed_cert(const x509::Name& n) {
+std::pair<x509, pkey>  x509::create_self_signed_cert(const x509::Name& n, const key_spec& spec) {
 
-    auto result = x509::create_cert(n);
+    auto result = x509::create_cert(n, spec);
 
     auto x509 = result.first.handle();
 
@@ -170,43 +301,19 @@ std::pair<x509, pkey>  x509::create_self_signed_cert(const x509::Name& n) {
 
     X509_PUBKEY * pkey = X509_get_X509_PUBKEY(x509);
     // Sign the certificate with the private key
-    X509_sign(x509, result.second.handle(), EVP_sha256());
+    X509_sign(x509, result.second.handle(), sign_digest(result.second.handle()));
 
     return result;
 }
 
-using X509Req = std::unique_ptr<::X509_REQ, decltype(&::X509_REQ_free)>;
-
-X509Req create_req() {
-    return X509Req(::X509_REQ_new(), ::X509_REQ_free);    
+std::pair<x509, pkey> x509::create_signed_cert(x509& ca_cert, pkey& ca_pkey, const x509::Name& n, const key_spec& spec) {
+    return create_signed_cert(ca_cert, ca_pkey, n, pkey::generate(spec));
 }
 
-
-
-
-std::pair<x509, pkey> x509::create_signed_cert(x509& ca_cert, pkey& ca_pkey, const x509::Name& n) {
-    auto x509_key = create_cert(n);
-    auto x509 = x509_key.first.handle();
-    // Step 2: Create new X.509 certificate request (CSR)
-    //X509_REQ* req = X509_REQ_new();
-    X509Req req = create_req();
-    auto pkey = x509_key.second.handle();
-    X509_REQ_set_pubkey(req.get(), pkey);
-
-    X509_NAME* name = X509_REQ_get_subject_name(req.get());
-    set_name(name, n);
-    // Sign the CSR with the new key
-    X509_REQ_sign(req.get(), pkey, EVP_sha256());
-
-    // Set certificate issuer (from CA certificate)
-    X509_set_issuer_name(x509, X509_get_subject_name((::X509*)ca_cert.handle()));
-
-    // Sign the certificate with the CA's private key
-    X509_sign(x509, ca_pkey.handle(), EVP_sha256());
-
-
-    return x509_key;
-
+std::pair<x509, pkey> x509::create_signed_cert(x509& ca_cert, pkey& ca_pkey, const x509::Name& n, pkey key) {
+    auto result = create_cert(n, std::move(key));
+    result.first.sign(ca_cert, ca_pkey);
+    return result;
 }
 
 
@@ -215,7 +322,7 @@ void x509::sign(x509& ca_cert, pkey& pk) {
     auto x509 =handle();
     X509_set_issuer_name(x509, X509_get_subject_name(ca_cert.handle()));
 
-    X509_sign(x509, pk.handle(), EVP_sha256());
+    X509_sign(x509, pk.handle(), sign_digest(pk.handle()));
 }
 
 
@@ -246,6 +353,7 @@ context::context(side_t s)
 
     //SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);
     SSL_CTX_set_mode(handle_,  SSL_MODE_ENABLE_PARTIAL_WRITE);
+    SSL_CTX_set_app_data(handle_, this);
 }
 
 
@@ -295,23 +403,803 @@ void context::set_pkey(pkey& pkey) {
     SSL_CTX_use_PrivateKey(handle(), pkey.handle());
 }
 
-ssl_stream_context::ssl_stream_context(acpp::network::async::io_context& io, side_t side, const std::string& hostname)
-:io_(io), side_(side), hostname_(hostname), context_(std::make_shared<context>(side))
-{
-    if (side_ == side_t::server) {
-        //auto start_time = std::chrono::high_resolution_clock::now();
+static void check_private_key(context& ctx) {
+    if (SSL_CTX_check_private_key(ctx.handle()) != 1)
+        throw exception("Private key does not match the certificate");
+}
+
+std::shared_ptr<context> context::make_server(x509& cert, pkey& key) {
+    auto result = std::make_shared<context>(side_t::server);
+    result->set_cert(cert);
+    result->set_pkey(key);
+    check_private_key(*result);
+    return result;
+}
+
+std::shared_ptr<context> context::make_server_from_files(const std::string& cert_chain_file, const std::string& key_file) {
+    auto result = std::make_shared<context>(side_t::server);
+    if (SSL_CTX_use_certificate_chain_file(result->handle(), cert_chain_file.c_str()) != 1)
+        throw exception("Unable to load cert chain file: " + cert_chain_file);
+    if (SSL_CTX_use_PrivateKey_file(result->handle(), key_file.c_str(), SSL_FILETYPE_PEM) != 1)
+        throw exception("Unable to load key file: " + key_file);
+    check_private_key(*result);
+    return result;
+}
+
+std::shared_ptr<context> context::make_server_from_memory(const std::string& cert_chain_pem, const std::string& key_pem) {
+    auto result = std::make_shared<context>(side_t::server);
+    Bio bio(::BIO_new_mem_buf(cert_chain_pem.data(), (int)cert_chain_pem.size()), ::BIO_free);
+    auto leaf = PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr);
+    if (!leaf)
+        throw exception("Unable to read PEM cert chain");
+    auto e = SSL_CTX_use_certificate(result->handle(), leaf);
+    X509_free(leaf);
+    if (e != 1)
+        throw exception("Fail to set cert");
+    while (auto ca = PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr)) {
+        // add0: the context takes the reference
+        SSL_CTX_add0_chain_cert(result->handle(), ca);
+    }
+    ERR_clear_error(); // end of the PEM data
+
+    auto key = pkey::from_pem(key_pem);
+    result->set_pkey(key);
+    check_private_key(*result);
+    return result;
+}
 
+std::shared_ptr<context> context::default_server() {
+    static std::shared_ptr<context> result = []() {
         auto c = x509::create_self_signed_cert(x509::Name().cn("xxx").l("l").o("o").st("st"));
+        LOG_DEBUG("ssl::context::default_server: cert: {}", c.first.to_string());
+        return make_server(c.first, c.second);
+    }();
+    return result;
+}
+
+std::shared_ptr<context> context::default_client() {
+    static std::shared_ptr<context> result = std::make_shared<context>(side_t::client);
+    return result;
+}
+
+ticket_keys::ticket_keys(std::chrono::seconds rotation, size_t keep)
+: rotation_(rotation), keep_(keep)
+{
+    rotate();
+}
+
+void ticket_keys::rotate_locked() {
+    key k;
+    if (RAND_bytes(k.name, sizeof(k.name)) != 1 || RAND_bytes(k.aes_key, sizeof(k.aes_key)) != 1 
+        || RAND_bytes(k.hmac_key, sizeof(k.hmac_key)) != 1) {
+        throw exception("ticket_keys: RAND_bytes failed");
+    }
+    k.created = std::chrono::steady_clock::now();
+    keys_.push_front(k);
+    while (keys_.size() > keep_ + 1)
+        keys_.pop_back();
+    rotations_++;
+}
+
+void ticket_keys::rotate() {
+    std::lock_guard<std::mutex> l(mutex_);
+    rotate_locked();
+}
+
+ticket_keys::key ticket_keys::current() {
+    std::lock_guard<std::mutex> l(mutex_);
+    if (std::chrono::steady_clock::now() - keys_.front().created >= rotation_)
+        rotate_locked();
+    return keys_.front();
+}
+
+bool ticket_keys::find(const unsigned char* name, key& k, bool& is_current) {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (size_t i = 0; i < keys_.size(); i++) {
+        if (memcmp(keys_[i].name, name, sizeof(k.name)) == 0) {
+            k = keys_[i];
+            is_current = i == 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+session_store::session_store(size_t max_entries)
+: max_entries_(max_entries)
+{
+
+}
+
+session_store::~session_store() {
+    for (auto& [h, s]: sessions_)
+        SSL_SESSION_free(s);
+}
+
+SSL_SESSION* session_store::get(const std::string& hostname) {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = sessions_.find(hostname);
+    if (it == sessions_.end())
+        return nullptr;
+    // each connection gets its own copy, see new_session_cb
+    return SSL_SESSION_dup(it->second);
+}
+
+void session_store::put(const std::string& hostname, SSL_SESSION* session) {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = sessions_.find(hostname);
+    if (it != sessions_.end()) {
+        SSL_SESSION_free(it->second);
+        it->second = session;
+        return;
+    }
+    if (sessions_.size() >= max_entries_) {
+        SSL_SESSION_free(sessions_.begin()->second);
+        sessions_.erase(sessions_.begin());
+    }
+    sessions_.emplace(hostname, session);
+}
+
+void session_store::remove(const std::string& hostname) {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = sessions_.find(hostname);
+    if (it != sessions_.end()) {
+        SSL_SESSION_free(it->second);
+        sessions_.erase(it);
+    }
+}
+
+size_t session_store::size() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return sessions_.size();
+}
+
+context* context::from_handle(SSL_CTX* handle) {
+    return static_cast<context*>(SSL_CTX_get_app_data(handle));
+}
+
+void context::record_handshake(bool resumed) {
+    handshakes_++;
+    if (resumed)
+        resumed_++;
+}
+
+static const unsigned char session_id_context[] = "acpp-network";
+
+void context::enable_session_cache(size_t size, std::chrono::seconds timeout) {
+    SSL_CTX_set_session_cache_mode(handle_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(handle_, (long)size);
+    SSL_CTX_set_timeout(handle_, (long)timeout.count());
+    SSL_CTX_set_session_id_context(handle_, session_id_context, sizeof(session_id_context) - 1);
+}
+
+static int ticket_key_cb(SSL* ssl, unsigned char key_name[16], unsigned char iv[EVP_MAX_IV_LENGTH], 
+                         EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* hmac_ctx, int enc) {
+    auto ctx = context::from_handle(SSL_get_SSL_CTX(ssl));
+    if (!ctx || !ctx->tickets())
+        return 0;
+    ticket_keys::key k;
+    int result = 1;
+    if (enc) {
+        k = ctx->tickets()->current();
+        memcpy(key_name, k.name, sizeof(k.name));
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1)
+            return -1;
+        if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, k.aes_key, iv) != 1)
+            return -1;
+    } else {
+        bool is_current = false;
+        if (!ctx->tickets()->find(key_name, k, is_current))
+            return 0; // unknown key: full handshake
+        if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, k.aes_key, iv) != 1)
+            return -1;
+        result = is_current ? 1 : 2; // 2: renew the ticket with the current key
+    }
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, k.hmac_key, sizeof(k.hmac_key)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()
+    };
+    if (EVP_MAC_CTX_set_params(hmac_ctx, params) != 1)
+        return -1;
+    return result;
+}
+
+void context::enable_session_tickets(std::shared_ptr<ticket_keys> keys) {
+    tickets_ = std::move(keys);
+    SSL_CTX_clear_options(handle_, SSL_OP_NO_TICKET);
+    SSL_CTX_set_session_id_context(handle_, session_id_context, sizeof(session_id_context) - 1);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(handle_, ticket_key_cb);
+}
+
+static int new_session_cb(SSL* ssl, SSL_SESSION* session) {
+    auto ctx = context::from_handle(SSL_get_SSL_CTX(ssl));
+    const char* hostname = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!ctx || !ctx->sessions() || !hostname || !SSL_SESSION_is_resumable(session))
+        return 0;
+    // A copy: SSL_free marks the original not resumable when the connection
+    // was not shut down with close_notify, which is the common case.
+    auto copy = SSL_SESSION_dup(session);
+    if (copy)
+        ctx->sessions()->put(hostname, copy);
+    return 0;
+}
+
+void context::enable_session_store(std::shared_ptr<session_store> store) {
+    sessions_ = std::move(store);
+    SSL_CTX_set_session_cache_mode(handle_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(handle_, new_session_cb);
+}
+
+cert_cache::cert_cache(mint_function mint, size_t capacity)
+:mint_(std::move(mint)), capacity_(std::max<size_t>(capacity, 1))
+{
+}
+
+cert_cache::cert_cache(x509& ca_cert, pkey& ca_key, size_t capacity, const key_spec& leaf)
+:cert_cache([ca_cert, ca_key, leaf](const std::string& hostname) mutable {
+    return x509::create_signed_cert(ca_cert, ca_key, x509::Name().cn(hostname), leaf);
+ }, capacity)
+{
+}
+
+cert_cache::cert_cache(x509& ca_cert, pkey& ca_key, std::shared_ptr<key_pool> keys, size_t capacity)
+:cert_cache([ca_cert, ca_key, keys](const std::string& hostname) mutable {
+    return x509::create_signed_cert(ca_cert, ca_key, x509::Name().cn(hostname), keys->take());
+ }, capacity)
+{
+}
+
+cert_cache::entry cert_cache::get(const std::string& hostname) {
+    std::unique_lock<std::mutex> l(mutex_);
+    auto it = index_.find(hostname);
+    if (it != index_.end()) {
+        stats_.hits++;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+    }
+    auto p = pending_.find(hostname);
+    if (p != pending_.end()) {
+        stats_.merged++;
+        auto f = p->second;
+        l.unlock();
+        return f.get();
+    }
+    stats_.misses++;
+    std::promise<entry> promise;
+    pending_.emplace(hostname, promise.get_future().share());
+    l.unlock();
+
+    try {
+        auto result = mint_(hostname);
+        l.lock();
+        pending_.erase(hostname);
+        lru_.emplace_front(hostname, result);
+        index_[hostname] = lru_.begin();
+        if (lru_.size() > capacity_) {
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+            stats_.evictions++;
+        }
+        l.unlock();
+        promise.set_value(result);
+        return result;
+    } catch (...) {
+        l.lock();
+        pending_.erase(hostname);
+        l.unlock();
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+size_t cert_cache::size() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return lru_.size();
+}
+
+cert_cache::stats_t cert_cache::stats() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return stats_;
+}
+
+key_pool::key_pool(const key_spec& spec, size_t min_depth, size_t max_depth, size_t threads)
+:spec_(spec), min_depth_(std::max<size_t>(min_depth, 1)), max_depth_(std::max(max_depth, min_depth)),
+ target_(min_depth_)
+{
+    for (size_t i = 0; i < threads; i++)
+        workers_.emplace_back([this]() { run(); });
+}
+
+key_pool::~key_pool() {
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t: workers_)
+        t.join();
+}
+
+void key_pool::run() {
+    std::unique_lock<std::mutex> l(mutex_);
+    while (true) {
+        cv_.wait(l, [this]() { return stop_ || keys_.size() + in_progress_ < target_; });
+        if (stop_)
+            return;
+        in_progress_++;
+        l.unlock();
+        std::optional<pkey> key;
+        try {
+            key.emplace(pkey::generate(spec_));
+        } catch (const exception& e) {
+            LOG_ERROR("ssl::key_pool: {}", e.what());
+        }
+        l.lock();
+        in_progress_--;
+        if (!key)
+            continue;
+        keys_.push_back(std::move(*key));
+        stats_.generated++;
+    }
+}
+
+pkey key_pool::take() {
+    std::unique_lock<std::mutex> l(mutex_);
+    stats_.taken++;
+    if (!keys_.empty()) {
+        auto result = std::move(keys_.front());
+        keys_.pop_front();
+        // a full target's worth of takes without a stall: shrink by a quarter
+        if (++since_stall_ >= target_ && target_ > min_depth_) {
+            target_ = std::max(min_depth_, target_ - std::max<size_t>(target_ / 4, 1));
+            since_stall_ = 0;
+        }
+        l.unlock();
+        cv_.notify_one();
+        return result;
+    }
+    // Empty reservoir: generate inline and grow the target for the burst.
+    stats_.stalls++;
+    since_stall_ = 0;
+    target_ = std::min(max_depth_, target_ * 2);
+    l.unlock();
+    cv_.notify_all();
+    return pkey::generate(spec_);
+}
+
+key_pool::stats_t key_pool::stats() {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto result = stats_;
+    result.depth = keys_.size();
+    result.target = target_;
+    return result;
+}
+
+crypto_pool::crypto_pool(size_t threads) {
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+        workers_.emplace_back([this]() {
+            std::unique_lock<std::mutex> l(mutex_);
+            while (true) {
+                cv_.wait(l, [this]() { return stop_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return; // stopping and drained
+                auto job = std::move(jobs_.front());
+                jobs_.pop_front();
+                l.unlock();
+                try {
+                    job();
+                } catch (const std::exception& e) {
+                    LOG_ERROR("ssl::crypto_pool: {}", e.what());
+                }
+                l.lock();
+            }
+        });
+    }
+}
+
+crypto_pool::~crypto_pool() {
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t: workers_)
+        t.join();
+}
+
+void crypto_pool::post(std::function<void()>&& job) {
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    cv_.notify_one();
+}
+
+size_t crypto_pool::pending() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return jobs_.size();
+}
+
+void context::enable_handshake_offload(std::shared_ptr<crypto_pool> pool) {
+    offload_ = std::move(pool);
+}
+
+// Application traffic secrets, captured through the keylog callback.
+struct traffic_secrets {
+    std::vector<unsigned char> client;
+    std::vector<unsigned char> server;
+};
+
+static void free_traffic_secrets(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp) {
+    auto secrets = static_cast<traffic_secrets*>(ptr);
+    if (!secrets)
+        return;
+    OPENSSL_cleanse(secrets->client.data(), secrets->client.size());
+    OPENSSL_cleanse(secrets->server.data(), secrets->server.size());
+    delete secrets;
+}
+
+static int traffic_secrets_index() {
+    static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, free_traffic_secrets);
+    return index;
+}
+
+// "<label> <client random> <secret>" in hex
+static void keylog_cb(const SSL* ssl, const char* line) {
+    std::string l(line);
+    auto first = l.find(' ');
+    auto second = l.find(' ', first + 1);
+    if (first == std::string::npos || second == std::string::npos)
+        return;
+    auto label = l.substr(0, first);
+    bool client = label == "CLIENT_TRAFFIC_SECRET_0";
+    if (!client && label != "SERVER_TRAFFIC_SECRET_0")
+        return;
+    long len = 0;
+    auto bytes = OPENSSL_hexstr2buf(l.c_str() + second + 1, &len);
+    if (!bytes)
+        return;
+    auto secrets = static_cast<traffic_secrets*>(SSL_get_ex_data(ssl, traffic_secrets_index()));
+    if (!secrets) {
+        secrets = new traffic_secrets;
+        SSL_set_ex_data(const_cast<SSL*>(ssl), traffic_secrets_index(), secrets);
+    }
+    (client ? secrets->client : secrets->server).assign(bytes, bytes + len);
+    OPENSSL_clear_free(bytes, len);
+}
 
-        // auto end_time = std::chrono::high_resolution_clock::now();
-        // auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);        
-        // std::cout << "⏱️  Latency create cert: " << duration.count() << "ms" << std::endl;
+// RFC 8446 7.1, with an empty context
+static bool hkdf_expand_label(const EVP_MD* md, const std::vector<unsigned char>& secret, const std::string& label,
+                              unsigned char* out, size_t len) {
+    auto full_label = "tls13 " + label;
+    std::vector<unsigned char> info = {(unsigned char)(len >> 8), (unsigned char)len, (unsigned char)full_label.size()};
+    info.insert(info.end(), full_label.begin(), full_label.end());
+    info.push_back(0);
+
+    auto kdf = EVP_KDF_fetch(nullptr, "HKDF", nullptr);
+    auto kdf_ctx = kdf ? EVP_KDF_CTX_new(kdf) : nullptr;
+    EVP_KDF_free(kdf);
+    if (!kdf_ctx)
+        return false;
+    int mode = EVP_KDF_HKDF_MODE_EXPAND_ONLY;
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_int(OSSL_KDF_PARAM_MODE, &mode),
+        OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, (char*)EVP_MD_get0_name(md), 0),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, (void*)secret.data(), secret.size()),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, info.data(), info.size()),
+        OSSL_PARAM_construct_end()
+    };
+    bool result = EVP_KDF_derive(kdf_ctx, out, len, params) == 1;
+    EVP_KDF_CTX_free(kdf_ctx);
+    return result;
+}
 
-        LOG_DEBUG("ssl::stream<Next>::stream: cert: {}", c.first.to_string());
-        context_->set_cert(c.first);
-        context_->set_pkey(c.second);
+bool traffic_keys::tx(SSL* ssl, traffic_keys& keys) {
+    if (SSL_version(ssl) != TLS1_3_VERSION)
+        return false;
+    auto cipher = SSL_get_current_cipher(ssl);
+    if (!cipher)
+        return false;
+    const EVP_MD* md = EVP_sha256();
+    size_t key_len = 16;
+    switch (SSL_CIPHER_get_id(cipher)) {
+    case TLS1_3_CK_AES_128_GCM_SHA256:
+        keys.cipher = cipher_t::aes_128_gcm;
+        break;
+    case TLS1_3_CK_AES_256_GCM_SHA384:
+        keys.cipher = cipher_t::aes_256_gcm;
+        md = EVP_sha384();
+        key_len = 32;
+        break;
+    case TLS1_3_CK_CHACHA20_POLY1305_SHA256:
+        keys.cipher = cipher_t::chacha20_poly1305;
+        key_len = 32;
+        break;
+    default:
+        return false;
     }
+    auto secrets = static_cast<traffic_secrets*>(SSL_get_ex_data(ssl, traffic_secrets_index()));
+    if (!secrets)
+        return false;
+    auto& secret = SSL_is_server(ssl) ? secrets->server : secrets->client;
+    if (secret.empty())
+        return false;
+    keys.key.resize(key_len);
+    keys.seq = 0;
+    return hkdf_expand_label(md, secret, "key", keys.key.data(), key_len) &&
+           hkdf_expand_label(md, secret, "iv", keys.iv.data(), keys.iv.size());
+}
+
+size_t record_count(const char* buf, size_t len) {
+    size_t result = 0;
+    for (size_t i = 0; i + 5 <= len; i += 5 + ((size_t)(unsigned char)buf[i + 3] << 8 | (unsigned char)buf[i + 4]))
+        result++;
+    return result;
+}
 
+static const EVP_CIPHER* evp_cipher(traffic_keys::cipher_t cipher) {
+    switch (cipher) {
+    case traffic_keys::cipher_t::aes_256_gcm:
+        return EVP_aes_256_gcm();
+    case traffic_keys::cipher_t::chacha20_poly1305:
+        return EVP_chacha20_poly1305();
+    default:
+        return EVP_aes_128_gcm();
+    }
+}
+
+record_sealer::record_sealer(const traffic_keys& keys)
+: iv_(keys.iv), ctx_(EVP_CIPHER_CTX_new())
+{
+    if (!ctx_ || EVP_EncryptInit_ex(ctx_, evp_cipher(keys.cipher), nullptr, keys.key.data(), nullptr) != 1) {
+        EVP_CIPHER_CTX_free(ctx_);
+        throw exception("Unable to create record sealer");
+    }
+}
+
+record_sealer::~record_sealer() {
+    EVP_CIPHER_CTX_free(ctx_);
+}
+
+bool record_sealer::seal(uint64_t seq, unsigned char type, const char* buf, size_t len, std::string& out) {
+    auto nonce = iv_;
+    for (int i = 0; i < 8; i++)
+        nonce[11 - i] ^= (unsigned char)(seq >> (8 * i));
+    size_t record_len = len + 1 + 16;
+    size_t at = out.size();
+    out.resize(at + 5 + record_len);
+    auto p = (unsigned char*)out.data() + at;
+    // TLS 1.3 records all claim to be TLS 1.2 application data
+    p[0] = SSL3_RT_APPLICATION_DATA;
+    p[1] = 3;
+    p[2] = 3;
+    p[3] = (unsigned char)(record_len >> 8);
+    p[4] = (unsigned char)record_len;
+    memcpy(p + 5, buf, len);
+    p[5 + len] = type;
+    int n = 0, m = 0;
+    bool ok = EVP_EncryptInit_ex(ctx_, nullptr, nullptr, nullptr, nonce.data()) == 1 &&
+              EVP_EncryptUpdate(ctx_, nullptr, &n, p, 5) == 1 &&
+              EVP_EncryptUpdate(ctx_, p + 5, &n, p + 5, (int)len + 1) == 1 &&
+              EVP_EncryptFinal_ex(ctx_, p + 5 + n, &m) == 1 &&
+              EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_GET_TAG, 16, p + 6 + len) == 1;
+    if (!ok) {
+        out.resize(at);
+        LOG_ERROR("ssl::record_sealer::seal: unable to seal record {}", seq);
+    }
+    return ok;
+}
+
+void context::set_buffer_sizes(size_t plaintext_chunk, size_t read_ahead) {
+    plaintext_chunk_ = plaintext_chunk ? plaintext_chunk : 16 * 1024;
+    SSL_CTX_set_read_ahead(handle_, read_ahead ? 1 : 0);
+    if (read_ahead)
+        SSL_CTX_set_default_read_buffer_len(handle_, read_ahead);
+}
+
+void context::enable_buffer_release() {
+    buffer_release_ = true;
+    SSL_CTX_set_mode(handle_, SSL_MODE_RELEASE_BUFFERS);
+}
+
+void context::enable_ktls() {
+    ktls_ = true;
+    traffic_secrets_index();
+    SSL_CTX_set_keylog_callback(handle_, keylog_cb);
+}
+
+void context::enable_tx_pipeline(std::shared_ptr<crypto_pool> pool, size_t batch) {
+    tx_pipeline_ = std::move(pool);
+    tx_batch_ = std::max<size_t>(batch, SSL3_RT_MAX_PLAIN_LENGTH);
+    traffic_secrets_index();
+    SSL_CTX_set_keylog_callback(handle_, keylog_cb);
+}
+
+static int servername_cb(SSL* ssl, int* alert, void* arg) {
+    auto ctx = context::from_handle(SSL_get_SSL_CTX(ssl));
+    const char* name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!ctx || !ctx->certs() || !name)
+        return SSL_TLSEXT_ERR_NOACK;
+    std::string hostname(name);
+    std::transform(hostname.begin(), hostname.end(), hostname.begin(), [](unsigned char c) { return std::tolower(c); });
+    try {
+        auto c = ctx->certs()->get(hostname);
+        if (SSL_use_certificate(ssl, c.first.handle()) == 1 && SSL_use_PrivateKey(ssl, c.second.handle()) == 1)
+            return SSL_TLSEXT_ERR_OK;
+        LOG_ERROR("ssl::servername_cb: unable to use cert for {}", hostname);
+    } catch (const std::exception& e) {
+        LOG_ERROR("ssl::servername_cb: unable to mint cert for {}: {}", hostname, e.what());
+    }
+    *alert = SSL_AD_INTERNAL_ERROR;
+    return SSL_TLSEXT_ERR_ALERT_FATAL;
+}
+
+void context::enable_sni_minting(std::shared_ptr<cert_cache> certs) {
+    certs_ = std::move(certs);
+    SSL_CTX_set_tlsext_servername_callback(handle_, servername_cb);
+}
+
+static int alpn_select_cb(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+                          const unsigned char* in, unsigned int inlen, void* arg) {
+    auto ctx = context::from_handle(SSL_get_SSL_CTX(ssl));
+    if (!ctx)
+        return SSL_TLSEXT_ERR_NOACK;
+    // server preference: first of ours the client offers
+    for (auto& p: ctx->alpn()) {
+        for (unsigned int i = 0; i < inlen; i += in[i] + 1) {
+            if (in[i] == p.size() && i + 1 + in[i] <= inlen && memcmp(in + i + 1, p.data(), p.size()) == 0) {
+                *out = in + i + 1;
+                *outlen = in[i];
+                return SSL_TLSEXT_ERR_OK;
+            }
+        }
+    }
+    LOG_DEBUG("ssl::alpn_select_cb: no common protocol");
+    return ctx->alpn_required() ? SSL_TLSEXT_ERR_ALERT_FATAL : SSL_TLSEXT_ERR_NOACK;
+}
+
+void context::set_alpn(const std::vector<std::string>& protocols, bool required) {
+    std::string wire; // length prefixed names
+    for (auto& p: protocols) {
+        if (p.empty() || p.size() > 255)
+            throw exception("Invalid ALPN protocol name: '" + p + "'");
+        wire += (char)p.size();
+        wire += p;
+    }
+    alpn_ = protocols;
+    alpn_required_ = required;
+    if (side_ == side_t::client) {
+        if (SSL_CTX_set_alpn_protos(handle_, (const unsigned char*)wire.data(), (unsigned)wire.size()) != 0)
+            throw exception("Unable to set ALPN protocols");
+    } else {
+        SSL_CTX_set_alpn_select_cb(handle_, protocols.empty() ? nullptr : alpn_select_cb, nullptr);
+    }
+}
+
+void context::enable_early_data(const early_data_policy& policy) {
+    early_data_ = true;
+    if (side_ == side_t::client)
+        return;
+    SSL_CTX_set_max_early_data(handle_, policy.max_size);
+    SSL_CTX_set_recv_max_early_data(handle_, policy.max_size);
+    if (policy.anti_replay) {
+        SSL_CTX_clear_options(handle_, SSL_OP_NO_ANTI_REPLAY);
+        // OpenSSL rejects all early data when there is no cache to track tickets in
+        if ((SSL_CTX_get_session_cache_mode(handle_) & SSL_SESS_CACHE_SERVER) == 0)
+            enable_session_cache();
+    } else {
+        SSL_CTX_set_options(handle_, SSL_OP_NO_ANTI_REPLAY);
+    }
+}
+
+std::shared_ptr<context> context::make_minting_server(std::shared_ptr<cert_cache> certs) {
+    auto result = std::make_shared<context>(side_t::server);
+    result->enable_sni_minting(std::move(certs));
+    return result;
+}
+
+BIO* stream_bio::make() {
+    static BIO_METHOD* method = []() {
+        auto m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "acpp-network stream");
+        BIO_meth_set_read(m, stream_bio::read);
+        BIO_meth_set_write(m, stream_bio::write);
+        BIO_meth_set_ctrl(m, stream_bio::ctrl);
+        BIO_meth_set_create(m, [](BIO* b) { BIO_set_init(b, 1); return 1; });
+        return m;
+    }();
+    auto result = BIO_new(method);
+    if (!result)
+        throw exception("Unable to create BIO");
+    BIO_set_data(result, this);
+    return result;
+}
+
+void stream_bio::input(const char* buf, size_t len) {
+    if (kept_.empty()) {
+        in_ = buf;
+        in_len_ = len;
+        in_kept_ = false;
+        return;
+    }
+    kept_.append(buf, len);
+    in_ = kept_.data();
+    in_len_ = kept_.size();
+    in_kept_ = true;
+}
+
+void stream_bio::done_input() {
+    if (in_kept_)
+        kept_.erase(0, kept_.size() - in_len_);
+    else
+        kept_.assign(in_, in_len_);
+    in_ = nullptr;
+    in_len_ = 0;
+    in_kept_ = false;
+}
+
+void stream_bio::release() {
+    if (kept_.empty())
+        std::string().swap(kept_);
+    if (out_.empty())
+        std::string().swap(out_);
+}
+
+void stream_bio::own_input() {
+    done_input();
+    input(nullptr, 0);
+}
+
+int stream_bio::read(BIO* b, char* buf, int len) {
+    auto self = static_cast<stream_bio*>(BIO_get_data(b));
+    BIO_clear_retry_flags(b);
+    if (!self->in_len_) {
+        BIO_set_retry_read(b);
+        return -1;
+    }
+    size_t n = std::min((size_t)len, self->in_len_);
+    memcpy(buf, self->in_, n);
+    self->in_ += n;
+    self->in_len_ -= n;
+    return (int)n;
+}
+
+int stream_bio::write(BIO* b, const char* buf, int len) {
+    auto self = static_cast<stream_bio*>(BIO_get_data(b));
+    BIO_clear_retry_flags(b);
+    if (self->discard_) {
+        self->discarded_ += len;
+        return len;
+    }
+    if (self->collect_ || !self->write_)
+        self->out_.append(buf, len);
+    else
+        self->write_(self->owner_, buf, len);
+    return len;
+}
+
+long stream_bio::ctrl(BIO* b, int cmd, long num, void* ptr) {
+    auto self = static_cast<stream_bio*>(BIO_get_data(b));
+    switch (cmd) {
+    case BIO_CTRL_FLUSH:
+        return 1;
+    case BIO_CTRL_PENDING:
+        return (long)self->in_len_;
+    default:
+        return 0;
+    }
+}
+
+ssl_stream_context::ssl_stream_context(acpp::network::async::io_context& io, side_t side, const std::string& hostname)
+:io_(io), side_(side), hostname_(hostname), 
+ context_(side == side_t::server ? context::default_server() : context::default_client())
+{
+}
+
+ssl_stream_context::ssl_stream_context(acpp::network::async::io_context& io, std::shared_ptr<context> ctx, const std::string& hostname)
+:io_(io), side_(ctx->side()), hostname_(hostname), context_(std::move(ctx))
+{
 }
 
 
@@ -0,0 +1,188 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include <acpp-network/websocket.h>
+#include <detail/common.h>
+#include <detail/cpu.h>
+
+namespace acpp::network::websocket {
+
+namespace {
+
+// The key as 8 bytes starting at `phase`: every kernel works on multiples of 4
+uint64_t key64(const mask_key& key, size_t phase) {
+    uint8_t k[8];
+    for (size_t i = 0; i < 8; i++)
+        k[i] = key[(phase + i) & 3];
+    uint64_t r;
+    std::memcpy(&r, k, 8);
+    return r;
+}
+
+// 8 bytes at a time, through memcpy to stay alignment and aliasing safe
+size_t mask_scalar(char* dst, const char* src, size_t len, const mask_key& key, size_t phase) {
+    auto k = key64(key, phase);
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, src + i, 8);
+        v ^= k;
+        std::memcpy(dst + i, &v, 8);
+    }
+    for (; i < len; i++)
+        dst[i] = src[i] ^ key[(phase + i) & 3];
+    return (phase + len) & 3;
+}
+
+#if ACPP_X86
+ACPP_TARGET("sse2")
+size_t mask_sse2(char* dst, const char* src, size_t len, const mask_key& key, size_t phase) {
+    auto k = _mm_set1_epi64x((long long)key64(key, phase));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        auto v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(v, k));
+    }
+    return mask_scalar(dst + i, src + i, len - i, key, (phase + i) & 3);
+}
+
+ACPP_TARGET("avx2")
+size_t mask_avx2(char* dst, const char* src, size_t len, const mask_key& key, size_t phase) {
+    auto k = _mm256_set1_epi64x((long long)key64(key, phase));
+    size_t i = 0;
+    // two blocks per round keep both load ports busy on long payloads
+    for (; i + 64 <= len; i += 64) {
+        auto a = _mm256_loadu_si256((const __m256i*)(src + i));
+        auto b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_xor_si256(b, k));
+    }
+    for (; i + 32 <= len; i += 32) {
+        auto v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(v, k));
+    }
+    // GCC does not add it for target functions: without it the SSE code
+    // that follows pays for the dirty upper halves
+    _mm256_zeroupper();
+    return mask_scalar(dst + i, src + i, len - i, key, (phase + i) & 3);
+}
+#endif
+
+using mask_fn = size_t (*)(char*, const char*, size_t, const mask_key&, size_t);
+
+http::simd detect() {
+    // SSE2 is part of x86-64, the sse42 level stands for it
+#if ACPP_X86
+    return detail::cpu_has_avx2() ? http::simd::avx2 : http::simd::sse42;
+#else
+    return http::simd::scalar;
+#endif
+}
+
+mask_fn kernel_for(http::simd level) {
+#if ACPP_X86
+    switch (level) {
+    case http::simd::avx2:  return mask_avx2;
+    case http::simd::sse42: return mask_sse2;
+    default:                break;
+    }
+#endif
+    return mask_scalar;
+}
+
+// Masking is one long pass over the payload, AVX2 wins as soon as there
+// are a few blocks (see WebsocketTests.mask_benchmark)
+const http::simd cpu_level = detect();
+http::simd current_level = cpu_level;
+mask_fn masker = kernel_for(current_level);
+
+// Ticks of a few dozen bytes go faster through the 64 bit loop than
+// through the vector setup
+constexpr size_t small = 128;
+
+std::string base64(const unsigned char* data, size_t len) {
+    std::string out(4 * ((len + 2) / 3), '\0');
+    EVP_EncodeBlock((unsigned char*)out.data(), data, (int)len);
+    return out;
+}
+
+} // namespace
+
+size_t mask(char* dst, const char* src, size_t len, const mask_key& key, size_t phase) {
+    if (len < small)
+        return mask_scalar(dst, src, len, key, phase);
+    return masker(dst, src, len, key, phase);
+}
+
+mask_key random_mask() {
+    mask_key key;
+    if (RAND_bytes(key.data(), (int)key.size()) != 1)
+        throw std::runtime_error("websocket: RAND_bytes failed");
+    return key;
+}
+
+http::simd mask_level() {
+    return current_level;
+}
+
+http::simd mask_level(http::simd level) {
+    current_level = std::min(level, cpu_level);
+    masker = kernel_for(current_level);
+    return current_level;
+}
+
+size_t write_frame_header(char* out, opcode op, bool fin, uint64_t len, const mask_key* key) {
+    auto p = (uint8_t*)out;
+    p[0] = (uint8_t)((fin ? 0x80 : 0) | (uint8_t)op);
+    uint8_t masked = key ? 0x80 : 0;
+    size_t n;
+    if (len < 126) {
+        p[1] = masked | (uint8_t)len;
+        n = 2;
+    } else if (len <= 0xffff) {
+        p[1] = masked | 126;
+        p[2] = (uint8_t)(len >> 8);
+        p[3] = (uint8_t)len;
+        n = 4;
+    } else {
+        p[1] = masked | 127;
+        for (int i = 0; i < 8; i++)
+            p[2 + i] = (uint8_t)(len >> (56 - 8 * i));
+        n = 10;
+    }
+    if (key) {
+        std::memcpy(p + n, key->data(), 4);
+        n += 4;
+    }
+    return n;
+}
+
+std::string make_client_key() {
+    unsigned char nonce[16];
+    if (RAND_bytes(nonce, sizeof(nonce)) != 1)
+        throw std::runtime_error("websocket: RAND_bytes failed");
+    return base64(nonce, sizeof(nonce));
+}
+
+std::string accept_key(std::string_view client_key) {
+    static constexpr std::string_view guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    std::string input;
+    input.reserve(client_key.size() + guid.size());
+    input.append(client_key).append(guid);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    if (!EVP_Digest(input.data(), input.size(), digest, &size, EVP_sha1(), nullptr))
+        throw std::runtime_error("websocket: SHA-1 failed");
+    return base64(digest, size);
+}
+
+} // namespace acpp::network::websocket
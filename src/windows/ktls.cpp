@@ -0,0 +1,25 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <acpp-network/ssl/ssl.h>
+
+// No kernel TLS here: streams keep OpenSSL's record layer.
+
+namespace acpp::network::ssl::ktls {
+
+bool enable_tx(int64_t fd, const traffic_keys& keys) {
+    return false;
+}
+
+bool send_close_notify(int64_t fd) {
+    return false;
+}
+
+int64_t sendfile(int64_t fd, int64_t in_fd, int64_t offset, size_t count) {
+    return -1;
+}
+
+} // namespace acpp::network::ssl::ktls
@@ -0,0 +1,106 @@
+//  Copyright Marcos Cambón-López 2025.
+
+// Distributed under the Mozilla Public License Version 2.0.
+//    (See accompanying file LICENSE or copy at
+//          https://www.mozilla.org/en-US/MPL/2.0/)
+
+#include <cassert>
+#include <new>
+#include <thread>
+
+#include <detail/numa.h>
+
+namespace acpp::network::detail {
+
+async::numa_topology detect_numa_topology() {
+    async::numa_topology result;
+    ULONG highest = 0;
+    GetNumaHighestNodeNumber(&highest);
+    for (USHORT node = 0; node <= highest; node++) {
+        GROUP_AFFINITY affinity = {};
+        if (!GetNumaNodeProcessorMaskEx(node, &affinity) || affinity.Group != 0)
+            continue;
+        async::numa_node n{node, {}};
+        for (int cpu = 0; cpu < (int)(sizeof(KAFFINITY) * 8); cpu++) {
+            if (affinity.Mask & ((KAFFINITY)1 << cpu))
+                n.cpus.push_back(cpu);
+        }
+        if (!n.cpus.empty())
+            result.nodes.push_back(std::move(n));
+    }
+    if (result.nodes.empty()) {
+        async::numa_node n{0, {}};
+        for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); cpu++)
+            n.cpus.push_back(cpu);
+        result.nodes.push_back(std::move(n));
+    }
+    return result;
+}
+
+bool pin_current_thread(int cpu) {
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+// Chunks are committed with VirtualAllocExNuma, whose pages are faulted in on
+// the preferred node regardless of the calling thread. They start on the
+// allocation granularity (64 KB), the largest alignment the pool above asks
+// its chunks for.
+class node_chunk_resource : public std::pmr::memory_resource {
+public:
+    explicit node_chunk_resource(int node): node_(node) {}
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        assert(alignment <= info.dwAllocationGranularity);
+        void* p = VirtualAllocExNuma(GetCurrentProcess(), nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+                                     node_ >= 0 ? (DWORD)node_ : NUMA_NO_PREFERRED_NODE);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        VirtualFree(p, 0, MEM_RELEASE);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    int node_;
+};
+
+class node_memory_resource : public std::pmr::memory_resource {
+public:
+    explicit node_memory_resource(int node)
+    : chunks_(node), pool_(std::pmr::pool_options{0, 64 * 1024}, &chunks_) {}
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return pool_.allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        pool_.deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    node_chunk_resource chunks_;
+    // sockets may be closed from threads other than the loop's
+    std::pmr::synchronized_pool_resource pool_;
+};
+
+std::unique_ptr<std::pmr::memory_resource> make_node_memory_resource(int node) {
+    return std::make_unique<node_memory_resource>(node);
+}
+
+bool set_incoming_cpu(int64_t fd, int cpu) {
+    return false;
+}
+
+} // namespace acpp::network::detail
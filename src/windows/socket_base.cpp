@@ -18,12 +18,14 @@
 
 #include <iostream>
 #include <sstream>
+#include <vector>
 #include <format>
 #include <algorithm>
 
 #include <detail/common.h>
 #include <acpp-network/address.h>
 #include <acpp-network/socket_base.h>
+#include <acpp-network/relay.h>
 
 
 namespace acpp::network {
@@ -225,6 +227,8 @@ public:
     int type_;
     int protocol_;
     //std::vector<char> pending_write_;
+    bool reading_ = true;
+    bool read_stopped_ = false; // paused with no WSARecv posted
 
     bool valid() { return fd_ != invalid_fd;}
 
@@ -336,7 +340,8 @@ public:
         auto& op = write_op;
         //op.type = operation_type::write;// TODO: not need to always set the type
         auto l = std::min(sizeof(op.buffer), len);
-        memcpy(op.buffer, buffer, l); 
+        if (buffer != op.buffer) // writev gathers in place
+            memcpy(op.buffer, buffer, l); 
         op.buf_info.buf = op.buffer;
         op.buf_info.len = l;
         op.in_use = true;
@@ -393,6 +398,21 @@ public:
         return n;
     }
 
+    // gathered into the single overlapped write buffer
+    size_t writev(const const_buffer* buffers, size_t count) {
+        if (write_op.in_use) {
+            LOG_DEBUG("async_socket_base writev: async_socket_base = true");
+            return 0;
+        }
+        size_t l = 0;
+        for (size_t i = 0; i < count && l < sizeof(write_op.buffer); i++) {
+            auto n = std::min(sizeof(write_op.buffer) - l, buffers[i].size);
+            memcpy(write_op.buffer + l, buffers[i].data, n);
+            l += n;
+        }
+        return internal_write(write_op.buffer, l);
+    }
+
 
     void close() {
         if (valid()) {
@@ -526,6 +546,23 @@ size_t async_socket_base::write(const char* buffer, size_t len) {
     return pimpl_->write(buffer, len);
 }
 
+size_t async_socket_base::writev(const const_buffer* buffers, size_t count) {
+    return pimpl_->writev(buffers, count);
+}
+
+// A receive already posted still completes once after pausing
+void async_socket_base::pause_reading() {
+    pimpl_->reading_ = false;
+}
+
+void async_socket_base::resume_reading() {
+    pimpl_->reading_ = true;
+    if (pimpl_->read_stopped_) {
+        pimpl_->read_stopped_ = false;
+        pimpl_->start_read();
+    }
+}
+
 class timer_impl {
 public:
     timer_impl(timer& parent, io_context& io, int milliseconds, timer::on_timeout_callback&& cb);
@@ -742,7 +779,10 @@ void io_context::wait_for_input() {
                 if(socket->callbacks_.on_received) {
                     socket->callbacks_.on_received(*socket->parent_, op.buf_info.buf, bytesTransferred);
                 }
-                socket->start_read();
+                if (socket->reading_)
+                    socket->start_read();
+                else
+                    socket->read_stopped_ = true;
             }
         } else if (operation->type == operation_type::write) {
             LOG_DEBUG("WRITE  .... bytesTransferred: {}", bytesTransferred);
@@ -828,6 +868,85 @@ void CALLBACK on_timer(PVOID lpParam, BOOLEAN TimerOrWaitFired)
     });
 }
 
+// No splice here: the bytes are copied. What a destination does not take is
+// kept until it can, and its source stops reading meanwhile
+struct relay_pimpl {
+    async_socket_base sockets_[2];
+    // bytes waiting to be sent to sockets_[i]
+    std::vector<char> pending_[2];
+    uint64_t bytes_[2] = {0, 0};
+    bool eof_[2] = {false, false};
+    relay* parent_;
+    relay::on_closed_callback on_closed_;
+    bool closed_ = false;
+
+    relay_pimpl(async_socket_base&& a, async_socket_base&& b, relay& parent, relay::on_closed_callback&& on_closed, relay_options)
+    : sockets_{std::move(a), std::move(b)}, parent_(&parent), on_closed_(std::move(on_closed)) {
+        for (int i = 0; i < 2; i++) {
+            sockets_[i].callbacks(socket_callbacks{
+                .on_disconnected = [this, i](async_socket_base&) { end_of_input(i); },
+                .on_received = [this, i](async_socket_base&, const char* buf, size_t len) {
+                    bytes_[i] += len;
+                    send(1 - i, buf, len);
+                },
+                .on_sent = [this, i](async_socket_base&, size_t) { send(i, nullptr, 0); },
+                .on_error = [this](async_socket_base&, int, const std::string&, const std::string&) { finish(); },
+            });
+        }
+    }
+
+    void send(int to, const char* buf, size_t len) {
+        auto& pending = pending_[to];
+        if (pending.empty()) {
+            auto n = len ? sockets_[to].write(buf, len) : 0;
+            pending.insert(pending.end(), buf + n, buf + len);
+        } else {
+            pending.insert(pending.end(), buf, buf + len);
+            auto n = sockets_[to].write(pending.data(), pending.size());
+            pending.erase(pending.begin(), pending.begin() + n);
+            if (pending.empty() && !eof_[1 - to])
+                sockets_[1 - to].resume_reading();
+        }
+        if (!pending.empty())
+            sockets_[1 - to].pause_reading();
+        if (pending.empty() && eof_[1 - to])
+            ::shutdown((int)sockets_[to].fd(), SD_SEND);
+    }
+
+    void end_of_input(int i) {
+        if (eof_[i])
+            return;
+        eof_[i] = true;
+        if (pending_[1 - i].empty())
+            ::shutdown((int)sockets_[1 - i].fd(), SD_SEND);
+        if (eof_[0] && eof_[1])
+            finish();
+    }
+
+    void finish() {
+        if (closed_)
+            return;
+        closed_ = true;
+        for (auto& s: sockets_)
+            s.close();
+        if (on_closed_)
+            on_closed_(*parent_);
+    }
+};
+
+relay::relay(async_socket_base&& a, async_socket_base&& b, on_closed_callback&& on_closed, relay_options options)
+: pimpl_(std::make_unique<relay_pimpl>(std::move(a), std::move(b), *this, std::move(on_closed), options)) {}
+
+relay::~relay() {}
+
+relay_stats relay::stats() const {
+    return {pimpl_->bytes_[0], pimpl_->bytes_[1], false};
+}
+
+bool relay::closed() const {
+    return pimpl_->closed_;
+}
+
 } //namespace async
 
 } // namespace acpp::network 
\ No newline at end of file
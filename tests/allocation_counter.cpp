@@ -0,0 +1,67 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to count the heap allocations of
+// each thread. Only allocation_tests links it, and it is a translation unit
+// of its own so that no new-expression sees malloc and free inlined.
+
+namespace {
+
+thread_local size_t allocations = 0;
+
+void* counted(size_t size) {
+    allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void* counted(size_t size, std::align_val_t alignment) {
+    allocations++;
+    auto a = (size_t)alignment;
+    return std::aligned_alloc(a, (size + a - 1) / a * a);
+}
+
+}
+
+size_t thread_allocations() {
+    return allocations;
+}
+
+void* operator new(size_t size) {
+    if (auto p = counted(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (auto p = counted(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
@@ -0,0 +1,86 @@
+#include <atomic>
+#include <cstring>
+#include <memory_resource>
+#include <thread>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/framing.h>
+#include <acpp-network/stream_server.h>
+
+#include <detail/common.h>
+
+// A binary of its own: allocation_counter.cpp replaces the global allocation
+// functions
+
+int port = 9080;
+
+// heap allocations of this thread so far (allocation_counter.cpp)
+size_t thread_allocations();
+
+// Connections one after the other from a blocking client: once the free
+// list and the loop's pool resource are warm, an accept allocates nothing.
+TEST(AllocationTests, stream_server_recycle)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<framing_layer<socket_stream>>;
+
+    constexpr size_t warmup = 20, measured = 200;
+    // the loop's slabs go back to it when the io_context is destroyed
+    std::pmr::unsynchronized_pool_resource pool;
+    io_context io;
+    io.placement(-1, -1, &pool);
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    stream_context c(io, side_t::server, "");
+    stream_server<stream_t> server(c, adr, {.max_sessions = 4});
+
+    size_t before = 0, after = 0;
+    server.on_created_ = [&](stream_t& s) {
+        s.on_received_cb_ = [&s](const char* buf, size_t len) { s.write(buf, len); };
+    };
+    server.on_open_ = [&](stream_t&) {
+        if (server.stats().accepted == warmup)
+            before = thread_allocations();
+        if (server.stats().accepted == warmup + measured)
+            after = thread_allocations();
+    };
+
+    std::atomic<bool> ok = true;
+    std::thread client([&]() {
+        for (size_t i = 0; i < warmup + measured; i++) {
+            sync::socket_base s;
+            s.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (!s.connect(to_sockaddr(adr))) {
+                ok = false;
+                break;
+            }
+            char frame[] = {4, 'p', 'i', 'n', 'g'};
+            char echo[sizeof(frame)];
+            ::send((int)s.fd(), frame, sizeof(frame), 0);
+            size_t got = 0;
+            while (got < sizeof(echo)) {
+                auto n = ::recv((int)s.fd(), echo + got, sizeof(echo) - got, 0);
+                if (n <= 0)
+                    break;
+                got += n;
+            }
+            ok = ok && got == sizeof(frame) && !memcmp(echo, frame, sizeof(frame));
+            s.close();
+        }
+        io.exec([&]() { io.stop(); });
+    });
+    timer guard(io, 20000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    client.join();
+
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(server.stats().accepted, warmup + measured);
+    EXPECT_LE(server.stats().created, 4u);
+    EXPECT_EQ(after - before, 0u);
+}
@@ -3,6 +3,18 @@
 #include <thread>
 #include <random>
 #include <format>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include <gtest/gtest.h> // googletest header file  
 
@@ -10,6 +22,7 @@
 #include <acpp-network/socket.inl>
 #include <detail/common.h>
 
+extern int port;
 
 TEST(AsyncSocketTests, simple_client_server)
 {
@@ -562,3 +575,229 @@ TEST(AsyncSocketTests, buffered_writer_test)
     //bw.flush(0);
     //EXPECT_EQ(bw.buffered_size(), 0);
 }
+
+
+// Two sockets readable in the same epoll_wait batch: the first handler
+// destroys the other socket, whose event must then be dropped
+TEST(AsyncSocketTests, destroyed_in_batch)
+{
+    using namespace acpp::network;
+    using namespace acpp::network::async;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    std::vector<std::unique_ptr<async_socket_base>> accepted;
+    size_t received = 0;
+    async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                accepted.emplace_back(std::make_unique<async_socket_base>(std::move(s)));
+                accepted.back()->callbacks(socket_callbacks {
+                    .on_received = [&](async_socket_base& s, const char*, size_t) {
+                        received++;
+                        for (auto& other: accepted)
+                            if (other.get() != &s)
+                                other.reset();
+                    }
+                });
+                if (accepted.size() == 2)
+                    io.stop();
+            }
+        });
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(2);
+
+    sync::socket_base clients[2];
+    for (auto& c: clients) {
+        c.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        ASSERT_TRUE(c.connect(to_sockaddr(adr)));
+    }
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    ASSERT_EQ(accepted.size(), 2u);
+
+    for (auto& c: clients)
+        ::send((int)c.fd(), "x", 1, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    timer done(io, 200, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    EXPECT_EQ(received, 1u);
+}
+
+// The peer sends and resets while reading is paused: nothing comes up
+// until resume_reading, then what is left does
+TEST(AsyncSocketTests, hang_up_while_paused)
+{
+    using namespace acpp::network;
+    using namespace acpp::network::async;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    std::unique_ptr<async_socket_base> accepted;
+    bool paused = false;
+    size_t while_paused = 0, after = 0;
+    auto event = [&]() {
+        if (paused)
+            while_paused++;
+        else if (after++ == 0)
+            io.exec([&]() { io.stop(); });
+    };
+    async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                accepted = std::make_unique<async_socket_base>(std::move(s));
+                accepted->callbacks(socket_callbacks {
+                    .on_disconnected = [&](async_socket_base&) { event(); },
+                    .on_received = [&](async_socket_base&, const char*, size_t) { event(); },
+                    .on_error = [&](async_socket_base&, int, const std::string&, const std::string&) { event(); },
+                });
+                accepted->pause_reading();
+                paused = true;
+                io.stop();
+            }
+        });
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    sync::socket_base client;
+    client.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ASSERT_TRUE(client.connect(to_sockaddr(adr)));
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    ASSERT_TRUE(accepted);
+
+    ::send((int)client.fd(), "data", 4, 0);
+    linger l{1, 0};
+    setsockopt((int)client.fd(), SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+    client.close();
+    timer resume(io, 200, [&](timer&) {
+        paused = false;
+        accepted->resume_reading();
+    });
+    io.wait_for_input();
+
+    EXPECT_EQ(while_paused, 0u);
+    EXPECT_GT(after, 0u);
+}
+
+namespace {
+
+// Last level cache misses of this thread in user space, when the hardware
+// counters are there (not in most VMs)
+class cache_misses {
+public:
+    cache_misses() {
+#if defined(__linux__)
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~cache_misses() {
+#if defined(__linux__)
+        if (fd_ != -1)
+            ::close(fd_);
+#endif
+    }
+
+    bool available() const { return fd_ != -1; }
+    void start() {
+#if defined(__linux__)
+        if (fd_ != -1)
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+    void stop() {
+#if defined(__linux__)
+        if (fd_ != -1)
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+    uint64_t count() const {
+        uint64_t n = 0;
+#if defined(__linux__)
+        if (fd_ != -1 && ::read(fd_, &n, sizeof(n)) != sizeof(n))
+            n = 0;
+#endif
+        return n;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+}
+
+// Many connections, each with heap objects of its own allocated next to its
+// socket (as a session would), and a quarter of them readable per round: the
+// loop's cost per event, in time and, where the counters exist, cache misses.
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=AsyncSocketTests.DISABLED_event_locality_benchmark
+TEST(AsyncSocketTests, DISABLED_event_locality_benchmark)
+{
+    using namespace acpp::network;
+    using namespace acpp::network::async;
+
+    constexpr size_t n = 2000, rounds = 200;
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    std::vector<async_socket_base> accepted;
+    std::vector<std::unique_ptr<std::array<char, 480>>> sessions;
+    accepted.reserve(n);
+    size_t received = 0, expected = 0;
+    async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                sessions.emplace_back(std::make_unique<std::array<char, 480>>());
+                accepted.emplace_back(std::move(s));
+                accepted.back().callbacks(socket_callbacks {
+                    .on_received = [&](async_socket_base&, const char*, size_t len) {
+                        received += len;
+                        if (received == expected)
+                            io.stop();
+                    }
+                });
+                if (accepted.size() == n)
+                    io.stop();
+            }
+        });
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen((int)n);
+
+    std::vector<sync::socket_base> clients(n);
+    for (auto& c: clients) {
+        c.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        ASSERT_TRUE(c.connect(to_sockaddr(adr)));
+    }
+    timer guard(io, 20000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    ASSERT_EQ(accepted.size(), n);
+
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++)
+        order[i] = i;
+    std::mt19937 rng(3);
+    cache_misses misses;
+    std::chrono::nanoseconds elapsed{0};
+    for (size_t r = 0; r < rounds; r++) {
+        std::shuffle(order.begin(), order.end(), rng);
+        for (size_t i = 0; i < n / 4; i++)
+            ::send((int)clients[order[i]].fd(), "x", 1, 0);
+        expected += n / 4;
+        auto start = std::chrono::steady_clock::now();
+        misses.start();
+        io.wait_for_input();
+        misses.stop();
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+    EXPECT_EQ(received, expected);
+    std::cout << "⏱️  " << expected << " events over " << n << " sockets: " << elapsed.count() / expected << " ns/event, ";
+    if (misses.available())
+        std::cout << (double)misses.count() / expected << " cache misses/event" << std::endl;
+    else
+        std::cout << "no cache miss counter here" << std::endl;
+}
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/broadcast.h>
+#include <acpp-network/ssl/ssl.h>
+#include <acpp-network/ssl/ssl.inl>
+
+#include <detail/common.h>
+
+extern int port;
+
+namespace {
+
+size_t heap() {
+#if defined(__GLIBC__)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+double cpu_ms() {
+    return 1000.0 * std::clock() / CLOCKS_PER_SEC;
+}
+
+void small_buffers(int64_t fd) {
+    int size = 4096;
+    setsockopt((int)fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt((int)fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+// `n` server sessions, each connected to a plain socket of this process that
+// counts what it receives
+template<typename Stream>
+struct subscribers {
+    using stream_type = Stream;
+
+    // stops the loop once the n sessions are there, when `stop`
+    template<typename Context>
+    subscribers(acpp::network::async::io_context& io, size_t n, Context& c, bool stop)
+    : io_(io), adr_(acpp::network::ip4_sockaddress("127.0.0.1", port++)),
+      listener_(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        acpp::network::async::socket_callbacks {
+            .on_accepted = [this, n, &c, stop](acpp::network::async::async_socket_base&, acpp::network::async::async_socket_base&& s) {
+                small_buffers(s.fd());
+                sessions_.emplace_back(std::make_unique<Stream>(c));
+                sessions_.back()->last().socket(std::move(s));
+                if (sessions_.size() == n && stop)
+                    io_.stop();
+            }
+        }) {
+        listener_.bind(to_sockaddr(adr_));
+        listener_.listen(4096);
+    }
+
+    acpp::network::async::io_context& io_;
+    acpp::network::ip_socketaddress adr_;
+    acpp::network::async::async_socket_base listener_;
+    std::vector<std::unique_ptr<Stream>> sessions_;
+};
+
+}
+
+// The message is released once the last subscriber's socket has taken it,
+// not before; until then the queues share it.
+TEST(BroadcastTests, lifetime)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<socket_stream>;
+
+    constexpr size_t n = 50;
+    io_context io;
+    stream_context sc(io, side_t::server, "");
+    subscribers<stream_t> subs(io, n, sc, true);
+
+    std::vector<std::unique_ptr<async_socket_base>> clients;
+    size_t received = 0;
+    for (size_t i = 0; i < n; i++) {
+        clients.emplace_back(std::make_unique<async_socket_base>(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+            socket_callbacks {
+                .on_received = [&](async_socket_base&, const char*, size_t len) {
+                    received += len;
+                    if (received == n * 1024 * 1024)
+                        io.stop();
+                },
+            }));
+        small_buffers(clients.back()->fd());
+        clients.back()->connect(to_sockaddr(subs.adr_));
+    }
+    timer guard(io, 10000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    ASSERT_EQ(subs.sessions_.size(), n);
+
+    std::string text(1024 * 1024, 'x');
+    bool released = false;
+    for (auto& c: clients)
+        c->pause_reading();
+    auto message = iobuf::wrap(text.data(), text.size(), [&]() { released = true; });
+    auto stats = broadcast(subs.sessions_, message);
+    message.clear();
+    EXPECT_EQ(stats.destinations, n);
+    EXPECT_EQ(stats.queued, n);
+    EXPECT_FALSE(released);
+
+    for (auto& c: clients)
+        c->resume_reading();
+    io.wait_for_input();
+    EXPECT_EQ(received, n * text.size());
+    EXPECT_TRUE(released);
+}
+
+// Serialized once, encrypted per subscriber
+TEST(BroadcastTests, tls)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<ssl::stream<socket_stream>>;
+
+    constexpr size_t n = 20;
+    io_context io;
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    ssl::ssl_stream_context sc(io, ssl::context::make_server(c.first, c.second));
+    subscribers<stream_t> subs(io, n, sc, false);
+
+    std::vector<std::unique_ptr<stream_t>> clients;
+    std::vector<std::string> received(n);
+    size_t connected = 0, done = 0;
+    std::string text(300000, 'x');
+    for (size_t i = 0; i < text.size(); i++)
+        text[i] = (char)(i * 11 + (i >> 8));
+    for (size_t i = 0; i < n; i++) {
+        ssl::ssl_stream_context cc(io, side_t::client, "localhost");
+        clients.emplace_back(std::make_unique<stream_t>(cc));
+        clients.back()->on_connected_cb_ = [&]() {
+            if (++connected == n)
+                io.stop();
+        };
+        clients.back()->on_received_cb_ = [&, i](const char* buf, size_t len) {
+            received[i].append(buf, len);
+            if (received[i].size() == text.size() && ++done == n)
+                io.stop();
+        };
+        clients.back()->last().connect(subs.adr_);
+    }
+    timer guard(io, 20000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    ASSERT_EQ(connected, n);
+
+    auto stats = broadcast(subs.sessions_, iobuf::copy(text.data(), text.size()));
+    EXPECT_EQ(stats.destinations, n);
+    io.wait_for_input();
+    EXPECT_EQ(done, n);
+    for (auto& r: received)
+        EXPECT_TRUE(r == text);
+}
+
+// One 64 KB message to 10k subscribers that are not reading, as a copy per
+// queue and as a shared iobuf: the heap it takes and the CPU time of the
+// fan-out, then of the delivery.
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=BroadcastTests.DISABLED_subscribers_benchmark
+TEST(BroadcastTests, DISABLED_subscribers_benchmark)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<socket_stream>;
+
+    // two descriptors per subscriber
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    size_t n = std::min<size_t>(10000, (limit.rlim_cur - 64) / 2);
+    constexpr size_t size = 64 * 1024;
+
+    io_context io;
+    stream_context sc(io, side_t::server, "");
+    subscribers<stream_t> subs(io, n, sc, true);
+    std::vector<std::unique_ptr<async_socket_base>> clients;
+    size_t received = 0, expected = 0;
+    for (size_t i = 0; i < n; i++) {
+        clients.emplace_back(std::make_unique<async_socket_base>(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+            socket_callbacks {
+                .on_received = [&](async_socket_base&, const char*, size_t len) {
+                    received += len;
+                    if (received == expected)
+                        io.stop();
+                },
+            }));
+        small_buffers(clients.back()->fd());
+        clients.back()->connect(to_sockaddr(subs.adr_));
+    }
+    timer guard(io, 120000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    ASSERT_EQ(subs.sessions_.size(), n);
+
+    std::string text(size, 'm');
+    for (auto shared: {false, true}) {
+        for (auto& c: clients)
+            c->pause_reading();
+        auto heap_before = heap();
+        auto cpu_before = cpu_ms();
+        size_t queued = 0;
+        if (shared) {
+            queued = broadcast(subs.sessions_, iobuf::copy(text.data(), text.size())).queued;
+        } else {
+            for (auto& s: subs.sessions_) {
+                s->write(text.data(), text.size());
+                queued += s->pending_output() != 0;
+            }
+        }
+        auto fan_out_ms = cpu_ms() - cpu_before;
+        // the first round's slice tables are reused, the heap may even shrink
+        auto heap_growth = std::max(heap(), heap_before) - heap_before;
+
+        expected += n * size;
+        cpu_before = cpu_ms();
+        for (auto& c: clients)
+            c->resume_reading();
+        io.wait_for_input();
+        auto delivery_ms = cpu_ms() - cpu_before;
+        EXPECT_EQ(received, expected);
+        EXPECT_GT(queued, 0u);
+        std::cout << "⏱️  broadcast " << size / 1024 << " KB to " << n << " subscribers, " << (shared ? "shared iobuf" : "copy per queue")
+                  << ": heap +" << heap_growth / 1024 << " KB, " << queued << " queued, fan-out " << fan_out_ms
+                  << " ms CPU, delivery " << delivery_ms << " ms CPU" << std::endl;
+        if (shared) {
+            EXPECT_LT(heap_growth, n * size / 4);
+        }
+    }
+}
@@ -0,0 +1,192 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/framing.h>
+#include <acpp-network/ssl/ssl.h>
+#include <acpp-network/ssl/ssl.inl>
+
+#include <detail/common.h>
+
+extern int port;
+
+namespace {
+
+std::string prefix(acpp::network::async::length_prefix p, uint64_t size) {
+    using acpp::network::async::length_prefix;
+    std::string result;
+    if (p == length_prefix::varint) {
+        do {
+            result.push_back((char)((size & 0x7f) | (size >= 0x80 ? 0x80 : 0)));
+            size >>= 7;
+        } while (size);
+        return result;
+    }
+    size_t width = p == length_prefix::fixed8 ? 1 : p == length_prefix::fixed16 ? 2 : p == length_prefix::fixed32 ? 4 : 8;
+    for (size_t i = 0; i < width; i++)
+        result.push_back((char)(size >> 8 * (width - 1 - i)));
+    return result;
+}
+
+}
+
+// Frames fed in one buffer, byte by byte and split at random points
+TEST(FramingTests, receive)
+{
+    using namespace acpp::network::async;
+    using stream_t = stream<framing_layer<layer<>>>;
+
+    for (auto p: {length_prefix::varint, length_prefix::fixed16, length_prefix::fixed64}) {
+        std::vector<std::string> frames;
+        std::string wire;
+        for (size_t size: {0, 1, 127, 128, 300, 20000, 5}) {
+            frames.push_back(std::string(size, (char)('a' + frames.size())));
+            wire += prefix(p, size) + frames.back();
+        }
+
+        stream_t s(acpp::network::side_t::client);
+        s.next().options({.prefix = p});
+        std::vector<std::string> received;
+        std::vector<const char*> views;
+        s.on_received_cb_ = [&](const char* buf, size_t len) {
+            received.emplace_back(buf, len);
+            views.push_back(buf);
+        };
+        auto last = s.last();
+
+        // whole: every frame is a view into the buffer
+        last.on_received<stream_t::chain_type>(wire.data(), wire.size());
+        EXPECT_EQ(received, frames);
+        EXPECT_EQ(s.next().stats().copied, 0u);
+        for (auto v: views)
+            EXPECT_TRUE(v >= wire.data() && v <= wire.data() + wire.size());
+
+        // byte by byte
+        received.clear();
+        for (size_t i = 0; i < wire.size(); i++)
+            last.on_received<stream_t::chain_type>(wire.data() + i, 1);
+        EXPECT_EQ(received, frames);
+
+        // random splits: only the frames crossing a split are copied
+        std::mt19937 gen(7);
+        for (int round = 0; round < 20; round++) {
+            received.clear();
+            auto copied = s.next().stats().copied;
+            size_t pos = 0;
+            while (pos < wire.size()) {
+                size_t n = std::min(wire.size() - pos, (size_t)std::uniform_int_distribution<>(1, 8000)(gen));
+                last.on_received<stream_t::chain_type>(wire.data() + pos, n);
+                pos += n;
+            }
+            EXPECT_EQ(received, frames);
+            EXPECT_LT(s.next().stats().copied - copied, frames.size());
+        }
+        EXPECT_FALSE(s.next().failed());
+        // the assembly buffer is kept for the next split frame
+        EXPECT_LE(s.next().memory_footprint(), 20000 + framing_layer<>::max_header);
+    }
+}
+
+TEST(FramingTests, max_frame)
+{
+    using namespace acpp::network::async;
+    using stream_t = stream<framing_layer<layer<>>>;
+
+    stream_t s(acpp::network::side_t::client);
+    s.next().options({.max_frame = 1000});
+    size_t count = 0;
+    s.on_received_cb_ = [&](const char*, size_t) { count++; };
+    auto last = s.last();
+
+    std::string wire = prefix(length_prefix::varint, 3) + "abc" + prefix(length_prefix::varint, 1001) + std::string(1001, 'x');
+    last.on_received<stream_t::chain_type>(wire.data(), wire.size());
+    EXPECT_EQ(count, 1u);
+    EXPECT_TRUE(s.next().failed());
+    // nothing goes up after the bad frame
+    last.on_received<stream_t::chain_type>(wire.data(), 4);
+    EXPECT_EQ(count, 1u);
+
+    // varint longer than 64 bits
+    stream_t s2(acpp::network::side_t::client);
+    std::string bad(11, (char)0xff);
+    s2.last().on_received<stream_t::chain_type>(bad.data(), bad.size());
+    EXPECT_TRUE(s2.next().failed());
+
+    // frames the prefix can not hold are not sent
+    s2.next().options({.prefix = length_prefix::fixed8});
+    std::string big(256, 'x');
+    EXPECT_EQ(s2.write(big.data(), big.size()), 0u);
+}
+
+// Messages, single and gathered, echoed back frame by frame
+template <typename Stream>
+void framed_echo() {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server_ctx = ssl::context::make_server(c.first, c.second);
+
+    std::vector<std::string> messages;
+    for (size_t size: {1, 100, 16 * 1024, 70000, 0, 3})
+        messages.push_back(std::string(size, (char)('a' + messages.size())));
+    std::string head("head:"), tail(":tail");
+    messages.push_back(head + messages[1] + tail);
+
+    std::unique_ptr<Stream> session;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<Stream>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    session->write(buf, len);
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context cc(io, side_t::client, "localhost");
+    Stream client(cc);
+    std::vector<std::string> received;
+    client.on_connected_cb_ = [&]() {
+        for (size_t i = 0; i + 1 < messages.size(); i++)
+            client.write(messages[i].data(), messages[i].size());
+        const_buffer parts[] = {{head.data(), head.size()}, {messages[1].data(), messages[1].size()}, {tail.data(), tail.size()}};
+        client.writev(parts, 3);
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t len) {
+        received.emplace_back(buf, len);
+        if (received.size() == messages.size())
+            io.stop();
+    };
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(received, messages);
+}
+
+TEST(FramingTests, socket_stream)
+{
+    using namespace acpp::network::async;
+    framed_echo<stream<framing_layer<socket_stream>>>();
+}
+
+TEST(FramingTests, ssl_stream)
+{
+    using namespace acpp::network::async;
+    framed_echo<stream<framing_layer<::acpp::network::ssl::stream<socket_stream>>>>();
+}
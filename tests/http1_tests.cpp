@@ -0,0 +1,383 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/http1.h>
+#include <acpp-network/ssl/ssl.h>
+#include <acpp-network/ssl/ssl.inl>
+
+#include <detail/common.h>
+
+extern int port;
+
+namespace {
+
+using namespace acpp::network;
+
+// Messages as the parser hands them out, heads copied
+struct recorder : public http::parser::handler {
+    struct item {
+        std::string method, target, reason;
+        int status = 0;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+        bool keep_alive = false;
+        bool ended = false;
+    };
+    void on_head(http::message& m) override {
+        item i{std::string(m.method), std::string(m.target), std::string(m.reason), m.status};
+        for (auto& h: m.headers)
+            i.headers.emplace_back(h.name, h.value);
+        i.keep_alive = m.keep_alive;
+        items.push_back(std::move(i));
+        views.push_back(m.method.empty() ? m.reason.data() : m.method.data());
+    }
+    void on_body(const char* buf, size_t len) override {
+        items.back().body.append(buf, len);
+    }
+    void on_end() override {
+        items.back().ended = true;
+    }
+    std::vector<item> items;
+    std::vector<const char*> views;
+};
+
+// Feeds `wire` in pieces of `step` bytes, keeping incomplete heads like http1_layer
+void feed(http::parser& p, recorder& r, const std::string& wire, size_t step) {
+    std::string pending;
+    for (size_t pos = 0; pos < wire.size(); pos += step) {
+        pending.append(wire, pos, step);
+        auto n = p.parse(pending.data(), pending.size(), r);
+        pending.erase(0, n);
+        if (p.status() == http::parser::state::error)
+            return;
+    }
+}
+
+const std::string requests =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: example.org\r\n"
+    "User-Agent: test  \r\n"
+    "\r\n"
+    "POST /upload HTTP/1.1\r\n"
+    "Host: example.org\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "5;ext=1\r\nhello\r\n"
+    "7\r\n, world\r\n"
+    "0\r\n"
+    "X-Checksum: 1\r\n"
+    "\r\n"
+    "PUT /item HTTP/1.0\r\n"
+    "content-length: 3\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "abc"
+    "DELETE /item HTTP/1.1\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+void check_requests(const recorder& r) {
+    ASSERT_EQ(r.items.size(), 4u);
+    EXPECT_EQ(r.items[0].method, "GET");
+    EXPECT_EQ(r.items[0].target, "/index.html");
+    ASSERT_EQ(r.items[0].headers.size(), 2u);
+    EXPECT_EQ(r.items[0].headers[1].second, "test");
+    EXPECT_EQ(r.items[1].body, "hello, world");
+    EXPECT_EQ(r.items[2].body, "abc");
+    EXPECT_TRUE(r.items[2].keep_alive);
+    EXPECT_FALSE(r.items[3].keep_alive);
+    for (auto& i: r.items)
+        EXPECT_TRUE(i.ended);
+}
+
+}
+
+// Pipelined requests in one buffer, then split at every size, with each kernel
+TEST(Http1Tests, requests)
+{
+    auto saved = http::scan_level();
+    for (auto level: {http::simd::scalar, http::simd::sse42, http::simd::avx2}) {
+        if (http::scan_level(level) != level)
+            continue;
+        http::parser p(side_t::server);
+        recorder r;
+        EXPECT_EQ(p.parse(requests.data(), requests.size(), r), requests.size());
+        check_requests(r);
+        // heads are views into the input
+        for (auto v: r.views)
+            EXPECT_TRUE(v >= requests.data() && v < requests.data() + requests.size());
+
+        for (size_t step = 1; step < 64; step++) {
+            http::parser p(side_t::server);
+            recorder r;
+            feed(p, r, requests, step);
+            check_requests(r);
+        }
+    }
+    http::scan_level(saved);
+}
+
+TEST(Http1Tests, responses)
+{
+    std::string wire =
+        "HTTP/1.1 100 Continue\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello"
+        "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n"     // HEAD: no body
+        "HTTP/1.1 204 No Content\r\n\r\n"
+        "HTTP/1.0 200 OK\r\n\r\nuntil the end";
+    http::parser p(side_t::client);
+    p.sent_request("POST");
+    p.sent_request("HEAD");
+    p.sent_request("DELETE");
+    p.sent_request("GET");
+    recorder r;
+    EXPECT_EQ(p.parse(wire.data(), wire.size(), r), wire.size());
+    EXPECT_EQ(p.status(), http::parser::state::until_close);
+    EXPECT_TRUE(p.close(r));
+    ASSERT_EQ(r.items.size(), 5u);
+    EXPECT_EQ(r.items[0].status, 100);
+    EXPECT_EQ(r.items[1].body, "hello");
+    EXPECT_EQ(r.items[2].body, "");
+    EXPECT_TRUE(r.items[2].ended);
+    EXPECT_EQ(r.items[3].status, 204);
+    EXPECT_EQ(r.items[4].body, "until the end");
+    EXPECT_TRUE(r.items[4].ended);
+
+    // 101: what follows is not HTTP
+    std::string upgrade = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n\r\n\x81\x02hi";
+    http::parser u(side_t::client);
+    u.sent_request("GET");
+    recorder ru;
+    EXPECT_EQ(u.parse(upgrade.data(), upgrade.size(), ru), upgrade.size() - 4);
+    EXPECT_EQ(u.status(), http::parser::state::upgraded);
+}
+
+TEST(Http1Tests, errors)
+{
+    const char* bad[] = {
+        "GET /a HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+        "POST /a HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "POST /a HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+        "GET /a HTTP/1.1\r\nBad Name: x\r\n\r\n",
+        "GET /a HTTP/1.1\r\nName: x\x01y\r\n\r\n",
+        "GET /a HTTP/1.1\r\n folded\r\n\r\n",
+        "GET /a HTTP/2.0\r\n\r\n",
+        "G(T /a HTTP/1.1\r\n\r\n",
+        "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    };
+    for (auto b: bad) {
+        http::parser p(side_t::server);
+        recorder r;
+        p.parse(b, std::strlen(b), r);
+        EXPECT_EQ(p.status(), http::parser::state::error) << b;
+    }
+
+    http::parser p(side_t::server, {.max_head = 100});
+    recorder r;
+    std::string big = "GET /a HTTP/1.1\r\nX: " + std::string(200, 'x');
+    EXPECT_EQ(p.parse(big.data(), big.size(), r), 0u);
+    EXPECT_EQ(p.status(), http::parser::state::error);
+}
+
+// Keep-alive requests, one chunked, answered by a server over the layer chain
+template <typename Stream>
+void http_exchange() {
+    using namespace acpp::network::async;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server_ctx = ssl::context::make_server(c.first, c.second);
+
+    std::unique_ptr<Stream> session;
+    std::string request_body;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<Stream>(c);
+                session->last().socket(std::move(accepted_socket));
+                auto& h1 = session->next();
+                h1.on_head_cb_ = [&](const http::message& m) {
+                    request_body.clear();
+                };
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    request_body.append(buf, len);
+                };
+                h1.on_end_cb_ = [&]() {
+                    std::string body = "got " + std::to_string(request_body.size());
+                    session->next().response(200, "OK", {{"Content-Type", "text/plain"}}, body.size());
+                    session->write(body.data(), body.size());
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context cc(io, side_t::client, "localhost");
+    Stream client(cc);
+    std::vector<std::string> bodies;
+    std::string body;
+    std::string upload(100000, 'u');
+    client.on_connected_cb_ = [&]() {
+        auto& h1 = client.next();
+        h1.request("GET", "/", {{"Host", "localhost"}});
+        client.flush();
+        h1.request("POST", "/upload", {{"Host", "localhost"}}, -1);
+        client.write(upload.data(), 60000);
+        client.write(upload.data() + 60000, 40000);
+        client.write(nullptr, 0);
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t len) {
+        body.append(buf, len);
+    };
+    client.next().on_end_cb_ = [&]() {
+        bodies.push_back(body);
+        body.clear();
+        if (bodies.size() == 2)
+            io.stop();
+    };
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(bodies, (std::vector<std::string>{"got 0", "got 100000"}));
+}
+
+TEST(Http1Tests, socket_stream)
+{
+    using namespace acpp::network::async;
+    http_exchange<stream<http::http1_layer<socket_stream>>>();
+}
+
+TEST(Http1Tests, ssl_stream)
+{
+    using namespace acpp::network::async;
+    http_exchange<stream<http::http1_layer<ssl::stream<socket_stream>>>>();
+}
+
+// A 204 started as chunked ends with its head: the empty write that ends
+// the body sends nothing, and the next response follows right after
+TEST(Http1Tests, bodiless_response)
+{
+    using namespace acpp::network::async;
+    using session_t = stream<http::http1_layer<socket_stream>>;
+    using raw_t = stream<socket_stream>;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::unique_ptr<session_t> session;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base&, async::async_socket_base&& accepted_socket) {
+                stream_context c(io, side_t::server, "");
+                session = std::make_unique<session_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->next().on_end_cb_ = [&]() {
+                    auto& h1 = session->next();
+                    h1.response(204, "No Content", {}, -1);
+                    session->write(nullptr, 0);
+                    h1.response(200, "OK", {}, 2);
+                    session->write("ok", 2);
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    stream_context cc(io, side_t::client, "");
+    raw_t client(cc);
+    std::string wire;
+    client.on_connected_cb_ = [&]() {
+        std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        client.write(request.data(), request.size());
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t len) {
+        wire.append(buf, len);
+        if (wire.ends_with("ok"))
+            io.stop();
+    };
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(wire, "HTTP/1.1 204 No Content\r\n\r\n"
+                    "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+}
+
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=Http1Tests.DISABLED_parse_benchmark
+TEST(Http1Tests, DISABLED_parse_benchmark)
+{
+    // a browser navigation and an API response, as seen in the wild
+    const std::string browser =
+        "GET /wp-content/uploads/2010/03/hello-kitty-darth-vader-pink.jpg HTTP/1.1\r\n"
+        "Host: www.kittyhell.com\r\n"
+        "User-Agent: Mozilla/5.0 (Macintosh; U; Intel Mac OS X 10.6; ja-JP-mac; rv:1.9.2.3) Gecko/20100401 Firefox/3.6.3 Pathtraq/0.9\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: ja,en-us;q=0.7,en;q=0.3\r\n"
+        "Accept-Encoding: gzip,deflate\r\n"
+        "Accept-Charset: Shift_JIS,utf-8;q=0.7,*;q=0.7\r\n"
+        "Keep-Alive: 115\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: wp_ozh_wsa_visits=2; wp_ozh_wsa_visit_lasttime=xxxxxxxxxx; __utma=xxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.xxxxxxxxxx.x; "
+        "__utmz=xxxxxxxxx.xxxxxxxxxx.x.x.utmccn=(referral)|utmcsr=reader.livedoor.com|utmcct=/reader/|utmcmd=referral\r\n"
+        "\r\n";
+    const std::string api =
+        "HTTP/1.1 200 OK\r\n"
+        "Date: Mon, 27 Jul 2009 12:28:53 GMT\r\n"
+        "Server: Apache/2.2.14 (Win32)\r\n"
+        "Last-Modified: Wed, 22 Jul 2009 19:15:56 GMT\r\n"
+        "ETag: \"34aa387-d-1568eb00\"\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "Cache-Control: private, max-age=0, must-revalidate\r\n"
+        "Strict-Transport-Security: max-age=31536000; includeSubDomains\r\n"
+        "X-Request-Id: 4b0f7c6e-92c5-4a3c-9d3e-0f1b2a3c4d5e\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n";
+
+    auto saved = http::scan_level();
+    std::pair<const char*, http::simd> levels[] = {{"scalar", http::simd::scalar}, {"sse4.2", http::simd::sse42}, {"avx2", http::simd::avx2}};
+    for (auto [set, wire, side]: {std::tuple{"browser request", &browser, side_t::server}, std::tuple{"api response", &api, side_t::client}}) {
+        // pipelined copies, parsed in one go
+        std::string input;
+        while (input.size() < 1024 * 1024)
+            input += *wire;
+        size_t messages = input.size() / wire->size();
+        for (auto [name, level]: levels) {
+            if (http::scan_level(level) != level)
+                continue;
+            struct counter : public http::parser::handler {
+                void on_head(http::message& m) override { headers += m.headers.size(); }
+                void on_body(const char*, size_t) override {}
+                void on_end() override { n++; }
+                size_t n = 0, headers = 0;
+            } h;
+            http::parser p(side);
+            auto start_time = std::chrono::steady_clock::now();
+            size_t rounds = 0;
+            while (std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(300)) {
+                for (size_t i = 0; i < messages; i++)
+                    p.sent_request("GET");
+                p.parse(input.data(), input.size(), h);
+                rounds++;
+            }
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+            EXPECT_EQ(h.n, rounds * messages);
+            std::cout << "⏱️  " << set << ", " << name << ": " << (double)rounds * input.size() / us << " MB/s, "
+                      << rounds * messages * 1.0 / us << " M messages/s" << std::endl;
+        }
+    }
+    http::scan_level(saved);
+}
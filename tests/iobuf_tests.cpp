@@ -0,0 +1,233 @@
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/iobuf.h>
+#include <acpp-network/framing.h>
+
+#include <detail/common.h>
+
+extern int port;
+
+namespace {
+
+// The bottom of a chain that keeps what is written as iobufs
+class capture {
+public:
+    enum {it = 0,};
+    using chain_type = std::tuple<capture*>;
+    using last_type = capture;
+
+    capture(acpp::network::side_t) {}
+    void* prev_;
+
+    template<typename Chain>
+    size_t write(const acpp::network::async::iobuf& buf) {
+        written_.push_back(buf);
+        return buf.size();
+    }
+
+    template<typename Chain>
+    size_t writev(const acpp::network::async::const_buffer* buffers, size_t count) {
+        acpp::network::async::iobuf buf;
+        for (size_t i = 0; i < count; i++)
+            buf.append(buffers[i].data, buffers[i].size);
+        return write<Chain>(buf);
+    }
+
+    size_t pending_output() const { return 0; }
+    size_t memory_footprint() const { return 0; }
+
+    std::vector<acpp::network::async::iobuf> written_;
+};
+
+}
+
+TEST(IobufTests, share)
+{
+    using namespace acpp::network::async;
+
+    std::string text(100000, 'x');
+    for (size_t i = 0; i < text.size(); i++)
+        text[i] = (char)('a' + i % 26);
+
+    auto a = iobuf::copy(text.data(), text.size(), 16);
+    EXPECT_EQ(a.size(), text.size());
+    EXPECT_EQ(a.to_string(), text);
+    auto first = a.piece(0).data;
+
+    // a header fits the headroom of a block no one else holds
+    a.prepend("HEAD", 4);
+    EXPECT_EQ(a.piece(0).data, first - 4);
+    EXPECT_EQ(a.to_string(), "HEAD" + text);
+    a.consume(4);
+
+    // copies share the bytes
+    iobuf b(a);
+    EXPECT_EQ(b.pieces(), a.pieces());
+    for (size_t i = 0; i < a.pieces(); i++)
+        EXPECT_EQ(b.piece(i).data, a.piece(i).data);
+
+    // a shared block is not written: the header and the tail get their own
+    b.prepend("HEAD", 4);
+    b.append("TAIL", 4);
+    EXPECT_EQ(b.pieces(), a.pieces() + 2);
+    EXPECT_EQ(b.piece(1).data, a.piece(0).data);
+    EXPECT_EQ(b.to_string(), "HEAD" + text + "TAIL");
+    EXPECT_EQ(a.to_string(), text);
+
+    // split in the middle of a piece: both halves hold the block
+    auto front = a.split(5000);
+    EXPECT_EQ(front.to_string(), text.substr(0, 5000));
+    EXPECT_EQ(a.to_string(), text.substr(5000));
+    EXPECT_EQ(a.piece(0).data, front.piece(0).data + 5000);
+
+    // appending an iobuf takes its pieces, not its bytes
+    iobuf c;
+    c.append(front);
+    c.append(std::move(a));
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ(c.to_string(), text);
+    EXPECT_EQ(c.piece(0).data, front.piece(0).data);
+
+    // the slice table stays for the next appends until it is shrunk
+    c.clear();
+    EXPECT_GT(c.memory_footprint(), 0u);
+    EXPECT_LT(c.memory_footprint(), iobuf_pool::small_block);
+    c.shrink_to_fit();
+    EXPECT_EQ(c.memory_footprint(), 0u);
+}
+
+// A socket that takes a random part of what it is offered, every time
+TEST(IobufTests, partial_writes)
+{
+    using namespace acpp::network::async;
+
+    auto pattern = [](size_t i) { return (char)(i * 31 + (i >> 9)); };
+    std::vector<char> data(1024 * 1024);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = pattern(i);
+
+    iobuf q;
+    std::mt19937 rng(7);
+    size_t appended = 0, consumed = 0;
+    std::vector<char> out;
+    const_buffer pieces[4];
+    while (consumed < data.size()) {
+        if (appended < data.size()) {
+            auto n = std::min<size_t>(rng() % (3 * iobuf_pool::large_block / 2), data.size() - appended);
+            q.append(data.data() + appended, n);
+            appended += n;
+        }
+        EXPECT_EQ(q.size(), appended - consumed);
+        auto count = q.fill(pieces, 4);
+        size_t offered = 0;
+        for (size_t i = 0; i < count; i++) {
+            out.insert(out.end(), pieces[i].data, pieces[i].data + pieces[i].size);
+            offered += pieces[i].size;
+        }
+        auto n = offered ? rng() % (offered + 1) : 0;
+        out.resize(consumed + n);
+        q.consume(n);
+        consumed += n;
+    }
+    EXPECT_TRUE(q.empty());
+    EXPECT_TRUE(out == data);
+    // the blocks are back in the pool, the empty chain holds its slice table
+    EXPECT_LT(q.memory_footprint(), iobuf_pool::small_block);
+    EXPECT_GT(iobuf_pool::local().size(), 0u);
+    q.shrink_to_fit();
+    EXPECT_EQ(q.memory_footprint(), 0u);
+}
+
+TEST(IobufTests, pool)
+{
+    using namespace acpp::network::async;
+
+    const char* data;
+    {
+        auto a = iobuf::copy("hello", 5);
+        data = a.piece(0).data;
+    }
+    // the block comes back for the next buffer of its size
+    auto b = iobuf::copy("world", 5);
+    EXPECT_EQ(b.piece(0).data, data);
+    EXPECT_GE(b.memory_footprint(), iobuf_pool::small_block);
+}
+
+// The frame prefix goes in front of the body's blocks, the body is not copied
+TEST(IobufTests, framing)
+{
+    using namespace acpp::network::async;
+    using stream_t = stream<framing_layer<capture>>;
+
+    stream_t s(acpp::network::side_t::client);
+    std::string body(300, 'b');
+    auto buf = iobuf::copy(body.data(), body.size());
+    EXPECT_EQ(s.write(buf), body.size());
+
+    auto& written = s.next().next().written_;
+    ASSERT_EQ(written.size(), 1u);
+    EXPECT_EQ(written[0].to_string(), "\xac\x02" + body);
+    EXPECT_EQ(written[0].piece(written[0].pieces() - 1).data, buf.piece(0).data);
+}
+
+// One message written to several connections: each socket_stream keeps a
+// share of what its socket does not take yet.
+TEST(IobufTests, fan_out)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<framing_layer<socket_stream>>;
+
+    constexpr size_t n = 4;
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::string text(8 * 1024 * 1024, 'x');
+    for (size_t i = 0; i < text.size(); i++)
+        text[i] = (char)(i * 7 + (i >> 10));
+    auto message = iobuf::copy(text.data(), text.size());
+
+    std::vector<std::unique_ptr<stream_t>> sessions;
+    async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                stream_context c(io, side_t::server, "");
+                sessions.emplace_back(std::make_unique<stream_t>(c));
+                sessions.back()->next().options({.max_frame = text.size()});
+                sessions.back()->last().socket(std::move(s));
+                sessions.back()->write(message);
+            }
+        });
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen((int)n);
+
+    std::vector<std::unique_ptr<stream_t>> clients;
+    size_t done = 0;
+    for (size_t i = 0; i < n; i++) {
+        stream_context c(io, side_t::client, "");
+        clients.emplace_back(std::make_unique<stream_t>(c));
+        clients.back()->next().options({.max_frame = text.size()});
+        clients.back()->on_received_cb_ = [&](const char* buf, size_t len) {
+            EXPECT_TRUE(std::string_view(buf, len) == text);
+            if (++done == n)
+                io.stop();
+        };
+        clients.back()->last().connect(adr);
+    }
+    timer guard(io, 10000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(done, n);
+    for (auto& s: sessions)
+        EXPECT_EQ(s->pending_output(), 0u);
+}
@@ -0,0 +1,95 @@
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+#include <future>
+#include <vector>
+#include <cstring>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/io_context_pool.h>
+#include <detail/common.h>
+#include <detail/numa.h>
+
+
+TEST(NumaTests, topology)
+{
+    using namespace acpp::network::async;
+    auto& t = numa_topology::detect();
+    ASSERT_FALSE(t.nodes.empty());
+    EXPECT_GT(t.cpu_count(), 0);
+    for (auto& n: t.nodes) {
+        for (auto cpu: n.cpus) {
+            EXPECT_EQ(t.node_of_cpu(cpu), n.id);
+        }
+    }
+}
+
+// The pool asks its mmap chunks for alignments up to 64 KB
+TEST(NumaTests, aligned_chunks)
+{
+    using namespace acpp::network;
+    auto mr = detail::make_node_memory_resource(0);
+    ASSERT_TRUE(mr);
+    std::vector<std::pair<void*, size_t>> blocks;
+    for (size_t size: {64, 4096, 40000, 65536, 300000}) {
+        for (size_t alignment: {8, 64, 4096, 65536}) {
+            auto p = mr->allocate(size, alignment);
+            EXPECT_EQ((uintptr_t)p % alignment, 0u) << size << " bytes, aligned to " << alignment;
+            memset(p, 1, size);
+            blocks.push_back({p, size});
+        }
+    }
+    size_t i = 0;
+    for (size_t size: {64, 4096, 40000, 65536, 300000})
+        for (size_t alignment: {8, 64, 4096, 65536})
+            mr->deallocate(blocks[i++].first, size, alignment);
+}
+
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_filter=NumaTests.placement
+TEST(NumaTests, placement)
+{
+    using namespace acpp::network::async;
+    io_context_pool pool(io_context_pool_config{.size = 2});
+    ASSERT_EQ(pool.size(), 2);
+    pool.start();
+
+    for (size_t i = 0; i < pool.size(); i++) {
+        auto& io = pool.at(i);
+        auto expected = pool.placement(i);
+        EXPECT_EQ(io.cpu(), expected.cpu);
+        EXPECT_EQ(io.numa_node(), expected.numa_node);
+
+        std::promise<std::pair<int, void*>> done;
+        io.exec([&]() {
+            constexpr size_t size = 256 * 1024;
+            auto p = static_cast<char*>(io.memory_resource()->allocate(size, 64));
+            memset(p, 1, size); // first touch from the loop thread
+            done.set_value({sched_getcpu(), p});
+        });
+        auto [cpu, p] = done.get_future().get();
+        EXPECT_EQ(cpu, expected.cpu);
+
+        int node = -1;
+        ASSERT_EQ(syscall(SYS_get_mempolicy, &node, nullptr, 0, p, MPOL_F_NODE | MPOL_F_ADDR), 0);
+        EXPECT_EQ(node, expected.numa_node);
+
+        void* page = (void*)((uintptr_t)p & ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1));
+        int status = -1;
+        ASSERT_EQ(syscall(SYS_move_pages, 0, 1, &page, nullptr, &status, 0), 0);
+        EXPECT_EQ(status, expected.numa_node);
+
+        io.memory_resource()->deallocate(p, 256 * 1024, 64);
+    }
+
+    async_socket_base listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, pool.at(0));
+    EXPECT_TRUE(pool.steer_listener(listener, 0));
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    getsockopt(listener.fd(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len);
+    EXPECT_EQ(cpu, pool.placement(0).cpu);
+
+    pool.stop();
+}
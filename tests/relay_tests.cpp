@@ -0,0 +1,357 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/relay.h>
+#include <acpp-network/ssl/ssl.h>
+#include <acpp-network/ssl/ssl.inl>
+
+#include <detail/common.h>
+
+extern int port;
+
+namespace {
+
+char pattern(uint64_t i) {
+    return (char)(i * 7 + (i >> 11));
+}
+
+}
+
+// client -> proxy (relay) -> backend. The client sends 1 MB and half-closes;
+// the backend sends 32 MB the client reads only after a while, then
+// half-closes too. Both ends see the whole stream and its end.
+TEST(RelayTests, splice)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    constexpr uint64_t upload = 1024 * 1024;
+    constexpr uint64_t download = 32 * 1024 * 1024;
+
+    io_context io;
+    ip_socketaddress proxy_adr = ip4_sockaddress("127.0.0.1", port++);
+    ip_socketaddress backend_adr = ip4_sockaddress("127.0.0.1", port++);
+
+    // backend: a source that counts what it receives
+    std::unique_ptr<async_socket_base> backend;
+    std::atomic<uint64_t> backend_sent = 0, backend_received = 0;
+    std::atomic<bool> backend_eof = false;
+    bool upload_ok = true;
+    std::vector<char> chunk(64 * 1024);
+    auto produce = [&]() {
+        while (backend_sent < download) {
+            auto n = std::min<uint64_t>(chunk.size(), download - backend_sent);
+            for (uint64_t i = 0; i < n; i++)
+                chunk[i] = pattern(backend_sent + i);
+            auto sent = backend->write(chunk.data(), n);
+            backend_sent += sent;
+            if (sent < n)
+                return;
+        }
+        ::shutdown((int)backend->fd(), SHUT_WR);
+    };
+    async_socket_base backend_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                backend = std::make_unique<async_socket_base>(std::move(s));
+                backend->callbacks(socket_callbacks{
+                    .on_disconnected = [&](async_socket_base&) { backend_eof = true; },
+                    .on_received = [&](async_socket_base&, const char* buf, size_t len) {
+                        for (size_t i = 0; i < len; i++)
+                            upload_ok = upload_ok && buf[i] == pattern(backend_received + i);
+                        backend_received += len;
+                    },
+                    .on_sent = [&](async_socket_base&, size_t) { produce(); },
+                });
+                produce();
+            }
+        });
+    backend_listener.bind(to_sockaddr(backend_adr));
+    backend_listener.listen(1);
+
+    // proxy: relays each accepted connection to the backend
+    std::unique_ptr<async_socket_base> accepted, upstream;
+    std::unique_ptr<relay> r;
+    relay_stats stats;
+    async_socket_base proxy_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                accepted = std::make_unique<async_socket_base>(std::move(s));
+                upstream = std::make_unique<async_socket_base>(AF_INET, SOCK_STREAM, IPPROTO_TCP, io);
+                upstream->callbacks(socket_callbacks{
+                    .on_connected = [&](async_socket_base&) {
+                        // not from inside the upstream's own callback
+                        io.exec([&]() {
+                            r = std::make_unique<relay>(std::move(*accepted), std::move(*upstream), [&](relay& r) {
+                                stats = r.stats();
+                                io.stop();
+                            });
+                        });
+                    },
+                });
+                upstream->connect(to_sockaddr(backend_adr));
+            }
+        });
+    proxy_listener.bind(to_sockaddr(proxy_adr));
+    proxy_listener.listen(1);
+
+    std::thread loop([&]() { io.wait_for_input(); });
+
+    // a blocking client
+    sync::socket_base client;
+    client.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ASSERT_TRUE(client.connect(to_sockaddr(proxy_adr)));
+    std::vector<char> out(upload);
+    for (uint64_t i = 0; i < upload; i++)
+        out[i] = pattern(i);
+    for (size_t pos = 0; pos < out.size();) {
+        auto n = ::send((int)client.fd(), out.data() + pos, out.size() - pos, 0);
+        ASSERT_GT(n, 0);
+        pos += n;
+    }
+    ::shutdown((int)client.fd(), SHUT_WR);
+
+    // nobody reads the download yet: the relay holds back the backend
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_LT(backend_sent.load(), download);
+
+    uint64_t received = 0;
+    bool download_ok = true;
+    std::vector<char> in(256 * 1024);
+    while (true) {
+        auto n = ::recv((int)client.fd(), in.data(), in.size(), 0);
+        if (n <= 0)
+            break;
+        for (ssize_t i = 0; i < n; i++)
+            download_ok = download_ok && in[i] == pattern(received + i);
+        received += n;
+    }
+    client.close();
+    loop.join();
+
+    EXPECT_EQ(received, download);
+    EXPECT_TRUE(download_ok);
+    EXPECT_EQ(backend_received.load(), upload);
+    EXPECT_TRUE(upload_ok);
+    EXPECT_TRUE(backend_eof.load());
+    EXPECT_EQ(stats.a_to_b, upload);
+    EXPECT_EQ(stats.b_to_a, download);
+#ifdef __linux__
+    EXPECT_TRUE(stats.spliced);
+#endif
+}
+
+// The client half-closes, then resets: its socket has no events of interest
+// left, but epoll keeps reporting the error, which ends the relay
+TEST(RelayTests, reset_after_half_close)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    io_context io;
+    ip_socketaddress proxy_adr = ip4_sockaddress("127.0.0.1", port++);
+    ip_socketaddress backend_adr = ip4_sockaddress("127.0.0.1", port++);
+
+    // a backend that never answers
+    std::unique_ptr<async_socket_base> backend;
+    async_socket_base backend_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                backend = std::make_unique<async_socket_base>(std::move(s));
+            }
+        });
+    backend_listener.bind(to_sockaddr(backend_adr));
+    backend_listener.listen(1);
+
+    std::unique_ptr<async_socket_base> accepted, upstream;
+    std::unique_ptr<relay> r;
+    std::atomic<bool> relaying = false;
+    bool closed = false;
+    async_socket_base proxy_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                accepted = std::make_unique<async_socket_base>(std::move(s));
+                upstream = std::make_unique<async_socket_base>(AF_INET, SOCK_STREAM, IPPROTO_TCP, io);
+                upstream->callbacks(socket_callbacks{
+                    .on_connected = [&](async_socket_base&) {
+                        io.exec([&]() {
+                            r = std::make_unique<relay>(std::move(*accepted), std::move(*upstream), [&](relay&) {
+                                closed = true;
+                                io.stop();
+                            });
+                            relaying = true;
+                        });
+                    },
+                });
+                upstream->connect(to_sockaddr(backend_adr));
+            }
+        });
+    proxy_listener.bind(to_sockaddr(proxy_adr));
+    proxy_listener.listen(1);
+
+    std::thread client([&]() {
+        sync::socket_base s;
+        s.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (!s.connect(to_sockaddr(proxy_adr)))
+            return;
+        while (!relaying)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ::shutdown((int)s.fd(), SHUT_WR);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        linger l{1, 0};
+        setsockopt((int)s.fd(), SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+        s.close();
+    });
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    client.join();
+
+    EXPECT_TRUE(closed);
+}
+
+// The client resets before the relay is made: the relay ends from its
+// constructor, and on_closed can already ask it for its stats
+TEST(RelayTests, closed_before_relaying)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    io_context io;
+    ip_socketaddress proxy_adr = ip4_sockaddress("127.0.0.1", port++);
+    ip_socketaddress backend_adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::unique_ptr<async_socket_base> backend;
+    async_socket_base backend_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                backend = std::make_unique<async_socket_base>(std::move(s));
+            }
+        });
+    backend_listener.bind(to_sockaddr(backend_adr));
+    backend_listener.listen(1);
+
+    std::unique_ptr<async_socket_base> accepted, upstream;
+    std::unique_ptr<relay> r;
+    std::atomic<bool> reset = false;
+    bool closed = false;
+    relay_stats stats{1, 1, false};
+    async_socket_base proxy_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                accepted = std::make_unique<async_socket_base>(std::move(s));
+                upstream = std::make_unique<async_socket_base>(AF_INET, SOCK_STREAM, IPPROTO_TCP, io);
+                upstream->callbacks(socket_callbacks{
+                    .on_connected = [&](async_socket_base&) {
+                        io.exec([&]() {
+                            while (!reset)
+                                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                            r = std::make_unique<relay>(std::move(*accepted), std::move(*upstream), [&](relay& r) {
+                                closed = true;
+                                stats = r.stats();
+                                io.exec([&]() { io.stop(); });
+                            });
+                        });
+                    },
+                });
+                upstream->connect(to_sockaddr(backend_adr));
+            }
+        });
+    proxy_listener.bind(to_sockaddr(proxy_adr));
+    proxy_listener.listen(1);
+
+    std::thread client([&]() {
+        sync::socket_base s;
+        s.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s.connect(to_sockaddr(proxy_adr))) {
+            linger l{1, 0};
+            setsockopt((int)s.fd(), SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+            s.close();
+        }
+        reset = true;
+    });
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    client.join();
+
+    EXPECT_TRUE(closed);
+    EXPECT_EQ(stats.a_to_b, 0u);
+    EXPECT_EQ(stats.b_to_a, 0u);
+}
+
+// TLS terminated at the proxy: the plaintext is copied to a plain backend
+TEST(RelayTests, stream_relay)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using tls_t = stream<ssl::stream<socket_stream>>;
+    using plain_t = stream<socket_stream>;
+
+    io_context io;
+    ip_socketaddress proxy_adr = ip4_sockaddress("127.0.0.1", port++);
+    ip_socketaddress backend_adr = ip4_sockaddress("127.0.0.1", port++);
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server_ctx = ssl::context::make_server(c.first, c.second);
+
+    // echo backend
+    std::unique_ptr<plain_t> backend;
+    async_socket_base backend_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                stream_context c(io, side_t::server, "");
+                backend = std::make_unique<plain_t>(c);
+                backend->last().socket(std::move(s));
+                backend->on_received_cb_ = [&](const char* buf, size_t len) { backend->write(buf, len); };
+            }
+        });
+    backend_listener.bind(to_sockaddr(backend_adr));
+    backend_listener.listen(1);
+
+    std::unique_ptr<tls_t> front;
+    std::unique_ptr<plain_t> upstream;
+    std::unique_ptr<stream_relay<tls_t, plain_t>> r;
+    async_socket_base proxy_listener(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                front = std::make_unique<tls_t>(c);
+                front->last().socket(std::move(s));
+                stream_context uc(io, side_t::client, "");
+                upstream = std::make_unique<plain_t>(uc);
+                r = std::make_unique<stream_relay<tls_t, plain_t>>(*front, *upstream);
+                upstream->last().connect(backend_adr);
+            }
+        });
+    proxy_listener.bind(to_sockaddr(proxy_adr));
+    proxy_listener.listen(1);
+
+    std::string message(200000, 'm');
+    std::string received;
+    ssl::ssl_stream_context cc(io, side_t::client, "localhost");
+    tls_t client(cc);
+    client.on_connected_cb_ = [&]() { client.write(message.data(), message.size()); };
+    client.on_received_cb_ = [&](const char* buf, size_t len) {
+        received.append(buf, len);
+        if (received.size() == message.size())
+            io.stop();
+    };
+    client.last().connect(proxy_adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(received, message);
+    ASSERT_TRUE(r);
+    EXPECT_EQ(r->stats().a_to_b, message.size());
+    EXPECT_EQ(r->stats().b_to_a, message.size());
+    EXPECT_FALSE(r->stats().spliced);
+}
@@ -0,0 +1,273 @@
+#include <iostream>
+#include <thread>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/ssl/ssl.h>
+
+#include <openssl/x509.h>
+#include <openssl/bn.h>
+#include <openssl/x509v3.h>
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+
+#include <detail/common.h>
+
+using namespace acpp::network;
+
+static std::string serial_of(ssl::x509& cert) {
+    auto bn = ASN1_INTEGER_to_BN(X509_get_serialNumber(cert.handle()), nullptr);
+    auto hex = BN_bn2hex(bn);
+    std::string result(hex);
+    OPENSSL_free(hex);
+    BN_free(bn);
+    return result;
+}
+
+TEST(SslTests, key_types)
+{
+    for (auto spec: {ssl::key_spec{ssl::key_type::rsa, 2048}, ssl::key_spec{ssl::key_type::ecdsa_p256},
+                     ssl::key_spec{ssl::key_type::ed25519}}) {
+        auto ca = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("ca"), spec);
+        EXPECT_EQ(X509_verify(ca.first.handle(), ca.second.handle()), 1);
+
+        // leaf of a different key type than its issuer
+        auto leaf = ssl::x509::create_signed_cert(ca.first, ca.second, ssl::x509::Name().cn("leaf"),
+                                                  ssl::key_spec{ssl::key_type::ecdsa_p256});
+        EXPECT_EQ(X509_verify(leaf.first.handle(), ca.second.handle()), 1);
+    }
+    auto rsa3072 = ssl::pkey::generate({ssl::key_type::rsa, 3072});
+    EXPECT_EQ(EVP_PKEY_get_bits(rsa3072.handle()), 3072);
+}
+
+TEST(SslTests, serials_unique_across_threads)
+{
+    std::mutex m;
+    std::set<std::string> serials;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 25; i++) {
+                auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("s"), {ssl::key_type::ed25519});
+                auto serial = serial_of(c.first);
+                std::lock_guard<std::mutex> l(m);
+                serials.insert(serial);
+            }
+        });
+    }
+    for (auto& t: threads)
+        t.join();
+    EXPECT_EQ(serials.size(), 100);
+}
+
+TEST(SslTests, cert_cache_lru)
+{
+    std::atomic<int> minted = 0;
+    ssl::cert_cache cache([&](const std::string& hostname) {
+        minted++;
+        return ssl::x509::create_self_signed_cert(ssl::x509::Name().cn(hostname), {ssl::key_type::ed25519});
+    }, 2);
+
+    auto a = cache.get("a.test");
+    EXPECT_EQ(cache.get("a.test").first.handle(), a.first.handle());
+    cache.get("b.test");
+    cache.get("a.test");  // b is now the least recently used
+    cache.get("c.test");
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(minted, 3);
+    cache.get("a.test");
+    EXPECT_EQ(minted, 3);
+    cache.get("b.test");
+    EXPECT_EQ(minted, 4);
+
+    auto stats = cache.stats();
+    EXPECT_EQ(stats.misses, 4);
+    EXPECT_EQ(stats.hits, 3);
+    EXPECT_EQ(stats.evictions, 2);
+
+    ssl::cert_cache failing([](const std::string&) -> ssl::cert_cache::entry {
+        throw ssl::exception("no");
+    });
+    EXPECT_THROW(failing.get("a.test"), ssl::exception);
+    EXPECT_EQ(failing.size(), 0);
+}
+
+TEST(SslTests, cert_cache_merges_concurrent_misses)
+{
+    auto ca = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("ca"), {ssl::key_type::ecdsa_p256});
+    std::atomic<int> minted = 0;
+    ssl::cert_cache cache([&](const std::string& hostname) {
+        minted++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        return ssl::x509::create_signed_cert(ca.first, ca.second, ssl::x509::Name().cn(hostname), {ssl::key_type::ecdsa_p256});
+    });
+
+    std::vector<std::thread> threads;
+    std::vector<X509*> certs(8);
+    for (size_t t = 0; t < certs.size(); t++) {
+        threads.emplace_back([&, t]() {
+            certs[t] = cache.get("host.test").first.handle();
+        });
+    }
+    for (auto& t: threads)
+        t.join();
+    EXPECT_EQ(minted, 1);
+    for (auto c: certs)
+        EXPECT_EQ(c, certs[0]);
+    EXPECT_EQ(cache.stats().misses, 1);
+    EXPECT_EQ(cache.stats().hits + cache.stats().merged, certs.size() - 1);
+
+    ssl::cert_cache signed_by_ca(ca.first, ca.second);
+    auto leaf = signed_by_ca.get("leaf.test");
+    EXPECT_EQ(X509_verify(leaf.first.handle(), ca.second.handle()), 1);
+    EXPECT_EQ(X509_check_host(leaf.first.handle(), "leaf.test", 0, 0, nullptr), 1);
+}
+
+TEST(SslTests, key_pool)
+{
+    ssl::key_pool pool({ssl::key_type::ed25519}, 4, 64);
+    for (int i = 0; i < 500 && pool.stats().depth < 4; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_EQ(pool.stats().depth, 4);
+    EXPECT_EQ(pool.stats().stalls, 0);
+
+    auto key = pool.take();
+    EXPECT_EQ(EVP_PKEY_get_id(key.handle()), EVP_PKEY_ED25519);
+
+    // drain faster than one worker refills: stalls grow the target
+    for (int i = 0; i < 200; i++)
+        pool.take();
+    auto stats = pool.stats();
+    EXPECT_GT(stats.stalls, 0);
+    EXPECT_GT(stats.target, 4);
+    EXPECT_EQ(stats.taken, 201);
+
+    auto ca = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("ca"), {ssl::key_type::ecdsa_p256});
+    auto leaf = ssl::x509::create_signed_cert(ca.first, ca.second, ssl::x509::Name().cn("leaf"), pool.take());
+    EXPECT_EQ(X509_verify(leaf.first.handle(), ca.second.handle()), 1);
+    EXPECT_EQ(X509_check_private_key(leaf.first.handle(), leaf.second.handle()), 1);
+}
+
+// What kernel TLS does with the keys: one TLS 1.3 application data record
+static std::string seal_record(const ssl::traffic_keys& keys, const std::string& data) {
+    std::string record;
+    ssl::record_sealer sealer(keys);
+    EXPECT_TRUE(sealer.seal(keys.seq, SSL3_RT_APPLICATION_DATA, data.data(), data.size(), record));
+    EXPECT_EQ(record.size(), data.size() + ssl::record_sealer::overhead);
+    return record;
+}
+
+static std::string drain(BIO* bio) {
+    std::string result;
+    char buf[4096];
+    int n;
+    while ((n = BIO_read(bio, buf, sizeof(buf))) > 0)
+        result.append(buf, n);
+    return result;
+}
+
+TEST(SslTests, ktls_traffic_keys)
+{
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    for (auto suite: {"TLS_AES_128_GCM_SHA256", "TLS_AES_256_GCM_SHA384", "TLS_CHACHA20_POLY1305_SHA256"}) {
+        auto server = ssl::context::make_server(c.first, c.second);
+        server->enable_ktls();
+        ssl::context client(side_t::client);
+        client.enable_ktls();
+        SSL_CTX_set_ciphersuites(client.handle(), suite);
+
+        auto cs = SSL_new(client.handle()), ss = SSL_new(server->handle());
+        BIO *c_in = BIO_new(BIO_s_mem()), *c_out = BIO_new(BIO_s_mem());
+        BIO *s_in = BIO_new(BIO_s_mem()), *s_out = BIO_new(BIO_s_mem());
+        SSL_set_bio(cs, c_in, c_out);
+        SSL_set_bio(ss, s_in, s_out);
+
+        std::string last_flight;
+        int ce = 0, se = 0;
+        for (int i = 0; i < 10 && (ce != 1 || se != 1); i++) {
+            if (ce != 1)
+                ce = SSL_connect(cs);
+            auto to_server = drain(c_out);
+            BIO_write(s_in, to_server.data(), (int)to_server.size());
+            if (se != 1) {
+                se = SSL_accept(ss);
+                last_flight = drain(s_out);
+                BIO_write(c_in, last_flight.data(), (int)last_flight.size());
+            }
+        }
+        ASSERT_EQ(ce, 1);
+        ASSERT_EQ(se, 1);
+
+        // server: continues after the session tickets of its last flight
+        ssl::traffic_keys keys;
+        ASSERT_TRUE(ssl::traffic_keys::tx(ss, keys)) << suite;
+        keys.seq = ssl::record_count(last_flight.data(), last_flight.size());
+        EXPECT_EQ(keys.seq, 2); // OpenSSL's default ticket count
+        auto record = seal_record(keys, "hello");
+        BIO_write(c_in, record.data(), (int)record.size());
+        char buf[64];
+        int n = SSL_read(cs, buf, sizeof(buf));
+        ASSERT_EQ(n, 5) << suite;
+        EXPECT_EQ(std::string(buf, n), "hello");
+
+        // client: nothing sent with the application keys yet
+        ASSERT_TRUE(ssl::traffic_keys::tx(cs, keys));
+        EXPECT_EQ(keys.seq, 0);
+        record = seal_record(keys, "ping");
+        BIO_write(s_in, record.data(), (int)record.size());
+        n = SSL_read(ss, buf, sizeof(buf));
+        ASSERT_EQ(n, 4) << suite;
+        EXPECT_EQ(std::string(buf, n), "ping");
+
+        SSL_free(cs);
+        SSL_free(ss);
+    }
+
+    // TLS 1.2 is not supported
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->enable_ktls();
+    SSL_CTX_set_max_proto_version(server->handle(), TLS1_2_VERSION);
+    auto ss = SSL_new(server->handle());
+    ssl::traffic_keys keys;
+    EXPECT_FALSE(ssl::traffic_keys::tx(ss, keys));
+    SSL_free(ss);
+}
+
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=SslTests.DISABLED_cert_minting_benchmark
+TEST(SslTests, DISABLED_cert_minting_benchmark)
+{
+    auto ca = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("ca"), {ssl::key_type::ecdsa_p256});
+    std::pair<const char*, ssl::key_spec> specs[] = {
+        {"rsa-2048", {ssl::key_type::rsa, 2048}},
+        {"ecdsa-p256", {ssl::key_type::ecdsa_p256}},
+        {"ed25519", {ssl::key_type::ed25519}},
+    };
+    for (auto& [name, spec]: specs) {
+        auto start_time = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        int n = 0;
+        while (n < 3 || elapsed < std::chrono::milliseconds(300)) {
+            auto c = ssl::x509::create_signed_cert(ca.first, ca.second, ssl::x509::Name().cn("host"), spec);
+            n++;
+            elapsed = std::chrono::steady_clock::now() - start_time;
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        std::cout << "⏱️  " << name << ": " << n * 1000000.0 / us << " certs/s ("
+                  << us / n << " us/cert)" << std::endl;
+    }
+
+    // Signing only, keys taken from a reservoir filled beforehand
+    ssl::key_pool pool({ssl::key_type::rsa, 2048}, 8, 8);
+    for (int i = 0; i < 1000 && pool.stats().depth < 8; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i = 0; i < 8; i++)
+        ssl::x509::create_signed_cert(ca.first, ca.second, ssl::x509::Name().cn("host"), pool.take());
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+    std::cout << "⏱️  rsa-2048 pooled: " << 8 * 1000000.0 / us << " certs/s (" << us / 8 << " us/cert, "
+              << pool.stats().stalls << " stalls)" << std::endl;
+}
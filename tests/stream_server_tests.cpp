@@ -0,0 +1,107 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/stream_server.h>
+#include <acpp-network/ssl/ssl.h>
+#include <acpp-network/ssl/ssl.inl>
+
+#include <detail/common.h>
+
+extern int port;
+
+// Past max_sessions the listener waits; the waiting clients get the
+// sessions the first ones leave
+TEST(StreamServerTests, max_sessions)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<socket_stream>;
+
+    constexpr size_t n = 6;
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    stream_context c(io, side_t::server, "");
+    stream_server<stream_t> server(c, adr, {.max_sessions = 2});
+
+    size_t max_active = 0, closes = 0;
+    server.on_created_ = [&](stream_t& s) {
+        s.on_received_cb_ = [&s](const char* buf, size_t len) { s.write(buf, len); };
+    };
+    server.on_open_ = [&](stream_t&) { max_active = std::max(max_active, server.stats().active); };
+    server.on_close_ = [&](stream_t&) { closes++; };
+
+    std::vector<std::unique_ptr<stream_t>> clients;
+    size_t echoed = 0;
+    for (size_t i = 0; i < n; i++) {
+        stream_context cc(io, side_t::client, "");
+        clients.emplace_back(std::make_unique<stream_t>(cc));
+        auto& client = *clients.back();
+        client.on_connected_cb_ = [&client]() { client.write("hi", 2); };
+        client.on_received_cb_ = [&](const char*, size_t) {
+            // done: leave the session to the next one
+            client.disconnect();
+            if (++echoed == n)
+                io.stop();
+        };
+        client.last().connect(adr);
+    }
+    timer guard(io, 10000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(echoed, n);
+    EXPECT_EQ(max_active, 2u);
+    EXPECT_EQ(server.stats().created, 2u);
+    EXPECT_GE(closes, n - 2);
+}
+
+// ssl::stream can not reset: its sessions are built again in place
+TEST(StreamServerTests, rebuild)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<ssl::stream<socket_stream>>;
+
+    constexpr size_t n = 5;
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    auto cert = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    ssl::ssl_stream_context c(io, ssl::context::make_server(cert.first, cert.second));
+    stream_server<stream_t> server(c, adr);
+    server.on_created_ = [&](stream_t& s) {
+        s.on_received_cb_ = [&s](const char* buf, size_t len) { s.write(buf, len); };
+    };
+
+    size_t echoed = 0;
+    std::unique_ptr<stream_t> client;
+    std::function<void()> next = [&]() {
+        if (echoed == n) {
+            io.stop();
+            return;
+        }
+        ssl::ssl_stream_context cc(io, side_t::client, "localhost");
+        client = std::make_unique<stream_t>(cc);
+        client->on_connected_cb_ = [&]() { client->write("hello", 5); };
+        client->on_received_cb_ = [&](const char* buf, size_t len) {
+            EXPECT_EQ(std::string(buf, len), "hello");
+            echoed++;
+            // the next client once the server has seen this one go
+            server.on_close_ = [&](stream_t&) { io.exec([&]() { next(); }); };
+            io.exec([&]() { client.reset(); });
+        };
+        client->last().connect(adr);
+    };
+    next();
+    timer guard(io, 10000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(echoed, n);
+    EXPECT_EQ(server.stats().accepted, n);
+    EXPECT_EQ(server.stats().active, 0u);
+}
@@ -2,6 +2,15 @@
 #include <thread>
 #include <random>
 #include <format>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <future>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 #include <gtest/gtest.h> // googletest header file  
 
@@ -10,6 +19,8 @@
 
 #include <acpp-network/address.h>
 #include <acpp-network/stream.h>
+#include <acpp-network/framing.h>
+#include <acpp-network/handler_stream.h>
 #include <acpp-network/ssl/ssl.h>
 #include <acpp-network/ssl/ssl.inl>
 
@@ -139,6 +150,9 @@ public:
         return size;
     }
 
+    // writes are handed over whole
+    size_t pending_output() const { return 0; }
+
     void on_received(const char* buf, size_t size) {
 
     }
@@ -237,14 +251,17 @@ TEST(StreamTests, ssl_stream_test2)
 }
 
 template <typename Stream>
-void client_server_socket_stream_test() {
+void client_server_socket_stream_test(std::shared_ptr<::acpp::network::ssl::context> server_ctx = nullptr, 
+                                      std::shared_ptr<::acpp::network::ssl::context> client_ctx = nullptr,
+                                      const std::string& hostname = "") {
     using namespace acpp::network::async;
     using namespace acpp::network;
     using stream_t = Stream;
     
     io_context io; //
     ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
-    ::acpp::network::ssl::ssl_stream_context c(io, acpp::network::side_t::client, "");
+    auto c = client_ctx ? ::acpp::network::ssl::ssl_stream_context(io, client_ctx, hostname)
+                        : ::acpp::network::ssl::ssl_stream_context(io, acpp::network::side_t::client, hostname);
 
     stream_t client(c);
     //stream_t server(io, acpp::network::side_t::server);
@@ -257,7 +274,8 @@ void client_server_socket_stream_test() {
     async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io, 
         async::socket_callbacks {
             .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
-                ::acpp::network::ssl::ssl_stream_context c(io, acpp::network::side_t::server, "");
+                auto c = server_ctx ? ::acpp::network::ssl::ssl_stream_context(io, server_ctx) 
+                                    : ::acpp::network::ssl::ssl_stream_context(io, acpp::network::side_t::server, "");
                 server_sessons.emplace_back(std::make_unique<stream_t>(c));
                 auto& sess = *server_sessons.back();
                 
@@ -326,6 +344,78 @@ TEST(StreamTests, socket_stream_test2)
 }
 
 
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_filter=StreamTests.shared_server_context
+TEST(StreamTests, shared_server_context)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost").l("l").o("o").st("st"));
+    auto cert_pem = c.first.to_pem();
+    auto key_pem = c.second.to_pem();
+
+    auto from_memory = ssl::context::make_server_from_memory(cert_pem, key_pem);
+    client_server_socket_stream_test<stream_t>(from_memory);
+
+    auto cert_file = std::filesystem::temp_directory_path() / "acpp_network_test.crt";
+    auto key_file = std::filesystem::temp_directory_path() / "acpp_network_test.key";
+    c.first.save_to_file(cert_file.string());
+    std::ofstream(key_file) << key_pem;
+    auto from_files = ssl::context::make_server_from_files(cert_file.string(), key_file.string());
+    client_server_socket_stream_test<stream_t>(from_files);
+    std::filesystem::remove(cert_file);
+    std::filesystem::remove(key_file);
+
+    // every session of the same configuration shares one SSL_CTX
+    async::io_context io;
+    ssl::ssl_stream_context sc1(io, from_memory);
+    ssl::ssl_stream_context sc2(io, from_memory);
+    EXPECT_EQ(sc1.ctx()->handle(), sc2.ctx()->handle());
+    EXPECT_EQ(ssl::context::default_server(), ssl::context::default_server());
+
+    EXPECT_THROW(ssl::context::make_server_from_memory(cert_pem, 
+        ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("other")).second.to_pem()), ssl::exception);
+}
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_filter=StreamTests.session_resumption
+TEST(StreamTests, session_resumption)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost").l("l").o("o").st("st"));
+    auto keys = std::make_shared<ssl::ticket_keys>(std::chrono::hours(1), 1);
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->enable_session_cache();
+    server->enable_session_tickets(keys);
+
+    auto client = std::make_shared<ssl::context>(side_t::client);
+    client->enable_session_store();
+
+    client_server_socket_stream_test<stream_t>(server, client, "localhost");
+    EXPECT_EQ(client->sessions()->size(), 1);
+    client_server_socket_stream_test<stream_t>(server, client, "localhost");
+    client_server_socket_stream_test<stream_t>(server, client, "localhost");
+    EXPECT_EQ(server->stats().handshakes, 3);
+    EXPECT_EQ(server->stats().resumed, 2);
+    EXPECT_EQ(client->stats().resumed, 2);
+
+    // tickets of the previous key are still accepted (and renewed)
+    keys->rotate();
+    client_server_socket_stream_test<stream_t>(server, client, "localhost");
+    EXPECT_EQ(server->stats().resumed, 3);
+
+    // ... but not once it has been rotated out
+    keys->rotate();
+    keys->rotate();
+    client_server_socket_stream_test<stream_t>(server, client, "localhost");
+    EXPECT_EQ(server->stats().resumed, 3);
+    EXPECT_EQ(server->stats().handshakes, 5);
+    EXPECT_DOUBLE_EQ(server->stats().hit_rate(), 3.0 / 5.0);
+}
 
  TEST(StreamTests, socket_stream_example_org_text)
  {
@@ -386,6 +476,1105 @@ TEST(StreamTests, socket_stream_test2)
 
 }
 
+TEST(StreamTests, sni_minting)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto ca = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("proxy ca"), {ssl::key_type::ecdsa_p256});
+    auto certs = std::make_shared<ssl::cert_cache>(ca.first, ca.second, 16);
+    auto server = ssl::context::make_minting_server(certs);
+    auto client = std::make_shared<ssl::context>(side_t::client);
+
+    client_server_socket_stream_test<stream_t>(server, client, "a.test");
+    client_server_socket_stream_test<stream_t>(server, client, "b.test");
+    client_server_socket_stream_test<stream_t>(server, client, "A.test");
+    EXPECT_EQ(certs->size(), 2);
+    EXPECT_EQ(certs->stats().misses, 2);
+    EXPECT_EQ(certs->stats().hits, 1);
+    EXPECT_EQ(server->stats().handshakes, 3);
+}
+
+TEST(StreamTests, handshake_offload)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto pool = std::make_shared<ssl::crypto_pool>(2);
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"));
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->enable_handshake_offload(pool);
+    auto client = std::make_shared<ssl::context>(side_t::client);
+    client->enable_handshake_offload(pool);
+
+    client_server_socket_stream_test<stream_t>(server, client, "localhost");
+    client_server_socket_stream_test<stream_t>(server, nullptr, "localhost");
+    EXPECT_EQ(server->stats().handshakes, 2);
+    EXPECT_EQ(client->stats().handshakes, 1);
+}
+
+// A stream dropped while its handshake step still waits in a busy pool does
+// not wait for the pool to get to it.
+TEST(StreamTests, handshake_offload_cancelled)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = ::acpp::network::async::stream<::acpp::network::ssl::stream<socket_stream>>;
+
+    auto pool = std::make_shared<ssl::crypto_pool>(1);
+    std::promise<void> release;
+    pool->post([f = release.get_future().share()]() { f.wait_for(std::chrono::seconds(2)); });
+    auto client_ctx = std::make_shared<ssl::context>(side_t::client);
+    client_ctx->enable_handshake_offload(pool);
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base&, async::async_socket_base&&) {}
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context c(io, client_ctx, "localhost");
+    auto client = std::make_unique<stream_t>(c);
+    client->last().connect(adr);
+    std::chrono::steady_clock::duration took{};
+    timer t(io, 100, [&](timer&) {
+        EXPECT_EQ(pool->pending(), 1);
+        auto start = std::chrono::steady_clock::now();
+        client.reset();
+        took = std::chrono::steady_clock::now() - start;
+        io.stop();
+    });
+    io.wait_for_input();
+    release.set_value();
+    EXPECT_LT(took, std::chrono::milliseconds(500));
+}
+
+// Uses kernel TLS where the tls module is loaded, OpenSSL otherwise: the
+// exchange has to work either way.
+TEST(StreamTests, ktls)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->enable_ktls();
+    auto client = std::make_shared<ssl::context>(side_t::client);
+    client->enable_ktls();
+
+    client_server_socket_stream_test<stream_t>(server, client, "localhost");
+    client_server_socket_stream_test<stream_t>(server, nullptr, "localhost");
+    client_server_socket_stream_test<stream_t>(nullptr, client, "localhost");
+}
+
+// A plain OpenSSL client asks for a KeyUpdate, then sends "ping". A server
+// whose records are sealed outside OpenSSL can not send the KeyUpdate it owes:
+// it closes the connection instead of echoing on. Returns what the client
+// got back, or nothing when the server sealed with OpenSSL itself.
+std::optional<std::string> key_update_exchange(std::shared_ptr<::acpp::network::ssl::context> server_ctx) {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = ::acpp::network::async::stream<::acpp::network::ssl::stream<socket_stream>>;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::unique_ptr<stream_t> session;
+    bool sealed_outside = false;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base&, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_connected_cb_ = [&]() {
+                    sealed_outside = session->next().ktls_tx() || server_ctx->tx_pipeline();
+                };
+                session->on_received_cb_ = [&](const char* buf, size_t len) { session->write(buf, len); };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    std::string echoed;
+    auto client_ctx = std::make_shared<ssl::context>(side_t::client);
+    std::thread client([&]() {
+        sync::socket_base s;
+        s.create_impl(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s.connect(to_sockaddr(adr))) {
+            timeval timeout{3, 0};
+            setsockopt((int)s.fd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            auto ssl = SSL_new(client_ctx->handle());
+            SSL_set_fd(ssl, (int)s.fd());
+            if (SSL_connect(ssl) == 1 && SSL_key_update(ssl, SSL_KEY_UPDATE_REQUESTED) == 1 && SSL_write(ssl, "ping", 4) == 4) {
+                char buf[64];
+                int n;
+                while (echoed.size() < 4 && (n = SSL_read(ssl, buf, sizeof(buf))) > 0)
+                    echoed.append(buf, n);
+            }
+            SSL_free(ssl);
+            s.close();
+        }
+        io.exec([&]() { io.stop(); });
+    });
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    client.join();
+    if (!sealed_outside)
+        return std::nullopt;
+    return echoed;
+}
+
+TEST(StreamTests, ktls_key_update)
+{
+    using namespace acpp::network;
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->enable_ktls();
+    auto echoed = key_update_exchange(server);
+    if (!echoed)
+        GTEST_SKIP() << "no kernel TLS";
+    EXPECT_EQ(*echoed, "");
+}
+
+TEST(StreamTests, tx_pipeline_key_update)
+{
+    using namespace acpp::network;
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->enable_tx_pipeline(std::make_shared<ssl::crypto_pool>(1));
+    auto echoed = key_update_exchange(server);
+    ASSERT_TRUE(echoed);
+    EXPECT_EQ(*echoed, "");
+}
+
+struct early_data_result {
+    std::string received;
+    bool as_early_data = false;
+    bool accepted = false;
+};
+
+// The client writes its request before connecting and waits for the echo.
+template <typename Stream>
+early_data_result early_data_exchange(std::shared_ptr<::acpp::network::ssl::context> server_ctx,
+                                      std::shared_ptr<::acpp::network::ssl::context> client_ctx) {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = Stream;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    const std::string request = "GET /idempotent";
+    early_data_result result;
+    std::unique_ptr<stream_t> session;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    result.as_early_data |= session->next().early_data();
+                    result.received.append(buf, len);
+                    if (result.received.size() == request.size())
+                        session->write(buf, len);
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context c(io, client_ctx, "localhost");
+    stream_t client(c);
+    client.on_connected_cb_ = [&]() {
+        result.accepted = client.next().early_data_accepted();
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t size) {
+        io.stop();
+    };
+    client.write(request.data(), request.size());
+    client.last().connect(adr);
+    timer guard(io, 2000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    return result;
+}
+
+TEST(StreamTests, early_data)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto keys = std::make_shared<ssl::ticket_keys>();
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->enable_session_tickets(keys);
+    server->enable_early_data();
+    auto client = std::make_shared<ssl::context>(side_t::client);
+    client->enable_session_store();
+    client->enable_early_data();
+
+    // no session yet: sent after the handshake
+    auto r = early_data_exchange<stream_t>(server, client);
+    EXPECT_EQ(r.received, "GET /idempotent");
+    EXPECT_FALSE(r.as_early_data);
+    EXPECT_FALSE(r.accepted);
+
+    auto used = client->sessions()->get("localhost");
+    ASSERT_NE(used, nullptr);
+    r = early_data_exchange<stream_t>(server, client);
+    EXPECT_EQ(r.received, "GET /idempotent");
+    EXPECT_TRUE(r.as_early_data);
+    EXPECT_TRUE(r.accepted);
+
+    // a replayed ticket is refused: full handshake, and the request is sent
+    // again once connected
+    client->sessions()->put("localhost", used);
+    r = early_data_exchange<stream_t>(server, client);
+    EXPECT_EQ(r.received, "GET /idempotent");
+    EXPECT_FALSE(r.as_early_data);
+    EXPECT_FALSE(r.accepted);
+    EXPECT_EQ(server->stats().resumed, 1);
+
+    // without anti-replay the same ticket takes early data again
+    auto open = ssl::context::make_server(c.first, c.second);
+    open->enable_session_tickets(keys);
+    open->enable_early_data({.anti_replay = false});
+    early_data_exchange<stream_t>(open, client);
+    used = client->sessions()->get("localhost");
+    ASSERT_NE(used, nullptr);
+    EXPECT_TRUE(early_data_exchange<stream_t>(open, client).accepted);
+    client->sessions()->put("localhost", used);
+    r = early_data_exchange<stream_t>(open, client);
+    EXPECT_TRUE(r.as_early_data);
+    EXPECT_TRUE(r.accepted);
+    EXPECT_EQ(open->stats().resumed, 2);
+}
+
+// Protocols selected on each side, read at on_connected.
+template <typename Stream>
+std::pair<std::string, std::string> negotiate_alpn(std::shared_ptr<::acpp::network::ssl::context> server_ctx,
+                                                   std::shared_ptr<::acpp::network::ssl::context> client_ctx) {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = Stream;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::unique_ptr<stream_t> session;
+    std::string server_proto = "-", client_proto = "-";
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_connected_cb_ = [&]() {
+                    server_proto = session->next().alpn();
+                    io.stop(); // after the client's, with TLS 1.3
+                };
+                session->on_disconnected_cb_ = [&]() { io.stop(); };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context c(io, client_ctx, "localhost");
+    stream_t client(c);
+    client.on_connected_cb_ = [&]() {
+        client_proto = client.next().alpn();
+    };
+    client.on_disconnected_cb_ = [&]() { io.stop(); };
+    client.last().connect(adr);
+    timer guard(io, 2000, [&](timer&) { io.stop(); }); // failed handshakes do not disconnect
+    io.wait_for_input();
+    return {server_proto, client_proto};
+}
+
+TEST(StreamTests, alpn)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server = ssl::context::make_server(c.first, c.second);
+    server->set_alpn({"h2", "http/1.1"});
+    auto client = std::make_shared<ssl::context>(side_t::client);
+
+    // server preference wins
+    client->set_alpn({"http/1.1", "h2"});
+    EXPECT_EQ(negotiate_alpn<stream_t>(server, client), std::make_pair(std::string("h2"), std::string("h2")));
+    client->set_alpn({"rpc", "http/1.1"});
+    EXPECT_EQ(negotiate_alpn<stream_t>(server, client), std::make_pair(std::string("http/1.1"), std::string("http/1.1")));
+    // no common protocol: the handshake goes on without one...
+    client->set_alpn({"rpc"});
+    EXPECT_EQ(negotiate_alpn<stream_t>(server, client), std::make_pair(std::string(), std::string()));
+    // ...unless the server requires one
+    auto strict = ssl::context::make_server(c.first, c.second);
+    strict->set_alpn({"h2"}, true);
+    auto result = negotiate_alpn<stream_t>(strict, client);
+    EXPECT_EQ(result, std::make_pair(std::string("-"), std::string("-")));
+
+    EXPECT_THROW(client->set_alpn({""}), ssl::exception);
+}
+
+// The server's SSL_read returns one record at a time, so its on_received
+// calls show how the client cut its writes into records.
+TEST(StreamTests, write_coalescing)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server_ctx = ssl::context::make_server(c.first, c.second);
+    auto client_ctx = std::make_shared<ssl::context>(side_t::client);
+    client_ctx->set_write_policy({.cork = true, .initial_record = 1024, .boost_after = 8 * 1024});
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::unique_ptr<stream_t> session;
+    std::vector<size_t> records;
+    std::string small(100, 's'), large(64 * 1024, 'l');
+    const size_t total = 50 * small.size() + large.size();
+    size_t received = 0;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    records.push_back(len);
+                    received += len;
+                    if (received == total)
+                        io.stop();
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context cc(io, client_ctx, "localhost");
+    stream_t client(cc);
+    client.on_connected_cb_ = [&]() {
+        for (int i = 0; i < 50; i++)
+            client.write(small.data(), small.size());
+        client.write(large.data(), large.size());
+    };
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    ASSERT_EQ(received, total);
+    // 50 small writes plus 64 KB: 8 records of 1 KB until boost_after, then
+    // full ones, instead of 50 + 4
+    EXPECT_LE(records.size(), 16u);
+    ASSERT_GE(records.size(), 8u);
+    for (size_t i = 0; i < 8; i++)
+        EXPECT_LE(records[i], 1024u);
+    EXPECT_EQ(*std::max_element(records.begin(), records.end()), 16u * 1024);
+}
+
+// A corked write seals its full records at once and keeps the tail; it
+// still returns all it was given
+TEST(StreamTests, corked_write_size)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server_ctx = ssl::context::make_server(c.first, c.second);
+    auto client_ctx = std::make_shared<ssl::context>(side_t::client);
+    client_ctx->set_write_policy({.cork = true});
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::unique_ptr<stream_t> session;
+    std::string data(40000, 'd');
+    size_t received = 0;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    received += len;
+                    if (received == data.size())
+                        io.stop();
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context cc(io, client_ctx, "localhost");
+    stream_t client(cc);
+    size_t written = 0;
+    client.on_connected_cb_ = [&]() { written = client.write(data.data(), data.size()); };
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(written, data.size());
+    EXPECT_EQ(received, data.size());
+}
+
+// `n` connections exchange one message and go idle. Returns the server
+// session footprint and the process heap growth, per connection.
+template <typename Stream>
+std::pair<size_t, size_t> idle_connections(std::shared_ptr<::acpp::network::ssl::context> server_ctx,
+                                           std::shared_ptr<::acpp::network::ssl::context> client_ctx, size_t n) {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = Stream;
+
+    auto heap = []() -> size_t {
+#if defined(__GLIBC__)
+        return mallinfo2().uordblks;
+#else
+        return 0;
+#endif
+    };
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    std::vector<std::unique_ptr<stream_t>> sessions, clients;
+    size_t echoed = 0;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                sessions.emplace_back(std::make_unique<stream_t>(c));
+                auto& sess = *sessions.back();
+                sess.last().socket(std::move(accepted_socket));
+                sess.on_received_cb_ = [&](const char* buf, size_t len) { sess.write(buf, len); };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen((int)n);
+
+    auto before = heap();
+    for (size_t i = 0; i < n; i++) {
+        ssl::ssl_stream_context c(io, client_ctx, "localhost");
+        clients.emplace_back(std::make_unique<stream_t>(c));
+        auto& client = *clients.back();
+        client.on_connected_cb_ = [&]() { client.write("ping", 4); };
+        client.on_received_cb_ = [&](const char* buf, size_t len) {
+            if (++echoed == n)
+                io.stop();
+        };
+        client.last().connect(adr);
+    }
+    timer guard(io, 20000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+    EXPECT_EQ(echoed, n);
+
+    size_t footprint = 0;
+    for (auto& s: sessions)
+        footprint += s->memory_footprint();
+    // both ends of each connection live in this process
+    return {footprint / n, (heap() - before) / n};
+}
+
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_filter=StreamTests.idle_memory
+TEST(StreamTests, idle_memory)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server = ssl::context::make_server(c.first, c.second);
+    auto client = std::make_shared<ssl::context>(side_t::client);
+    auto [footprint, heap] = idle_connections<stream_t>(server, client, 200);
+
+    auto lean_server = ssl::context::make_server(c.first, c.second);
+    lean_server->enable_buffer_release();
+    auto lean_client = std::make_shared<ssl::context>(side_t::client);
+    lean_client->enable_buffer_release();
+    auto [lean_footprint, lean_heap] = idle_connections<stream_t>(lean_server, lean_client, 200);
+
+    std::cout << "⏱️  idle connection: session " << footprint << " bytes, heap " << heap << " bytes per connection" << std::endl;
+    std::cout << "⏱️  idle connection, buffer release: session " << lean_footprint << " bytes, heap " << lean_heap << " bytes per connection" << std::endl;
+    EXPECT_LE(lean_footprint + 16 * 1024, footprint); // the plaintext buffer
+    EXPECT_LE(lean_footprint, sizeof(stream_t));
+#if defined(__GLIBC__)
+    EXPECT_LT(lean_heap, heap);
+#endif
+}
+
+// A producer echoed back to a reader that keeps pausing: the echo server
+// stops reading while its output is pending and the producer only writes
+// while its own output drains, so nothing piles up on either side.
+template <typename Stream>
+void backpressure(std::shared_ptr<::acpp::network::ssl::context> server_ctx) {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    constexpr size_t total = 32 * 1024 * 1024;
+    constexpr size_t high_water = 256 * 1024;
+    auto pattern = [](size_t i) { return (char)(i * 13 + (i >> 12)); };
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    std::unique_ptr<Stream> session;
+    size_t session_max_pending = 0, pauses = 0;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<Stream>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    session->write(buf, len);
+                    session_max_pending = std::max(session_max_pending, session->pending_output());
+                    if (session->pending_output()) {
+                        session->pause_reading();
+                        pauses++;
+                    }
+                };
+                session->on_drained_cb_ = [&]() { session->resume_reading(); };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context cc(io, side_t::client, "localhost");
+    Stream client(cc);
+    std::vector<char> chunk(64 * 1024);
+    size_t sent = 0, received = 0, client_max_pending = 0;
+    bool ok = true;
+    auto produce = [&]() {
+        while (sent < total && client.pending_output() < high_water) {
+            auto n = std::min(chunk.size(), total - sent);
+            for (size_t i = 0; i < n; i++)
+                chunk[i] = pattern(sent + i);
+            client.write(chunk.data(), n);
+            sent += n;
+            client_max_pending = std::max(client_max_pending, client.pending_output());
+        }
+    };
+    std::unique_ptr<timer> nap;
+    client.on_connected_cb_ = produce;
+    client.on_drained_cb_ = produce;
+    client.on_received_cb_ = [&](const char* buf, size_t len) {
+        for (size_t i = 0; i < len; i++)
+            ok = ok && buf[i] == pattern(received + i);
+        auto before = received;
+        received += len;
+        if (received == total) {
+            io.stop();
+        } else if (before / (4 * 1024 * 1024) != received / (4 * 1024 * 1024)) {
+            // a slow reader
+            client.pause_reading();
+            nap = std::make_unique<timer>(io, 20, [&](timer&) { client.resume_reading(); });
+        }
+    };
+    client.last().connect(adr);
+    timer guard(io, 20000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(received, total);
+    EXPECT_TRUE(ok);
+    EXPECT_GT(pauses, 0u);
+    // one received buffer at most over the mark
+    EXPECT_LE(session_max_pending, 64u * 1024);
+    EXPECT_LE(client_max_pending, high_water + chunk.size());
+}
+
+TEST(StreamTests, backpressure)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    backpressure<::acpp::network::async::stream<socket_stream_t>>(ssl::context::make_server(c.first, c.second));
+    backpressure<::acpp::network::async::stream<ssl_stream_t>>(ssl::context::make_server(c.first, c.second));
+}
+
+// A writer that keeps up to 16 MB queued in front of a reader that naps
+// every 16 MB; 1 GB goes through the output queue.
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=StreamTests.DISABLED_slow_reader_benchmark
+TEST(StreamTests, DISABLED_slow_reader_benchmark)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = stream<socket_stream>;
+
+    constexpr size_t total = 1024 * 1024 * 1024;
+    constexpr size_t chunk = 1024 * 1024;
+    constexpr size_t queued = 16 * 1024 * 1024;
+    constexpr size_t period = 65537;
+    std::vector<char> data(period + chunk);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char)((i % period) * 7 + ((i % period) >> 8));
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    std::unique_ptr<stream_t> session;
+    size_t sent = 0, max_pending = 0;
+    auto produce = [&]() {
+        while (sent < total && session->pending_output() < queued) {
+            auto n = std::min(chunk, total - sent);
+            session->write(data.data() + sent % period, n);
+            sent += n;
+        }
+        max_pending = std::max(max_pending, session->pending_output());
+    };
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                stream_context c(io, side_t::server, "");
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_drained_cb_ = produce;
+                produce();
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    stream_context cc(io, side_t::client, "");
+    stream_t client(cc);
+    size_t received = 0;
+    bool ok = true;
+    std::unique_ptr<timer> nap;
+    std::chrono::steady_clock::time_point start_time;
+    client.on_connected_cb_ = [&]() { start_time = std::chrono::steady_clock::now(); };
+    client.on_received_cb_ = [&](const char* buf, size_t len) {
+        for (size_t done = 0; done < len;) {
+            auto n = std::min(len - done, chunk);
+            ok = ok && !memcmp(buf + done, data.data() + (received + done) % period, n);
+            done += n;
+        }
+        auto before = received;
+        received += len;
+        if (received == total) {
+            io.stop();
+        } else if (before / queued != received / queued) {
+            client.pause_reading();
+            nap = std::make_unique<timer>(io, 5, [&](timer&) { client.resume_reading(); });
+        }
+    };
+    client.last().connect(adr);
+    timer guard(io, 60000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+    EXPECT_EQ(received, total);
+    EXPECT_TRUE(ok);
+    EXPECT_GE(max_pending, queued);
+    ASSERT_TRUE(session);
+    EXPECT_EQ(session->pending_output(), 0u);
+    // no block left queued, only the slice table of the backlog
+    EXPECT_LT(session->memory_footprint(), sizeof(stream_t) + acpp::network::async::iobuf_pool::large_block);
+    std::cout << "⏱️  slow reader: " << total / (1024 * 1024) << " MB in " << us / 1000 << "ms, "
+              << (double)total / us << " MB/s, up to " << max_pending / 1024 << " KB queued" << std::endl;
+}
+
+namespace {
+
+using framed_socket = acpp::network::async::framing_layer<acpp::network::async::socket_stream>;
+
+class echo_session: public acpp::network::async::handler_stream<echo_session, framed_socket> {
+public:
+    using handler_stream::handler_stream;
+    void on_received(const char* buf, size_t len) { write(buf, len); }
+};
+
+class ping_client: public acpp::network::async::handler_stream<ping_client, framed_socket> {
+public:
+    ping_client(acpp::network::async::stream_context& c, size_t n): handler_stream(c), n_(n) {}
+
+    void on_connected() { write("ping", 4); }
+    void on_received(const char* buf, size_t len) {
+        ok_ = ok_ && std::string_view(buf, len) == "ping";
+        if (++echoed_ < n_)
+            write("ping", 4);
+        else
+            disconnect();
+    }
+    void on_disconnected() { disconnected_ = true; }
+
+    size_t n_, echoed_ = 0;
+    bool ok_ = true, disconnected_ = false;
+};
+
+// Counts what comes up, for the dispatch benchmark
+class counting_session: public acpp::network::async::handler_stream<counting_session, framed_socket> {
+public:
+    using handler_stream::handler_stream;
+    void on_received(const char* buf, size_t len) { messages_++; bytes_ += len; }
+
+    size_t messages_ = 0, bytes_ = 0;
+};
+
+}
+
+// Sessions whose upcalls are their own member functions
+TEST(StreamTests, handler_stream)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    std::unique_ptr<echo_session> session;
+    async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        socket_callbacks {
+            .on_accepted = [&](async_socket_base&, async_socket_base&& s) {
+                stream_context c(io, side_t::server, "");
+                session = std::make_unique<echo_session>(c);
+                session->last().socket(std::move(s));
+            }
+        });
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    stream_context cc(io, side_t::client, "");
+    ping_client client(cc, 100);
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    timer poll(io, 10, [&](timer& t) {
+        if (client.echoed_ == client.n_)
+            io.stop();
+    });
+    io.wait_for_input();
+
+    EXPECT_EQ(client.echoed_, 100u);
+    EXPECT_TRUE(client.ok_);
+    ASSERT_TRUE(session);
+    EXPECT_EQ(session->next().stats().frames, 100u);
+}
+
+// Frames of 15 bytes handed up by a socket_stream, to a stream<> with
+// on_received_cb_ and to a handler_stream: what the chain costs per message.
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=StreamTests.DISABLED_handler_dispatch_benchmark
+TEST(StreamTests, DISABLED_handler_dispatch_benchmark)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    constexpr size_t frames = 64 * 1024, rounds = 100;
+    std::string input;
+    for (size_t i = 0; i < frames; i++)
+        input += "\x0f" + std::string(15, (char)('a' + i % 26));
+
+    io_context io;
+    stream_context c(io, side_t::server, "");
+    auto run = [&](auto& s) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; r++)
+            s.last().on_received(input.data(), input.size());
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (frames * rounds);
+    };
+
+    stream<framed_socket> callbacks(c);
+    size_t messages = 0, bytes = 0;
+    callbacks.on_received_cb_ = [&](const char*, size_t len) {
+        messages++;
+        bytes += len;
+    };
+    auto callback_ns = run(callbacks);
+    EXPECT_EQ(messages, frames * rounds);
+    EXPECT_EQ(bytes, 15 * frames * rounds);
+
+    counting_session handler(c);
+    auto handler_ns = run(handler);
+    EXPECT_EQ(handler.messages_, frames * rounds);
+    EXPECT_EQ(handler.bytes_, 15 * frames * rounds);
+
+    std::cout << "⏱️  " << frames * rounds << " framed messages up the chain: std::function " << callback_ns
+              << " ns/message, handler_stream " << handler_ns << " ns/message" << std::endl;
+}
+
+// Both sides seal on the pipeline; the server echoes and the client closes.
+TEST(StreamTests, tx_pipeline)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto pool = std::make_shared<ssl::crypto_pool>(2);
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server_ctx = ssl::context::make_server(c.first, c.second);
+    server_ctx->enable_tx_pipeline(pool);
+    auto client_ctx = std::make_shared<ssl::context>(side_t::client);
+    client_ctx->enable_tx_pipeline(pool, 32 * 1024);
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    // around the record size, batch size and inline threshold
+    const std::vector<size_t> sizes = {100, 70000, 5, 300000, 16384, 1, 16385, 1000000};
+    std::string sent;
+    std::mt19937 rng(7);
+    for (size_t size: sizes) {
+        size_t at = sent.size();
+        sent.resize(at + size);
+        for (size_t i = at; i < sent.size(); i++)
+            sent[i] = (char)rng();
+    }
+
+    std::unique_ptr<stream_t> session;
+    std::string received, echoed;
+    bool disconnected = false;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    received.append(buf, len);
+                    session->write(buf, len);
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context cc(io, client_ctx, "localhost");
+    stream_t client(cc);
+    client.on_connected_cb_ = [&]() {
+        size_t at = 0;
+        for (size_t size: sizes) {
+            client.write(sent.data() + at, size);
+            at += size;
+        }
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t size) {
+        echoed.append(buf, size);
+        if (echoed.size() == sent.size())
+            client.disconnect();
+    };
+    client.on_disconnected_cb_ = [&]() {
+        disconnected = true; // the server got our close_notify and answered
+        io.stop();
+    };
+    client.last().connect(adr);
+    timer guard(io, 10000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_TRUE(received == sent);
+    EXPECT_TRUE(echoed == sent);
+    EXPECT_TRUE(disconnected);
+}
+
+// Loop latency of the server io_context while `n` clients handshake at once.
+template <typename Stream>
+void handshake_storm(std::shared_ptr<::acpp::network::ssl::context> server_ctx, size_t n, const char* name) {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = Stream;
+
+    io_context server_io, client_io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::vector<std::unique_ptr<stream_t>> sessions;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, server_io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(server_io, server_ctx);
+                sessions.emplace_back(std::make_unique<stream_t>(c));
+                auto& sess = *sessions.back();
+                sess.last().socket(std::move(accepted_socket));
+                sess.on_received_cb_ = [&sess](const char* buf, size_t len) {
+                    sess.write(buf, len);
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen((int)n);
+    std::thread server_thread([&]() { server_io.wait_for_input(); });
+
+    // probe: how long a task posted to the server loop waits to run
+    std::vector<int64_t> delays; // server loop only
+    std::atomic<bool> probing = true;
+    std::thread probe([&]() {
+        while (probing) {
+            auto posted = std::chrono::steady_clock::now();
+            server_io.exec([&delays, posted]() {
+                delays.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - posted).count());
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    std::string msg("hello");
+    size_t echoed = 0;
+    std::vector<std::unique_ptr<stream_t>> clients;
+    auto start_time = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        ssl::ssl_stream_context c(client_io, side_t::client, "localhost");
+        clients.emplace_back(std::make_unique<stream_t>(c));
+        auto& client = *clients.back();
+        client.on_connected_cb_ = [&]() {
+            client.write(msg.c_str(), msg.size());
+        };
+        client.on_received_cb_ = [&](const char* buf, size_t size) {
+            if (++echoed == n)
+                client_io.stop();
+        };
+        client.last().connect(adr);
+    }
+    timer guard(client_io, 30000, [&](timer&) { client_io.stop(); });
+    client_io.wait_for_input();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+
+    probing = false;
+    probe.join();
+    server_io.exec([&]() { server_io.stop(); });
+    server_thread.join();
+
+    EXPECT_EQ(echoed, n);
+    std::sort(delays.begin(), delays.end());
+    if (!delays.empty()) {
+        std::cout << "⏱️  " << name << ": " << n << " handshakes in " << elapsed.count() << "ms, loop latency p50 "
+                  << delays[delays.size() / 2] << "us p99 " << delays[delays.size() * 99 / 100]
+                  << "us max " << delays.back() << "us" << std::endl;
+    }
+}
+
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=StreamTests.DISABLED_handshake_storm_benchmark
+TEST(StreamTests, DISABLED_handshake_storm_benchmark)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::rsa, 4096});
+    auto inline_ctx = ssl::context::make_server(c.first, c.second);
+    handshake_storm<stream_t>(inline_ctx, 32, "inline");
+
+    auto offload_ctx = ssl::context::make_server(c.first, c.second);
+    offload_ctx->enable_handshake_offload(std::make_shared<ssl::crypto_pool>());
+    handshake_storm<stream_t>(offload_ctx, 32, "offload");
+}
+
+// Client streams `total` bytes to the server in blocks; the server acks each
+// block so the socket queues never grow.
+template <typename Stream>
+void tls_bulk_transfer(std::shared_ptr<::acpp::network::ssl::context> server_ctx, size_t total, size_t block, const char* name,
+                       std::shared_ptr<::acpp::network::ssl::context> client_ctx = nullptr) {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+    using stream_t = Stream;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+
+    std::unique_ptr<stream_t> session;
+    size_t received = 0;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<stream_t>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    auto blocks = received / block;
+                    received += len;
+                    if (received / block != blocks)
+                        session->write("k", 1);
+                };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    std::string data(block, 'x');
+    size_t sent = 0;
+    std::chrono::steady_clock::time_point start_time;
+    auto c = client_ctx ? ssl::ssl_stream_context(io, client_ctx, "localhost")
+                        : ssl::ssl_stream_context(io, side_t::client, "localhost");
+    stream_t client(c);
+    client.on_connected_cb_ = [&]() {
+        start_time = std::chrono::steady_clock::now();
+        client.write(data.data(), data.size());
+        sent += data.size();
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t size) {
+        if (sent >= total) {
+            io.stop();
+            return;
+        }
+        client.write(data.data(), data.size());
+        sent += data.size();
+    };
+    client.last().connect(adr);
+    timer guard(io, 20000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+    EXPECT_EQ(received, total);
+    std::cout << "⏱️  " << name << ": " << total / (1024 * 1024) << " MB in " << us / 1000 << "ms, "
+              << (double)total / us << " MB/s" << std::endl;
+}
+
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=StreamTests.DISABLED_tls_bulk_throughput_benchmark
+TEST(StreamTests, DISABLED_tls_bulk_throughput_benchmark)
+{
+    using namespace acpp::network;
+    using socket_stream_t = ::acpp::network::async::socket_stream;
+    using ssl_stream_t = ::acpp::network::ssl::stream<socket_stream_t>;
+    using stream_t = ::acpp::network::async::stream<ssl_stream_t>;
+
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server = ssl::context::make_server(c.first, c.second);
+    tls_bulk_transfer<stream_t>(server, 256 * 1024 * 1024, 256 * 1024, "tls bulk 256K blocks");
+    tls_bulk_transfer<stream_t>(server, 32 * 1024 * 1024, 4 * 1024, "tls bulk 4K blocks");
+
+    auto read_ahead = ssl::context::make_server(c.first, c.second);
+    read_ahead->set_buffer_sizes(64 * 1024, 64 * 1024);
+    tls_bulk_transfer<stream_t>(read_ahead, 256 * 1024 * 1024, 256 * 1024, "tls bulk 256K blocks, read ahead");
+
+    auto pipelined = std::make_shared<ssl::context>(side_t::client);
+    pipelined->enable_tx_pipeline(std::make_shared<ssl::crypto_pool>());
+    tls_bulk_transfer<stream_t>(read_ahead, 256 * 1024 * 1024, 256 * 1024, "tls bulk 256K blocks, read ahead, tx pipeline", pipelined);
+}
+
 // ./build.sh && ./build/tests/acpp-network-tests --gtest_filter=StreamTests.socket_stream_server
 
 TEST(StreamTests, DISABLED_socket_stream_server)
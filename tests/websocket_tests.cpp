@@ -0,0 +1,338 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h> // googletest header file
+
+#include <acpp-network/socket.h>
+#include <acpp-network/socket.inl>
+
+#include <acpp-network/address.h>
+#include <acpp-network/stream.h>
+#include <acpp-network/websocket.h>
+#include <acpp-network/ssl/ssl.h>
+#include <acpp-network/ssl/ssl.inl>
+
+#include <detail/common.h>
+
+extern int port;
+
+namespace {
+
+using namespace acpp::network;
+
+const std::string client_key = "dGhlIHNhbXBsZSBub25jZQ==";
+
+const std::string upgrade_request =
+    "GET /chat HTTP/1.1\r\n"
+    "Host: server.example.com\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: " + client_key + "\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+// A frame as a client sends it
+std::string client_frame(websocket::opcode op, bool fin, const std::string& payload) {
+    char header[websocket::max_frame_header];
+    websocket::mask_key key{0x37, 0xfa, 0x21, 0x3d};
+    auto n = websocket::write_frame_header(header, op, fin, payload.size(), &key);
+    std::string frame(header, n);
+    for (size_t i = 0; i < payload.size(); i++)
+        frame.push_back(payload[i] ^ key[i & 3]);
+    return frame;
+}
+
+}
+
+TEST(WebsocketTests, accept_key)
+{
+    // RFC 6455 1.3
+    EXPECT_EQ(websocket::accept_key(client_key), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+    EXPECT_EQ(websocket::make_client_key().size(), 24u);
+}
+
+// Every kernel against the byte by byte definition, at every alignment,
+// length and phase
+TEST(WebsocketTests, mask)
+{
+    auto saved = websocket::mask_level();
+    websocket::mask_key key{0x12, 0x34, 0x56, 0x78};
+    std::vector<char> src(300), dst(301), expected(300);
+    std::mt19937 gen(3);
+    for (auto& c: src)
+        c = (char)gen();
+    for (auto level: {http::simd::scalar, http::simd::sse42, http::simd::avx2}) {
+        if (websocket::mask_level(level) != level)
+            continue;
+        for (size_t offset: {0, 1, 3})
+            for (size_t len = 0; len + offset < src.size(); len += len < 70 ? 1 : 37)
+                for (size_t phase = 0; phase < 4; phase++) {
+                    for (size_t i = 0; i < len; i++)
+                        expected[i] = src[offset + i] ^ key[(phase + i) & 3];
+                    auto next = websocket::mask(dst.data() + 1, src.data() + offset, len, key, phase);
+                    EXPECT_EQ(next, (phase + len) & 3);
+                    ASSERT_EQ(std::string(dst.data() + 1, len), std::string(expected.data(), len))
+                        << "level " << (int)level << " offset " << offset << " len " << len << " phase " << phase;
+                }
+        // in place, continued over pieces
+        std::vector<char> data(src);
+        size_t phase = 0;
+        for (size_t pos = 0; pos < data.size(); pos += 37)
+            phase = websocket::mask(data.data() + pos, data.data() + pos, std::min<size_t>(37, data.size() - pos), key, phase);
+        for (size_t i = 0; i < data.size(); i++)
+            ASSERT_EQ(data[i], (char)(src[i] ^ key[i & 3]));
+    }
+    websocket::mask_level(saved);
+}
+
+// Handshake and frames fed in one buffer and split at random points: the
+// payload goes up fragment by fragment, unmasked
+TEST(WebsocketTests, receive)
+{
+    using namespace acpp::network::async;
+    using stream_t = stream<websocket::websocket_layer<layer<>>>;
+
+    std::string big(200000, 'b');
+    for (size_t i = 0; i < big.size(); i++)
+        big[i] = (char)('a' + i % 26);
+    std::string wire = upgrade_request
+        + client_frame(websocket::opcode::text, true, "hello")
+        + client_frame(websocket::opcode::binary, false, "frag1-")
+        + client_frame(websocket::opcode::ping, true, "are you there")
+        + client_frame(websocket::opcode::continuation, false, std::string(300, 'x'))
+        + client_frame(websocket::opcode::continuation, true, "-end")
+        + client_frame(websocket::opcode::binary, true, big)
+        + client_frame(websocket::opcode::binary, true, "");
+    std::vector<std::string> expected = {"hello", "frag1-" + std::string(300, 'x') + "-end", big, ""};
+
+    std::mt19937 gen(11);
+    for (size_t max_split: {wire.size(), (size_t)1, (size_t)100, (size_t)9000}) {
+        stream_t s(side_t::server);
+        bool connected = false;
+        s.on_connected_cb_ = [&]() { connected = true; };
+        std::vector<std::string> messages;
+        std::vector<websocket::opcode> types;
+        size_t pieces = 0, largest = 0;
+        s.next().on_message_begin_cb_ = [&](websocket::opcode op) {
+            types.push_back(op);
+            messages.emplace_back();
+        };
+        s.on_received_cb_ = [&](const char* buf, size_t len) {
+            ASSERT_FALSE(messages.empty());
+            messages.back().append(buf, len);
+            pieces++;
+            largest = std::max(largest, len);
+        };
+        size_t ended = 0;
+        s.next().on_message_end_cb_ = [&]() { ended++; };
+
+        auto last = s.last();
+        size_t pos = 0;
+        while (pos < wire.size()) {
+            size_t n = std::min(wire.size() - pos, (size_t)std::uniform_int_distribution<size_t>(1, max_split)(gen));
+            last.on_received<stream_t::chain_type>(wire.data() + pos, n);
+            pos += n;
+        }
+        EXPECT_TRUE(connected);
+        EXPECT_EQ(s.next().state(), stream_t::next_type::status::open);
+        EXPECT_EQ(messages, expected);
+        EXPECT_EQ(ended, expected.size());
+        EXPECT_EQ(types, (std::vector{websocket::opcode::text, websocket::opcode::binary,
+                                      websocket::opcode::binary, websocket::opcode::binary}));
+        // the large message is never held whole
+        EXPECT_LE(largest, 64u * 1024);
+        if (max_split == wire.size()) {
+            EXPECT_GE(pieces, big.size() / (64 * 1024));
+        }
+    }
+}
+
+TEST(WebsocketTests, errors)
+{
+    using namespace acpp::network::async;
+    using stream_t = stream<websocket::websocket_layer<layer<>>>;
+
+    auto run = [](const std::string& wire) {
+        stream_t s(side_t::server);
+        uint16_t code = 0;
+        s.next().on_close_cb_ = [&](uint16_t c, std::string_view) { code = c; };
+        s.last().on_received<stream_t::chain_type>(wire.data(), wire.size());
+        EXPECT_EQ(s.next().state(), stream_t::next_type::status::closed);
+        return code;
+    };
+    // not an upgrade
+    EXPECT_EQ(run("GET / HTTP/1.1\r\nHost: a\r\n\r\n"), 0);
+    // unmasked client frame
+    std::string unmasked("\x82\x01x", 3);
+    EXPECT_EQ(run(upgrade_request + unmasked), 1002);
+    // fragmented control frame
+    EXPECT_EQ(run(upgrade_request + client_frame(websocket::opcode::ping, false, "")), 1002);
+    // continuation without a message
+    EXPECT_EQ(run(upgrade_request + client_frame(websocket::opcode::continuation, true, "x")), 1002);
+    // new message inside a fragmented one
+    EXPECT_EQ(run(upgrade_request + client_frame(websocket::opcode::text, false, "a")
+                  + client_frame(websocket::opcode::text, true, "b")), 1002);
+    // close from the peer
+    EXPECT_EQ(run(upgrade_request + client_frame(websocket::opcode::close, true, std::string("\x03\xe9", 2))), 1001);
+}
+
+// Messages of every length encoding echoed back whole; the client closes
+template <typename Stream>
+void websocket_echo() {
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    auto c = ssl::x509::create_self_signed_cert(ssl::x509::Name().cn("localhost"), {ssl::key_type::ecdsa_p256});
+    auto server_ctx = ssl::context::make_server(c.first, c.second);
+
+    std::vector<std::string> messages;
+    for (size_t size: {1, 125, 126, 65535, 65536, 1024 * 1024, 0})
+        messages.push_back(std::string(size, (char)('a' + messages.size())));
+    std::string head("head:"), tail(":tail");
+    messages.push_back(head + messages[1] + tail);
+
+    std::unique_ptr<Stream> session;
+    std::string assembled;
+    uint16_t server_close = 0;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                ssl::ssl_stream_context c(io, server_ctx);
+                session = std::make_unique<Stream>(c);
+                session->last().socket(std::move(accepted_socket));
+                session->on_received_cb_ = [&](const char* buf, size_t len) {
+                    assembled.append(buf, len);
+                };
+                session->next().on_message_end_cb_ = [&]() {
+                    session->write(assembled.data(), assembled.size());
+                    assembled.clear();
+                };
+                session->next().on_close_cb_ = [&](uint16_t code, std::string_view) { server_close = code; };
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    ssl::ssl_stream_context cc(io, side_t::client, "localhost");
+    Stream client(cc);
+    client.next().options({.path = "/feed"});
+    std::vector<std::string> received;
+    std::string current;
+    uint16_t client_close = 0;
+    client.on_connected_cb_ = [&]() {
+        for (size_t i = 0; i + 1 < messages.size(); i++)
+            client.write(messages[i].data(), messages[i].size());
+        const_buffer parts[] = {{head.data(), head.size()}, {messages[1].data(), messages[1].size()}, {tail.data(), tail.size()}};
+        client.writev(parts, 3);
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t len) {
+        current.append(buf, len);
+    };
+    client.next().on_message_end_cb_ = [&]() {
+        received.push_back(std::move(current));
+        current.clear();
+        if (received.size() == messages.size())
+            client.disconnect();
+    };
+    // the server's answer to our close ends the handshake
+    client.next().on_close_cb_ = [&](uint16_t code, std::string_view) {
+        client_close = code;
+        io.stop();
+    };
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    EXPECT_EQ(received, messages);
+    EXPECT_EQ(server_close, 1000);
+    EXPECT_EQ(client_close, 1000);
+}
+
+TEST(WebsocketTests, socket_stream)
+{
+    using namespace acpp::network::async;
+    websocket_echo<stream<websocket::websocket_layer<socket_stream>>>();
+}
+
+TEST(WebsocketTests, ssl_stream)
+{
+    using namespace acpp::network::async;
+    websocket_echo<stream<websocket::websocket_layer<::acpp::network::ssl::stream<socket_stream>>>>();
+}
+
+// A raw client: the server answers the handshake, a ping and a close
+TEST(WebsocketTests, ping_close)
+{
+    using namespace acpp::network::async;
+    using namespace acpp::network;
+
+    io_context io;
+    ip_socketaddress adr = ip4_sockaddress("127.0.0.1", port++);
+    using server_t = stream<websocket::websocket_layer<socket_stream>>;
+    std::unique_ptr<server_t> session;
+    async::async_socket_base server_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP, io,
+        async::socket_callbacks {
+            .on_accepted = [&](async::async_socket_base& server, async::async_socket_base&& accepted_socket) {
+                stream_context c(io, side_t::server, "");
+                session = std::make_unique<server_t>(c);
+                session->last().socket(std::move(accepted_socket));
+            }
+        }
+    );
+    server_socket.bind(to_sockaddr(adr));
+    server_socket.listen(1);
+
+    stream_context cc(io, side_t::client, "");
+    stream<socket_stream> client(cc);
+    std::string response;
+    client.on_connected_cb_ = [&]() {
+        auto out = upgrade_request + client_frame(websocket::opcode::ping, true, "tick")
+                 + client_frame(websocket::opcode::close, true, std::string("\x03\xe8" "bye", 5));
+        client.write(out.data(), out.size());
+    };
+    client.on_received_cb_ = [&](const char* buf, size_t len) { response.append(buf, len); };
+    client.on_disconnected_cb_ = [&]() { io.stop(); };
+    client.last().connect(adr);
+    timer guard(io, 5000, [&](timer&) { io.stop(); });
+    io.wait_for_input();
+
+    auto end = response.find("\r\n\r\n");
+    ASSERT_NE(end, std::string::npos);
+    auto head = response.substr(0, end);
+    EXPECT_EQ(head.substr(0, 12), "HTTP/1.1 101");
+    EXPECT_NE(head.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo="), std::string::npos);
+    // pong with the ping's payload, then the close echoed, unmasked
+    EXPECT_EQ(response.substr(end + 4), std::string("\x8a\x04tick\x88\x02\x03\xe8", 10));
+}
+
+// ./build.sh && ./build/tests/acpp-network-tests --gtest_also_run_disabled_tests --gtest_filter=WebsocketTests.DISABLED_mask_benchmark
+TEST(WebsocketTests, DISABLED_mask_benchmark)
+{
+    auto saved = websocket::mask_level();
+    websocket::mask_key key{1, 2, 3, 4};
+    std::pair<const char*, http::simd> levels[] = {{"scalar", http::simd::scalar}, {"sse2", http::simd::sse42}, {"avx2", http::simd::avx2}};
+    // market data ticks and a snapshot
+    for (size_t size: {64, 512, 256 * 1024}) {
+        std::vector<char> data(size, 'x');
+        for (auto [name, level]: levels) {
+            if (websocket::mask_level(level) != level)
+                continue;
+            auto start_time = std::chrono::steady_clock::now();
+            size_t rounds = 0;
+            while (std::chrono::steady_clock::now() - start_time < std::chrono::milliseconds(300)) {
+                for (int i = 0; i < 64; i++)
+                    websocket::mask(data.data(), data.data(), data.size(), key, i);
+                rounds += 64;
+            }
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+            std::cout << "⏱️  " << size << " bytes, " << name << ": " << (double)rounds * size / us << " MB/s" << std::endl;
+        }
+    }
+    websocket::mask_level(saved);
+}